@@ -1,7 +1,10 @@
 #include "application.h"
 
+#include "engine_cull.h"
 #include "engine_object.h"
+#include "engine_transform.h"
 #include "engine_vulkan.h"
+#include "threadpool.h"
 
 #include <windows.h>
 
@@ -17,6 +20,18 @@ bool application_init(struct Application *app) {
 	}
 	app->execute_path[i + 1] = '\0';
 
+	// Start worker threads, the main thread makes up the last slice
+	ret = threadpool_init(app->thread_pool, threadpool_processorcount() - 1);
+	if (ret == false) {
+		fprintf(stderr, "Failed to create thread pool.\n");
+		return false;
+	}
+
+	// Pick the widest SIMD kernels the CPU supports
+	transform_init();
+	cull_init();
+	printf("SIMD kernels: %s\n", transform_pathname(transform_getpath()));
+
 	// Initialize GLFW
 	glfwInit();
 
@@ -126,4 +141,6 @@ void application_close(struct Application *app) {
 	// End window & GLFW
 	glfwDestroyWindow(app->window);
 	glfwTerminate();
+	// Stop worker threads
+	threadpool_destroy(app->thread_pool);
 }
\ No newline at end of file
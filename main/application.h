@@ -12,6 +12,7 @@ struct Application {
 	GLFWwindow *window;
 	struct VulkanData *vulkan_data;
 	struct ObjectGroup *object_group;
+	struct ThreadPool *thread_pool;
 };
 
 bool application_init(struct Application *);
@@ -0,0 +1,100 @@
+#include "engine_transform.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*
+	Microbenchmark of the transform kernels. Every path the CPU supports builds the same 2D and 3D
+	transforms, its rate is printed and its output must match the scalar path bit for bit.
+*/
+
+// Not a multiple of the vector width, so the tails of the vector paths are checked too
+#define BENCH_OBJECTS 100003
+#define BENCH_ROUNDS 50
+#define BENCH_PATHS 3
+
+double bench_seconds() {
+	struct timespec now;
+	timespec_get(&now, TIME_UTC);
+	return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+// Uniform value in [min, max) from a fixed sequence, so every run sees the same input
+float bench_random(float min, float max) {
+	return min + (max - min) * ((float)rand() / ((float)RAND_MAX + 1.0f));
+}
+
+// Transforms per second of one build function over all objects
+double bench_rate(void (*build)(const float *const[3], const float *const[3], size_t, size_t,
+								union ObjectTransform *),
+				  const float *const pos[3], const float *const rot[3],
+				  union ObjectTransform *out) {
+	double start = bench_seconds();
+	int round;
+	for (round = 0; round < BENCH_ROUNDS; round++) {
+		build(pos, rot, 0, BENCH_OBJECTS, out);
+	}
+	return (double)BENCH_OBJECTS * BENCH_ROUNDS / (bench_seconds() - start);
+}
+
+int main() {
+	float *streams = malloc(sizeof(*streams) * BENCH_OBJECTS * 6);
+	union ObjectTransform *out[BENCH_PATHS][2] = {{NULL}};
+	size_t out_bytes = sizeof(union ObjectTransform) * BENCH_OBJECTS;
+	bool ret = streams != NULL;
+
+	// Zeroed so padding the 2D kernels leave alone compares equal
+	int p, i;
+	for (p = 0; p < BENCH_PATHS && ret; p++) {
+		out[p][0] = calloc(1, out_bytes);
+		out[p][1] = calloc(1, out_bytes);
+		ret = out[p][0] != NULL && out[p][1] != NULL;
+	}
+	if (ret == false) {
+		fprintf(stderr, "Failure to allocate benchmark data.\n");
+		return EXIT_FAILURE;
+	}
+
+	const float *pos[3], *rot[3];
+	srand(1);
+	for (i = 0; i < 3; i++) {
+		pos[i] = streams + BENCH_OBJECTS * i;
+		rot[i] = streams + BENCH_OBJECTS * (i + 3);
+	}
+	for (i = 0; i < BENCH_OBJECTS * 3; i++) {
+		streams[i] = bench_random(-1000.0f, 1000.0f);
+		streams[BENCH_OBJECTS * 3 + i] = bench_random(-100.0f, 100.0f);
+	}
+
+	printf("%d objects, %d rounds per path\n", BENCH_OBJECTS, BENCH_ROUNDS);
+
+	enum TransformPath best = transform_bestpath();
+	double rate2d, rate3d;
+	for (p = 0; p < BENCH_PATHS; p++) {
+		if ((enum TransformPath)p > best || transform_setpath(p) == false) {
+			printf("%-6s  not supported\n", transform_pathname(p));
+			continue;
+		}
+
+		rate2d = bench_rate(transform_build2d, pos, rot, out[p][0]);
+		rate3d = bench_rate(transform_build3d, pos, rot, out[p][1]);
+
+		bool match = memcmp(out[p][0], out[TRANSFORM_PATH_SCALAR][0], out_bytes) == 0 &&
+					 memcmp(out[p][1], out[TRANSFORM_PATH_SCALAR][1], out_bytes) == 0;
+		printf("%-6s  2D %8.2f M/s  3D %8.2f M/s  %s\n", transform_pathname(p), rate2d * 1e-6,
+			   rate3d * 1e-6, match ? "matches scalar" : "DIFFERS FROM SCALAR");
+		if (match == false) {
+			ret = false;
+		}
+	}
+
+	for (p = 0; p < BENCH_PATHS; p++) {
+		free(out[p][0]);
+		free(out[p][1]);
+	}
+	free(streams);
+	return ret ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,235 @@
+#include "engine_arena.h"
+
+// First aligned byte after a block's header
+static inline char *arena_blockdata(struct ArenaBlock *block) {
+	uintptr_t base = (uintptr_t)(block + 1);
+	return (char *)((base + ARENA_ALIGNMENT - 1) & ~(uintptr_t)(ARENA_ALIGNMENT - 1));
+}
+
+/*			Arena functions		*/
+
+/**
+ * @brief Prepares an empty arena, no memory is taken until the first allocation
+ *
+ * @param arena Arena to initialize
+ * @param block_size Usual block size, 0 for ARENA_MIN_BLOCK_SIZE
+ */
+void arena_init(struct Arena *arena, size_t block_size) {
+	arena->blocks = NULL;
+	arena->block_size = (block_size == 0) ? ARENA_MIN_BLOCK_SIZE : block_size;
+}
+
+/**
+ * @brief Frees every block, or drops the arena's reference for shared arenas
+ *
+ * @param arena Arena to destroy
+ */
+void arena_destroy(struct Arena *arena) {
+	struct ArenaBlock *next, *curr = arena->blocks;
+	while (curr != NULL) {
+		next = curr->next;
+		arena_releaseblock(curr);
+		curr = next;
+	}
+	arena->blocks = NULL;
+}
+
+/**
+ * @brief Takes 'size' bytes from the current block, starting a new block when it is full
+ *
+ * @param arena Arena to allocate from
+ * @param size Bytes needed
+ * @return void* Aligned memory valid until the arena is reset or destroyed, NULL on failure
+ */
+void *arena_alloc(struct Arena *arena, size_t size) {
+	size = arena_alignsize(size);
+
+	struct ArenaBlock *block = arena->blocks;
+	if (block == NULL || block->size - block->used < size) {
+		block = arena_newblock(arena, size);
+		if (block == NULL) {
+			return NULL;
+		}
+		block->next = arena->blocks;
+		arena->blocks = block;
+	}
+
+	void *memory = arena_blockdata(block) + block->used;
+	block->used += size;
+	return memory;
+}
+
+/**
+ * @brief Takes 'size' bytes and a reference to the block holding them
+ *
+ * Full blocks are left to their allocations and freed by the last 'arena_releaseblock', so memory
+ * can be given back while the arena is in use. Releasing is safe from any thread, allocating is
+ * not.
+ *
+ * @param arena Arena to allocate from
+ * @param size Bytes needed
+ * @param block Receives the block to release once the memory is no longer used
+ * @return void* Aligned memory, NULL on failure
+ */
+void *arena_allocshared(struct Arena *arena, size_t size, struct ArenaBlock **block) {
+	size = arena_alignsize(size);
+
+	struct ArenaBlock *curr = arena->blocks;
+	if (curr == NULL || curr->size - curr->used < size) {
+		curr = arena_newblock(arena, size);
+		if (curr == NULL) {
+			return NULL;
+		}
+		if (arena->blocks != NULL) {
+			arena_releaseblock(arena->blocks);
+		}
+		arena->blocks = curr;
+	}
+
+	void *memory = arena_blockdata(curr) + curr->used;
+	curr->used += size;
+	atomic_fetch_add(&curr->retain_count, 1);
+	*block = curr;
+	return memory;
+}
+
+/**
+ * @brief Makes all memory of an 'arena_alloc' arena available again
+ *
+ * If several blocks were needed since the last reset they are replaced by a single block large
+ * enough for all of them, so a steady workload settles on one block.
+ *
+ * @param arena Arena to reset
+ */
+void arena_reset(struct Arena *arena) {
+	struct ArenaBlock *next, *curr = arena->blocks;
+	if (curr == NULL) {
+		return;
+	}
+	if (curr->next == NULL) {
+		curr->used = 0;
+		return;
+	}
+
+	size_t total = 0;
+	while (curr != NULL) {
+		next = curr->next;
+		total += curr->size;
+		free(curr);
+		curr = next;
+	}
+	arena->blocks = NULL;
+
+	if (total > arena->block_size) {
+		arena->block_size = total;
+	}
+}
+
+/**
+ * @brief Drops a reference to a block, freeing it with the last one
+ *
+ * @param block Block to release
+ */
+void arena_releaseblock(struct ArenaBlock *block) {
+	if (atomic_fetch_sub(&block->retain_count, 1) == 1) {
+		free(block);
+	}
+}
+
+/**
+ * @brief Allocates a block with room for at least 'size' bytes
+ *
+ * The block starts with one reference, held by the arena
+ *
+ * @param arena Arena the block is for
+ * @param size Bytes the block must fit
+ * @return struct ArenaBlock* New block, NULL on failure
+ */
+struct ArenaBlock *arena_newblock(struct Arena *arena, size_t size) {
+	size_t block_size = (size > arena->block_size) ? size : arena->block_size;
+
+	struct ArenaBlock *block = malloc(sizeof(*block) + ARENA_ALIGNMENT + block_size);
+	if (block == NULL) {
+		fprintf(stderr, "Failure to allocate arena block.\n");
+		return NULL;
+	}
+
+	block->next = NULL;
+	block->size = block_size;
+	block->used = 0;
+	atomic_init(&block->retain_count, 1);
+	return block;
+}
+
+/**
+ * @brief Rounds a size up to ARENA_ALIGNMENT
+ *
+ * @param size Size in bytes
+ * @return size_t Aligned size
+ */
+size_t arena_alignsize(size_t size) {
+	return (size + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+}
+
+/*			Pool functions		*/
+
+/**
+ * @brief Prepares a pool of 'item_size' byte items, allocated 'items_per_block' at a time
+ *
+ * @param pool Pool to initialize
+ * @param item_size Size of each item
+ * @param items_per_block Items carved from each arena block
+ */
+void pool_init(struct Pool *pool, size_t item_size, size_t items_per_block) {
+	if (item_size < sizeof(void *)) {
+		item_size = sizeof(void *);
+	}
+	pool->item_size = arena_alignsize(item_size);
+	pool->free_list = NULL;
+	pool->items_size = 0;
+	arena_init(&pool->arena, pool->item_size * items_per_block);
+}
+
+/**
+ * @brief Frees every item at once
+ *
+ * @param pool Pool to destroy
+ */
+void pool_destroy(struct Pool *pool) {
+	arena_destroy(&pool->arena);
+	pool->free_list = NULL;
+	pool->items_size = 0;
+}
+
+/**
+ * @brief Takes an item, reusing the last freed one if any
+ *
+ * @param pool Pool to allocate from
+ * @return void* Uninitialized item, NULL on failure
+ */
+void *pool_alloc(struct Pool *pool) {
+	void *item = pool->free_list;
+	if (item != NULL) {
+		pool->free_list = *(void **)item;
+	} else {
+		item = arena_alloc(&pool->arena, pool->item_size);
+		if (item == NULL) {
+			return NULL;
+		}
+	}
+
+	pool->items_size++;
+	return item;
+}
+
+/**
+ * @brief Returns an item to the pool
+ *
+ * @param pool Pool the item came from
+ * @param item Item to free
+ */
+void pool_free(struct Pool *pool, void *item) {
+	*(void **)item = pool->free_list;
+	pool->free_list = item;
+	pool->items_size--;
+}
@@ -0,0 +1,61 @@
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef ENGINE_ARENA_H
+#define ENGINE_ARENA_H
+
+// Every allocation starts on this boundary, enough for SIMD streams
+#define ARENA_ALIGNMENT 32
+#define ARENA_MIN_BLOCK_SIZE 65536
+
+/*
+	Chunk of arena memory, allocations follow the header. Blocks of shared arenas are freed with
+	their last reference, the arena holding one while the block is current.
+*/
+struct ArenaBlock {
+	struct ArenaBlock *next;
+	size_t size;
+	size_t used;
+	_Atomic uint32_t retain_count;
+};
+
+/*
+	Bump allocator. Used either with arena_alloc, where everything is freed at once by
+	arena_reset or arena_destroy, or with arena_allocshared, where each allocation keeps its block
+	alive until released. An arena must not mix both.
+*/
+struct Arena {
+	struct ArenaBlock *blocks;
+	size_t block_size;
+};
+
+// Fixed-size items carved from an arena, freed items are reused first
+struct Pool {
+	struct Arena arena;
+	size_t item_size;
+	void *free_list;
+	size_t items_size;
+};
+
+// Arena functions
+void arena_init(struct Arena *, size_t);
+void arena_destroy(struct Arena *);
+void *arena_alloc(struct Arena *, size_t);
+void *arena_allocshared(struct Arena *, size_t, struct ArenaBlock **);
+void arena_reset(struct Arena *);
+void arena_releaseblock(struct ArenaBlock *);
+struct ArenaBlock *arena_newblock(struct Arena *, size_t);
+size_t arena_alignsize(size_t);
+
+// Pool functions
+void pool_init(struct Pool *, size_t, size_t);
+void pool_destroy(struct Pool *);
+void *pool_alloc(struct Pool *);
+void pool_free(struct Pool *, void *);
+
+#endif	// ENGINE_ARENA_H
@@ -0,0 +1,241 @@
+#include "engine_cull.h"
+
+#ifdef TRANSFORM_X86
+#include <immintrin.h>
+#endif
+
+// Selected kernel, scalar until cull_init follows the transform kernel's choice
+static CullKernel cull_kernel = cull_allocationscalar;
+
+/*			Cull functions		*/
+
+/**
+ * @brief Uses the same instruction set as the transform kernels
+ *
+ * Must be called after transform_init
+ */
+void cull_init() {
+	if (cull_setpath(transform_getpath()) == false) {
+		cull_setpath(TRANSFORM_PATH_SCALAR);
+	}
+}
+
+/**
+ * @brief Forces a kernel path
+ *
+ * @param path Path to use
+ * @return true Path selected
+ * @return false Path not supported on this CPU, selection unchanged
+ */
+bool cull_setpath(enum TransformPath path) {
+	switch (path) {
+		case TRANSFORM_PATH_SCALAR:
+			cull_kernel = cull_allocationscalar;
+			return true;
+#ifdef TRANSFORM_X86
+		case TRANSFORM_PATH_SSE2:
+			if (__builtin_cpu_supports("sse2") == 0) {
+				return false;
+			}
+			cull_kernel = cull_allocationsse2;
+			return true;
+		case TRANSFORM_PATH_AVX2:
+			if (__builtin_cpu_supports("avx2") == 0) {
+				return false;
+			}
+			cull_kernel = cull_allocationavx2;
+			return true;
+#endif
+		default:
+			return false;
+	}
+}
+
+/**
+ * @brief Builds the four planes of a 2D rectangle
+ *
+ * @param view View to fill
+ * @param min_x Left edge
+ * @param min_y Top edge
+ * @param max_x Right edge
+ * @param max_y Bottom edge
+ */
+void cull_viewport2d(struct CullView *view, float min_x, float min_y, float max_x, float max_y) {
+	const float planes[4][4] = {{1.0f, 0.0f, 0.0f, -min_x},
+								{-1.0f, 0.0f, 0.0f, max_x},
+								{0.0f, 1.0f, 0.0f, -min_y},
+								{0.0f, -1.0f, 0.0f, max_y}};
+
+	memcpy(view->planes, planes, sizeof(planes));
+	view->planes_size = 4;
+}
+
+/**
+ * @brief Culls an allocation with the selected kernel
+ *
+ * Every path gives the same visible list in the same order
+ *
+ * @param allocation Allocation with current bounds streams
+ * @param view Planes to test against
+ * @param live Number of objects that are not retired
+ * @return size_t Number of visible objects, also stored in the allocation
+ */
+size_t cull_allocation(struct EngineObjectAllocation *allocation, const struct CullView *view,
+					   size_t *live) {
+	allocation->visible_size = cull_kernel(allocation, view, live);
+	return allocation->visible_size;
+}
+
+/*			Scalar path		*/
+
+size_t cull_allocationscalar(struct EngineObjectAllocation *allocation, const struct CullView *view,
+							 size_t *live) {
+	size_t i, visible_size = 0, live_size = 0;
+	uint32_t p;
+
+	for (i = 0; i < allocation->objects_size; i++) {
+		if (allocation->flags[i] & OBJECT_FLAG_RETIRED) {
+			continue;
+		}
+		live_size++;
+
+		// Box corner farthest along each plane normal decides
+		bool inside = true;
+		for (p = 0; p < view->planes_size && inside; p++) {
+			const float *plane = view->planes[p];
+			float corner[3];
+			int j;
+			for (j = 0; j < 3; j++) {
+				corner[j] = (plane[j] >= 0.0f) ? allocation->bounds_max[j][i]
+											   : allocation->bounds_min[j][i];
+			}
+
+			float d = plane[0] * corner[0] + plane[1] * corner[1];
+			d = d + plane[2] * corner[2];
+			d = d + plane[3];
+			inside = d >= 0.0f;
+		}
+
+		if (inside) {
+			allocation->visible[visible_size++] = (uint32_t)i;
+		}
+	}
+
+	*live = live_size;
+	return visible_size;
+}
+
+#ifdef TRANSFORM_X86
+
+/*
+	Vector paths test whole vectors of the padded streams. A plane's sign picks the same corner for
+	every lane, so each plane reads one min or max stream per axis.
+*/
+
+// Picks the streams holding each plane's farthest corner
+static inline void cull_selectstreams(struct EngineObjectAllocation *allocation,
+									  const struct CullView *view,
+									  const float *corner[CULL_MAX_PLANES][3]) {
+	uint32_t p;
+	int j;
+	for (p = 0; p < view->planes_size; p++) {
+		for (j = 0; j < 3; j++) {
+			corner[p][j] = (view->planes[p][j] >= 0.0f) ? allocation->bounds_max[j]
+														: allocation->bounds_min[j];
+		}
+	}
+}
+
+// Appends the lanes set in 'mask' to the visible list
+static inline size_t cull_emit(uint32_t *visible, size_t visible_size, size_t base, uint32_t mask) {
+	while (mask != 0) {
+		visible[visible_size++] = (uint32_t)(base + __builtin_ctz(mask));
+		mask &= mask - 1;
+	}
+	return visible_size;
+}
+
+/*			SSE2 path		*/
+
+size_t cull_allocationsse2(struct EngineObjectAllocation *allocation, const struct CullView *view,
+						   size_t *live) {
+	const float *corner[CULL_MAX_PLANES][3];
+	size_t i, visible_size = 0, live_size = 0;
+	uint32_t p, lanes;
+
+	cull_selectstreams(allocation, view, corner);
+
+	__m128i retired = _mm_set1_epi32(OBJECT_FLAG_RETIRED);
+	__m128 zero = _mm_setzero_ps();
+
+	for (i = 0; i < allocation->objects_size; i += 4) {
+		__m128i flags = _mm_load_si128((const __m128i *)(allocation->flags + i));
+		__m128 alive = _mm_castsi128_ps(
+			_mm_cmpeq_epi32(_mm_and_si128(flags, retired), _mm_setzero_si128()));
+		__m128 inside = alive;
+
+		for (p = 0; p < view->planes_size; p++) {
+			const float *plane = view->planes[p];
+			__m128 d = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane[0]), _mm_load_ps(corner[p][0] + i)),
+								  _mm_mul_ps(_mm_set1_ps(plane[1]), _mm_load_ps(corner[p][1] + i)));
+			d = _mm_add_ps(d, _mm_mul_ps(_mm_set1_ps(plane[2]), _mm_load_ps(corner[p][2] + i)));
+			d = _mm_add_ps(d, _mm_set1_ps(plane[3]));
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(d, zero));
+		}
+
+		// Lanes past the last object are padding
+		lanes = (allocation->objects_size - i >= 4) ? 0xF
+													: (1u << (allocation->objects_size - i)) - 1;
+		live_size += __builtin_popcount((uint32_t)_mm_movemask_ps(alive) & lanes);
+		visible_size = cull_emit(allocation->visible, visible_size, i,
+								 (uint32_t)_mm_movemask_ps(inside) & lanes);
+	}
+
+	*live = live_size;
+	return visible_size;
+}
+
+/*			AVX2 path		*/
+
+__attribute__((target("avx2"))) size_t
+cull_allocationavx2(struct EngineObjectAllocation *allocation, const struct CullView *view,
+					size_t *live) {
+	const float *corner[CULL_MAX_PLANES][3];
+	size_t i, visible_size = 0, live_size = 0;
+	uint32_t p, lanes;
+
+	cull_selectstreams(allocation, view, corner);
+
+	__m256i retired = _mm256_set1_epi32(OBJECT_FLAG_RETIRED);
+	__m256 zero = _mm256_setzero_ps();
+
+	for (i = 0; i < allocation->objects_size; i += 8) {
+		__m256i flags = _mm256_load_si256((const __m256i *)(allocation->flags + i));
+		__m256 alive = _mm256_castsi256_ps(
+			_mm256_cmpeq_epi32(_mm256_and_si256(flags, retired), _mm256_setzero_si256()));
+		__m256 inside = alive;
+
+		for (p = 0; p < view->planes_size; p++) {
+			const float *plane = view->planes[p];
+			__m256 d = _mm256_add_ps(
+				_mm256_mul_ps(_mm256_set1_ps(plane[0]), _mm256_load_ps(corner[p][0] + i)),
+				_mm256_mul_ps(_mm256_set1_ps(plane[1]), _mm256_load_ps(corner[p][1] + i)));
+			d = _mm256_add_ps(
+				d, _mm256_mul_ps(_mm256_set1_ps(plane[2]), _mm256_load_ps(corner[p][2] + i)));
+			d = _mm256_add_ps(d, _mm256_set1_ps(plane[3]));
+			inside = _mm256_and_ps(inside, _mm256_cmp_ps(d, zero, _CMP_GE_OQ));
+		}
+
+		// Lanes past the last object are padding
+		lanes = (allocation->objects_size - i >= 8) ? 0xFF
+													: (1u << (allocation->objects_size - i)) - 1;
+		live_size += __builtin_popcount((uint32_t)_mm256_movemask_ps(alive) & lanes);
+		visible_size = cull_emit(allocation->visible, visible_size, i,
+								 (uint32_t)_mm256_movemask_ps(inside) & lanes);
+	}
+
+	*live = live_size;
+	return visible_size;
+}
+
+#endif
@@ -0,0 +1,35 @@
+#include "engine_transform.h"
+#include "object_struct.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef ENGINE_CULL_H
+#define ENGINE_CULL_H
+
+/*
+	Tests an allocation's bounds streams against a view, writing the indices of live objects
+	inside it to the allocation's visible list. Returns the visible count and stores the number of
+	live objects tested in the last argument.
+*/
+typedef size_t (*CullKernel)(struct EngineObjectAllocation *, const struct CullView *, size_t *);
+
+// Cull functions
+void cull_init();
+bool cull_setpath(enum TransformPath);
+void cull_viewport2d(struct CullView *, float, float, float, float);
+size_t cull_allocation(struct EngineObjectAllocation *, const struct CullView *, size_t *);
+
+// Scalar path
+size_t cull_allocationscalar(struct EngineObjectAllocation *, const struct CullView *, size_t *);
+
+#ifdef TRANSFORM_X86
+// SSE2 path
+size_t cull_allocationsse2(struct EngineObjectAllocation *, const struct CullView *, size_t *);
+
+// AVX2 path
+size_t cull_allocationavx2(struct EngineObjectAllocation *, const struct CullView *, size_t *);
+#endif
+
+#endif	// ENGINE_CULL_H
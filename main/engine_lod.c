@@ -0,0 +1,323 @@
+#include "engine_lod.h"
+
+// Twice the signed area of a triangle in the xy plane
+static inline float lod_area(const float *a, const float *b, const float *c) {
+	return (b[0] - a[0]) * (c[1] - a[1]) - (b[1] - a[1]) * (c[0] - a[0]);
+}
+
+// Index following corner 'i' in its triangle
+static inline size_t lod_nextcorner(size_t i) {
+	return i - i % 3 + (i % 3 + 1) % 3;
+}
+
+// Quadric error of moving 'from' onto 'to', plus the color it loses
+static inline float lod_collapsecost(const struct Vertex *vertices,
+									 const struct LodQuadric *quadrics, float color_weight,
+									 uint32_t from, uint32_t to) {
+	struct LodQuadric q = quadrics[from];
+	lod_addquadric(&q, &quadrics[to]);
+
+	float cost = lod_quadricerror(&q, vertices[to].pos);
+	int j;
+	for (j = 0; j < 3; j++) {
+		float d = vertices[from].color[j] - vertices[to].color[j];
+		cost += color_weight * d * d;
+	}
+	return cost;
+}
+
+/*			Simplification functions		*/
+
+/**
+ * @brief Simplifies a triangle list by collapsing edges onto existing vertices
+ *
+ * Only indices change, so every level can share the original vertices. Each pass sorts the
+ * current edges by cost and collapses the cheapest ones that touch no earlier collapse of the
+ * pass and flip no triangle, until the list reaches 'target_size' indices or the next collapse
+ * would cost more than 'max_error'.
+ *
+ * @param vertices Vertices the indices refer to
+ * @param vertices_size Number of vertices
+ * @param indices Triangle list to simplify, may be the same array as 'out'
+ * @param indices_size Number of indices, a multiple of 3
+ * @param target_size Number of indices to aim for
+ * @param max_error Largest distance in mesh units the boundary may move
+ * @param out Receives the simplified list, with room for 'indices_size' indices
+ * @param error Receives the largest distance of the collapses made
+ * @return size_t Number of indices written, 'indices_size' if nothing could be collapsed
+ */
+size_t lod_simplify(const struct Vertex *vertices, size_t vertices_size, const uint32_t *indices,
+					size_t indices_size, size_t target_size, float max_error, uint32_t *out,
+					float *error) {
+	memmove(out, indices, sizeof(*out) * indices_size);
+	*error = 0.0f;
+	if (vertices_size == 0 || indices_size < 3) {
+		return indices_size;
+	}
+
+	struct LodQuadric *quadrics = calloc(vertices_size, sizeof(*quadrics));
+	uint32_t *remap = malloc(sizeof(*remap) * vertices_size);
+	uint32_t *offsets = malloc(sizeof(*offsets) * (vertices_size + 1));
+	uint32_t *adjacency = malloc(sizeof(*adjacency) * indices_size);
+	uint8_t *locked = malloc(vertices_size);
+	uint64_t *edges = malloc(sizeof(*edges) * indices_size);
+	struct LodCollapse *collapses = malloc(sizeof(*collapses) * indices_size * 2);
+	if (quadrics == NULL || remap == NULL || offsets == NULL || adjacency == NULL ||
+		locked == NULL || edges == NULL || collapses == NULL) {
+		fprintf(stderr, "Failure to allocate mesh simplification.\n");
+		free(quadrics);
+		free(remap);
+		free(offsets);
+		free(adjacency);
+		free(locked);
+		free(edges);
+		free(collapses);
+		return indices_size;
+	}
+
+	size_t i, j, size = indices_size;
+	uint32_t a, b, c;
+
+	// Edges used by a single triangle are the boundary, whose lines the quadrics keep in place
+	for (i = 0; i < size; i++) {
+		a = out[i];
+		b = out[lod_nextcorner(i)];
+		edges[i] = (a < b) ? ((uint64_t)a << 32 | b) : ((uint64_t)b << 32 | a);
+	}
+	qsort(edges, size, sizeof(*edges), lod_compareedges);
+
+	for (i = 0; i < size; i = j) {
+		j = i + 1;
+		while (j < size && edges[j] == edges[i]) {
+			j++;
+		}
+		if (j - i == 1) {
+			a = (uint32_t)(edges[i] >> 32);
+			b = (uint32_t)edges[i];
+			lod_addline(&quadrics[a], vertices[a].pos, vertices[b].pos);
+			lod_addline(&quadrics[b], vertices[a].pos, vertices[b].pos);
+		}
+	}
+	free(edges);
+
+	// Color loss is measured against the mesh's size so the error limit covers both
+	float min[2] = {vertices[0].pos[0], vertices[0].pos[1]};
+	float max[2] = {vertices[0].pos[0], vertices[0].pos[1]};
+	for (i = 1; i < vertices_size; i++) {
+		for (j = 0; j < 2; j++) {
+			min[j] = fminf(min[j], vertices[i].pos[j]);
+			max[j] = fmaxf(max[j], vertices[i].pos[j]);
+		}
+	}
+	float color_weight = LOD_COLOR_WEIGHT * fmaxf(max[0] - min[0], max[1] - min[1]);
+	color_weight *= color_weight;
+
+	for (i = 0; i < vertices_size; i++) {
+		remap[i] = i;
+	}
+
+	float max_cost = max_error * max_error, worst = 0.0f;
+	uint32_t pass, t;
+
+	for (pass = 0; pass < LOD_MAX_PASSES && size > target_size; pass++) {
+		// Triangles around each vertex, offsets are shifted back after filling
+		memset(offsets, 0, sizeof(*offsets) * (vertices_size + 1));
+		for (i = 0; i < size; i++) {
+			offsets[out[i] + 1]++;
+		}
+		for (i = 0; i < vertices_size; i++) {
+			offsets[i + 1] += offsets[i];
+		}
+		for (i = 0; i < size; i++) {
+			adjacency[offsets[out[i]]++] = i / 3;
+		}
+		for (i = vertices_size; i > 0; i--) {
+			offsets[i] = offsets[i - 1];
+		}
+		offsets[0] = 0;
+
+		// Both directions of every edge, interior edges appear twice
+		size_t collapses_size = 0;
+		for (i = 0; i < size; i++) {
+			a = out[i];
+			b = out[lod_nextcorner(i)];
+			collapses[collapses_size].from = a;
+			collapses[collapses_size].to = b;
+			collapses[collapses_size++].cost =
+				lod_collapsecost(vertices, quadrics, color_weight, a, b);
+			collapses[collapses_size].from = b;
+			collapses[collapses_size].to = a;
+			collapses[collapses_size++].cost =
+				lod_collapsecost(vertices, quadrics, color_weight, b, a);
+		}
+		qsort(collapses, collapses_size, sizeof(*collapses), lod_comparecollapses);
+
+		// Collapses in one pass never share a triangle, so each flip test sees current triangles
+		memset(locked, 0, vertices_size);
+		size_t triangles = size / 3, collapsed = 0;
+		struct LodCollapse *collapse;
+
+		for (i = 0; i < collapses_size && triangles > target_size / 3; i++) {
+			collapse = &collapses[i];
+			if (collapse->cost > max_cost) {
+				break;
+			}
+			if (locked[collapse->from] || locked[collapse->to] ||
+				lod_collapseflips(vertices, out, offsets, adjacency, collapse->from,
+								  collapse->to)) {
+				continue;
+			}
+
+			for (j = offsets[collapse->from]; j < offsets[collapse->from + 1]; j++) {
+				t = adjacency[j] * 3;
+				locked[out[t]] = locked[out[t + 1]] = locked[out[t + 2]] = 1;
+				if (out[t] == collapse->to || out[t + 1] == collapse->to ||
+					out[t + 2] == collapse->to) {
+					triangles--;
+				}
+			}
+
+			remap[collapse->from] = collapse->to;
+			lod_addquadric(&quadrics[collapse->to], &quadrics[collapse->from]);
+			worst = fmaxf(worst, collapse->cost);
+			collapsed++;
+		}
+		if (collapsed == 0) {
+			break;
+		}
+
+		// Apply the pass, dropping triangles that lost an edge
+		size_t kept = 0;
+		for (i = 0; i < size; i += 3) {
+			a = remap[out[i]];
+			b = remap[out[i + 1]];
+			c = remap[out[i + 2]];
+			if (a == b || b == c || a == c) {
+				continue;
+			}
+			out[kept++] = a;
+			out[kept++] = b;
+			out[kept++] = c;
+		}
+		size = kept;
+
+		for (i = 0; i < vertices_size; i++) {
+			remap[i] = i;
+		}
+	}
+
+	free(quadrics);
+	free(remap);
+	free(offsets);
+	free(adjacency);
+	free(locked);
+	free(collapses);
+
+	*error = sqrtf(worst);
+	return size;
+}
+
+/**
+ * @brief Adds the line through two points
+ *
+ * @param quadric Quadric to add to
+ * @param p First point
+ * @param q Second point
+ */
+void lod_addline(struct LodQuadric *quadric, const float *p, const float *q) {
+	double dx = q[0] - p[0], dy = q[1] - p[1];
+	double length = sqrt(dx * dx + dy * dy);
+	if (length == 0.0) {
+		return;
+	}
+
+	// Unit normal (a, b) and offset c, so ax + by + c is the signed distance
+	double a = -dy / length, b = dx / length;
+	double c = -(a * p[0] + b * p[1]);
+
+	quadric->xx += a * a;
+	quadric->xy += a * b;
+	quadric->x1 += a * c;
+	quadric->yy += b * b;
+	quadric->y1 += b * c;
+	quadric->c += c * c;
+}
+
+/**
+ * @brief Adds one quadric to another
+ *
+ * @param quadric Quadric to add to
+ * @param other Quadric to add
+ */
+void lod_addquadric(struct LodQuadric *quadric, const struct LodQuadric *other) {
+	quadric->xx += other->xx;
+	quadric->xy += other->xy;
+	quadric->x1 += other->x1;
+	quadric->yy += other->yy;
+	quadric->y1 += other->y1;
+	quadric->c += other->c;
+}
+
+/**
+ * @brief Evaluates the sum of squared distances at a point
+ *
+ * @param quadric Quadric to evaluate
+ * @param p Point
+ * @return float Error, never negative
+ */
+float lod_quadricerror(const struct LodQuadric *quadric, const float *p) {
+	double x = p[0], y = p[1];
+	double e = quadric->xx * x * x + 2.0 * quadric->xy * x * y + 2.0 * quadric->x1 * x +
+			   quadric->yy * y * y + 2.0 * quadric->y1 * y + quadric->c;
+	return (e > 0.0) ? (float)e : 0.0f;
+}
+
+/**
+ * @brief Checks whether collapsing 'from' onto 'to' turns any remaining triangle over
+ *
+ * @param vertices Vertex positions
+ * @param indices Current triangle list
+ * @param offsets Start of each vertex's triangles in 'adjacency'
+ * @param adjacency Triangles around each vertex
+ * @param from Vertex being moved
+ * @param to Vertex it moves onto
+ * @return true A triangle would flip or become degenerate
+ * @return false Collapse is safe
+ */
+bool lod_collapseflips(const struct Vertex *vertices, const uint32_t *indices,
+					   const uint32_t *offsets, const uint32_t *adjacency, uint32_t from,
+					   uint32_t to) {
+	const float *corner[3], *moved[3];
+	uint32_t j, t;
+	int k;
+
+	for (j = offsets[from]; j < offsets[from + 1]; j++) {
+		// Triangles on the collapsed edge disappear
+		t = adjacency[j] * 3;
+		if (indices[t] == to || indices[t + 1] == to || indices[t + 2] == to) {
+			continue;
+		}
+
+		for (k = 0; k < 3; k++) {
+			corner[k] = vertices[indices[t + k]].pos;
+			moved[k] = (indices[t + k] == from) ? vertices[to].pos : corner[k];
+		}
+		if (lod_area(corner[0], corner[1], corner[2]) * lod_area(moved[0], moved[1], moved[2]) <=
+			0.0f) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+int lod_comparecollapses(const void *a, const void *b) {
+	float cost_a = ((const struct LodCollapse *)a)->cost;
+	float cost_b = ((const struct LodCollapse *)b)->cost;
+	return (cost_a > cost_b) - (cost_a < cost_b);
+}
+
+int lod_compareedges(const void *a, const void *b) {
+	uint64_t edge_a = *(const uint64_t *)a, edge_b = *(const uint64_t *)b;
+	return (edge_a > edge_b) - (edge_a < edge_b);
+}
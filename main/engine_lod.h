@@ -0,0 +1,47 @@
+#include "engine_vertex.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef ENGINE_LOD_H
+#define ENGINE_LOD_H
+
+// Each pass collapses independent edges, meshes needing more passes stop short of the target
+#define LOD_MAX_PASSES 32
+// A full color change costs as much as moving this fraction of the mesh's size
+#define LOD_COLOR_WEIGHT 0.1f
+
+/*
+	Sum of squared distances to lines in the xy plane, as the symmetric matrix of the quadratic
+	form over (x, y, 1). Only boundary edges add lines, so a flat interior collapses for free.
+*/
+struct LodQuadric {
+	double xx, xy, x1;
+	double yy, y1;
+	double c;
+};
+
+// Moves vertex 'from' onto vertex 'to', removing the triangles that shared the edge
+struct LodCollapse {
+	uint32_t from;
+	uint32_t to;
+	float cost;
+};
+
+// Simplification functions
+size_t lod_simplify(const struct Vertex *, size_t, const uint32_t *, size_t, size_t, float,
+					uint32_t *, float *);
+void lod_addline(struct LodQuadric *, const float *, const float *);
+void lod_addquadric(struct LodQuadric *, const struct LodQuadric *);
+float lod_quadricerror(const struct LodQuadric *, const float *);
+bool lod_collapseflips(const struct Vertex *, const uint32_t *, const uint32_t *, const uint32_t *,
+					   uint32_t, uint32_t);
+int lod_comparecollapses(const void *, const void *);
+int lod_compareedges(const void *, const void *);
+
+#endif	// ENGINE_LOD_H
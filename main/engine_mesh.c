@@ -0,0 +1,581 @@
+#include "engine_mesh.h"
+
+/*			Mesh registry functions		*/
+bool meshreg_init(struct MeshRegistry *registry, struct VulkanMemory *vmem) {
+	registry->table = calloc(MESH_REGISTRY_SIZE, sizeof(*registry->table));
+	if (registry->table == NULL) {
+		fprintf(stderr, "Failure to allocate mesh registry.\n");
+		return false;
+	}
+
+	registry->size = MESH_REGISTRY_SIZE;
+	registry->meshes_size = 0;
+	registry->memory_pool = vmem;
+	pthread_mutex_init(&registry->lock, NULL);
+	return true;
+}
+
+void meshreg_destroy(struct MeshRegistry *registry) {
+	// Free meshes that are still referenced
+	struct EngineMesh *curr, *next;
+	size_t i;
+	for (i = 0; i < registry->size; i++) {
+		curr = registry->table[i];
+		while (curr != NULL) {
+			next = curr->next;
+			mesh_free(registry->memory_pool, curr);
+			curr = next;
+		}
+	}
+
+	free(registry->table);
+	registry->table = NULL;
+	registry->meshes_size = 0;
+	pthread_mutex_destroy(&registry->lock);
+}
+
+/*
+	Returns a retained registered mesh with the same contents as 'mesh'. If there is none, a copy
+	of 'mesh' is stored in 'storage', registered and returned with 'created' set. 'mesh' itself is
+	never registered, so it can live in temporary memory. Returns NULL if the copy fails. With
+	'lod' set, the copy is stored as by mesh_store and needs mesh_buildlods before 'mesh' goes.
+*/
+struct EngineMesh *meshreg_acquire(struct MeshRegistry *registry, struct EngineMesh *mesh,
+								   struct Arena *storage, bool lod, bool *created) {
+	size_t table_pos = mesh->hash % registry->size;
+	*created = false;
+
+	pthread_mutex_lock(&registry->lock);
+
+	struct EngineMesh *curr = registry->table[table_pos];
+	while (curr != NULL) {
+		if (curr->hash == mesh->hash && mesh_equals(curr, mesh)) {
+			atomic_fetch_add(&curr->retain_count, 1);
+			pthread_mutex_unlock(&registry->lock);
+			return curr;
+		}
+		curr = curr->next;
+	}
+
+	struct EngineMesh *copy = mesh_store(storage, mesh, lod);
+	if (copy == NULL) {
+		pthread_mutex_unlock(&registry->lock);
+		return NULL;
+	}
+
+	// Register new mesh at head of chain
+	copy->registry = registry;
+	copy->next = registry->table[table_pos];
+	registry->table[table_pos] = copy;
+	registry->meshes_size++;
+	*created = true;
+
+	pthread_mutex_unlock(&registry->lock);
+	return copy;
+}
+
+// Removes 'mesh' from its chain, must be called with the registry lock held
+void meshreg_unlink(struct MeshRegistry *registry, struct EngineMesh *mesh) {
+	size_t table_pos = mesh->hash % registry->size;
+	struct EngineMesh *prev = NULL, *curr = registry->table[table_pos];
+	while (curr != NULL && curr != mesh) {
+		prev = curr;
+		curr = curr->next;
+	}
+	if (curr == NULL) {
+		return;
+	}
+
+	if (prev == NULL) {
+		registry->table[table_pos] = curr->next;
+	} else {
+		prev->next = curr->next;
+	}
+	registry->meshes_size--;
+	mesh->registry = NULL;
+	mesh->next = NULL;
+}
+
+/*          Mesh functions         */
+
+/*
+	Copies geometry into 'storage', which must hold mesh_storagesize bytes and outlive the mesh,
+	narrowing indices to 16-bit when they fit, and hashes the stored bytes. The mesh is laid out
+	as the struct followed by its vertices and indices. Freeing it only drops its buffer.
+*/
+struct EngineMesh *mesh_create(void *storage, struct Vertex *vertices, size_t vertices_size,
+							   uint32_t *indices, size_t indices_size) {
+	struct EngineMesh *mesh = storage;
+	memset(mesh, 0, sizeof(*mesh));
+
+	atomic_init(&mesh->retain_count, 1);
+	mesh->index_type = VK_INDEX_TYPE_UINT16;
+	mesh->retention = MESH_RETAIN_KEEP;
+
+	if (vertices_size > 0) {
+		mesh->vertices_size = vertices_size;
+		mesh->vertices = (struct Vertex *)(mesh + 1);
+
+		memcpy(mesh->vertices, vertices, sizeof(*mesh->vertices) * vertices_size);
+
+		// Start bounds at the first vertex so they cover exactly the positions given
+		mesh->bounds_min[0] = mesh->bounds_max[0] = vertices[0].pos[0];
+		mesh->bounds_min[1] = mesh->bounds_max[1] = vertices[0].pos[1];
+		mesh_growbounds(mesh, vertices, vertices_size);
+	}
+
+	if (indices_size > 0) {
+		// Find largest index to pick the narrowest index type
+		uint32_t max_index = 0;
+		size_t i;
+		for (i = 0; i < indices_size; i++) {
+			if (indices[i] > max_index) {
+				max_index = indices[i];
+			}
+		}
+
+		if (max_index >= vertices_size) {
+			fprintf(stderr, "Object index %u out of range of %llu vertices.\n", max_index,
+					(unsigned long long)vertices_size);
+			return NULL;
+		}
+
+		mesh->indices_size = indices_size;
+		mesh->index_type = (max_index <= UINT16_MAX) ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+		mesh->indices = (char *)(mesh + 1) + mesh_vertexbytes(mesh);
+
+		if (mesh->index_type == VK_INDEX_TYPE_UINT16) {
+			uint16_t *narrow = mesh->indices;
+			for (i = 0; i < indices_size; i++) {
+				narrow[i] = (uint16_t)indices[i];
+			}
+		} else {
+			memcpy(mesh->indices, indices, sizeof(*indices) * indices_size);
+		}
+
+		mesh->lods[0] = (struct MeshLod){.first = 0, .count = indices_size, .error = 0.0f};
+		mesh->lods_size = 1;
+	}
+
+	// Hash stored representation of the full mesh so equal hashes can be confirmed with memcmp
+	mesh->hash = __murmur64a(mesh->vertices, mesh_vertexbytes(mesh), MESH_HASH_SEED);
+	mesh->hash =
+		__murmur64a(mesh->indices, mesh_indexstride(mesh) * mesh->indices_size, mesh->hash);
+
+	return mesh;
+}
+
+/*
+	Copies a mesh into 'arena', whose block stays allocated until the copy is freed. The copy has
+	its own reference and no registry link, and can be updated in place like the original. Meshes
+	that drop their geometry after upload only copy the struct and borrow the original's geometry
+	until mesh_dropgeometry, so the original must outlive the upload. With 'lod' set, meshes
+	getting levels of detail borrow it too until mesh_buildlods gives them their own.
+*/
+struct EngineMesh *mesh_store(struct Arena *arena, struct EngineMesh *mesh, bool lod) {
+	VkDeviceSize vertex_bytes = 0, index_bytes = 0;
+	struct ArenaBlock *block;
+	bool borrow = mesh->retention != MESH_RETAIN_KEEP || (lod && mesh_wantslods(mesh));
+	if (borrow == false) {
+		vertex_bytes = mesh_vertexbytes(mesh);
+		index_bytes = mesh_indexstride(mesh) * mesh_indexcount(mesh);
+	}
+
+	struct EngineMesh *copy =
+		arena_allocshared(arena, sizeof(*copy) + vertex_bytes + index_bytes, &block);
+	if (copy == NULL) {
+		fprintf(stderr, "Failure to store mesh.\n");
+		return NULL;
+	}
+
+	memcpy(copy, mesh, sizeof(*copy));
+	if (borrow == false) {
+		copy->vertices = NULL;
+		copy->indices = NULL;
+	}
+	if (vertex_bytes > 0) {
+		copy->vertices = (struct Vertex *)(copy + 1);
+		memcpy(copy->vertices, mesh->vertices, vertex_bytes);
+	}
+	if (index_bytes > 0) {
+		copy->indices = (char *)(copy + 1) + vertex_bytes;
+		memcpy(copy->indices, mesh->indices, index_bytes);
+	}
+
+	atomic_init(&copy->retain_count, 1);
+	copy->block = block;
+	copy->registry = NULL;
+	copy->next = NULL;
+	return copy;
+}
+
+// Bytes mesh_create needs for the given geometry, assuming 32-bit indices
+size_t mesh_storagesize(size_t vertices_size, size_t indices_size) {
+	return sizeof(struct EngineMesh) + sizeof(struct Vertex) * vertices_size +
+		   sizeof(uint32_t) * indices_size;
+}
+
+/*
+	Appends simplified levels after the full indices, each aiming for MESH_LOD_REDUCTION of the
+	previous level's triangles. Stops when a level barely shrinks, its error would pass
+	MESH_LOD_MAX_ERROR of the mesh's size, or the levels would outgrow the full mesh's indices.
+	Errors add up, as each level is simplified from the one before. The geometry moves to its own
+	'restored' block with room for the levels, so registered meshes only pay for it once.
+*/
+bool mesh_buildlods(struct EngineMesh *mesh) {
+	if (mesh_wantslods(mesh) == false) {
+		return true;
+	}
+
+	float extent = fmaxf(mesh->bounds_max[0] - mesh->bounds_min[0],
+						 mesh->bounds_max[1] - mesh->bounds_min[1]);
+	float max_error = extent * MESH_LOD_MAX_ERROR, error;
+
+	// Levels take at most as many indices again, simplified from 32-bit copies
+	VkDeviceSize vertex_bytes = mesh_vertexbytes(mesh);
+	VkDeviceSize index_bytes = mesh_indexstride(mesh) * mesh->indices_size;
+	uint8_t *geometry = malloc(vertex_bytes + index_bytes * 2);
+	uint32_t *full = malloc(sizeof(*full) * mesh->indices_size * 2);
+	if (geometry == NULL || full == NULL) {
+		fprintf(stderr, "Failure to allocate mesh levels of detail.\n");
+		free(geometry);
+		free(full);
+		return false;
+	}
+
+	size_t source_size = mesh->indices_size, target, count, i;
+	if (mesh->index_type == VK_INDEX_TYPE_UINT16) {
+		const uint16_t *narrow = mesh->indices;
+		for (i = 0; i < source_size; i++) {
+			full[i] = narrow[i];
+		}
+	} else {
+		memcpy(full, mesh->indices, sizeof(*full) * source_size);
+	}
+
+	memcpy(geometry, mesh->vertices, vertex_bytes);
+	memcpy(geometry + vertex_bytes, mesh->indices, index_bytes);
+	free(mesh->restored);
+	mesh->restored = geometry;
+	mesh->vertices = (struct Vertex *)geometry;
+	mesh->indices = geometry + vertex_bytes;
+
+	const uint32_t *source = full;
+	uint32_t *level = full + mesh->indices_size;
+	struct MeshLod *prev, *lod;
+
+	while (mesh->lods_size < MESH_MAX_LODS) {
+		prev = &mesh->lods[mesh->lods_size - 1];
+		target = (size_t)(source_size / 3 * MESH_LOD_REDUCTION) * 3;
+		count = lod_simplify(mesh->vertices, mesh->vertices_size, source, source_size, target,
+							 max_error - prev->error, level, &error);
+
+		// Levels that barely shrink aren't worth their indices
+		if (count == 0 || count > source_size / 4 * 3 ||
+			mesh->lod_indices_size + count > mesh->indices_size) {
+			break;
+		}
+
+		lod = &mesh->lods[mesh->lods_size++];
+		lod->first = mesh->indices_size + mesh->lod_indices_size;
+		lod->count = count;
+		lod->error = prev->error + error;
+
+		if (mesh->index_type == VK_INDEX_TYPE_UINT16) {
+			uint16_t *narrow = (uint16_t *)mesh->indices + lod->first;
+			for (i = 0; i < count; i++) {
+				narrow[i] = (uint16_t)level[i];
+			}
+		} else {
+			memcpy((uint32_t *)mesh->indices + lod->first, level, sizeof(*level) * count);
+		}
+		mesh->lod_indices_size += count;
+
+		source = level;
+		source_size = count;
+	}
+
+	free(full);
+	return true;
+}
+
+// Whether mesh_buildlods gives the mesh simplified levels, only worth it for large meshes
+bool mesh_wantslods(struct EngineMesh *mesh) {
+	return mesh->indices_size / 3 >= MESH_LOD_MIN_TRIANGLES;
+}
+
+/*
+	Picks the coarsest level whose error is within 'max_error' mesh units, level 0 when the mesh
+	has no simplified levels.
+*/
+uint32_t mesh_selectlod(struct EngineMesh *mesh, float max_error) {
+	uint32_t level = 0;
+	while (level + 1 < mesh->lods_size && mesh->lods[level + 1].error <= max_error) {
+		level++;
+	}
+	return level;
+}
+
+void mesh_retain(struct EngineMesh *mesh) {
+	atomic_fetch_add(&mesh->retain_count, 1);
+}
+
+// Safe from any thread, registered meshes are unlinked under the registry lock
+void mesh_release(struct VulkanMemory *vmem, struct EngineMesh *mesh) {
+	struct MeshRegistry *registry = mesh->registry;
+
+	if (registry == NULL) {
+		if (atomic_fetch_sub(&mesh->retain_count, 1) == 1) {
+			mesh_free(vmem, mesh);
+		}
+		return;
+	}
+
+	// Decrement under lock so meshreg_acquire cannot revive a mesh being freed
+	pthread_mutex_lock(&registry->lock);
+	if (atomic_fetch_sub(&mesh->retain_count, 1) != 1) {
+		pthread_mutex_unlock(&registry->lock);
+		return;
+	}
+
+	meshreg_unlink(registry, mesh);
+	pthread_mutex_unlock(&registry->lock);
+
+	mesh_free(vmem, mesh);
+}
+
+// Drops the mesh's buffer and storage, meshes built in caller storage only hold the buffer
+void mesh_free(struct VulkanMemory *vmem, struct EngineMesh *mesh) {
+	if (mesh->vi_buffer != NULL) {
+		vkmemory_releasebuffer(vmem, mesh->vi_buffer);
+	}
+	free(mesh->compressed);
+	free(mesh->restored);
+
+	// The block may hold the mesh itself, so it goes last
+	if (mesh->block != NULL) {
+		arena_releaseblock(mesh->block);
+	}
+}
+
+/*
+	Compares contents byte for byte. Meshes without CPU geometry can only be matched on their 64-bit
+	content hash, which is already known to be equal when called from the registry.
+*/
+bool mesh_equals(struct EngineMesh *a, struct EngineMesh *b) {
+	if (a->vertices_size != b->vertices_size || a->indices_size != b->indices_size ||
+		a->index_type != b->index_type) {
+		return false;
+	}
+	if (a->vertices == NULL || b->vertices == NULL) {
+		return a->hash == b->hash;
+	}
+
+	return memcmp(a->vertices, b->vertices, mesh_vertexbytes(a)) == 0 &&
+		   memcmp(a->indices, b->indices, mesh_indexstride(a) * a->indices_size) == 0;
+}
+
+/*
+	Applies the mesh's retention policy once it is uploaded, compressing the geometry if asked and
+	letting go of it. Falls back to discarding when the compressed copy can't be allocated.
+*/
+bool mesh_dropgeometry(struct EngineMesh *mesh) {
+	if (mesh->retention == MESH_RETAIN_KEEP || mesh->retention == MESH_RETAIN_DEFAULT) {
+		return true;
+	}
+
+	bool ret = true;
+	if (mesh->retention == MESH_RETAIN_COMPRESSED && mesh->compressed == NULL) {
+		VkDeviceSize vertex_bytes = mesh_vertexbytes(mesh);
+		VkDeviceSize index_bytes = mesh_indexstride(mesh) * mesh_indexcount(mesh);
+
+		// Worst case alternates single literal and zero bytes, taking 3 bytes for every 2
+		size_t capacity = vertex_bytes + vertex_bytes / 2 + index_bytes + index_bytes / 2 + 2;
+		uint8_t *compressed = malloc(capacity);
+		if (compressed == NULL) {
+			fprintf(stderr, "Failure to allocate compressed mesh, discarding it instead.\n");
+			mesh->retention = MESH_RETAIN_DISCARD;
+			ret = false;
+		} else {
+			// Vertices are predicted from the previous vertex, indices from the previous triangle
+			size_t size = mesh_encode((const uint8_t *)mesh->vertices, vertex_bytes,
+									  sizeof(*mesh->vertices), compressed);
+			size += mesh_encode(mesh->indices, index_bytes, mesh_indexstride(mesh) * 3,
+								compressed + size);
+
+			void *shrunk = realloc(compressed, size);
+			mesh->compressed = (shrunk == NULL) ? compressed : shrunk;
+			mesh->compressed_size = size;
+		}
+	}
+
+	free(mesh->restored);
+	mesh->restored = NULL;
+	mesh->vertices = NULL;
+	mesh->indices = NULL;
+	return ret;
+}
+
+// Brings back dropped geometry from the compressed copy, false if there is none
+bool mesh_decompress(struct EngineMesh *mesh) {
+	if (mesh->vertices != NULL) {
+		return true;
+	}
+	if (mesh->compressed == NULL) {
+		fprintf(stderr, "Mesh geometry was discarded, restore it with objgrp_restoremesh.\n");
+		return false;
+	}
+
+	VkDeviceSize vertex_bytes = mesh_vertexbytes(mesh);
+	VkDeviceSize index_bytes = mesh_indexstride(mesh) * mesh_indexcount(mesh);
+	uint8_t *geometry = malloc(vertex_bytes + index_bytes);
+	if (geometry == NULL) {
+		fprintf(stderr, "Failure to allocate memory. Line: #%d.\n", __LINE__);
+		return false;
+	}
+
+	const uint8_t *src = mesh_decode(mesh->compressed, geometry, vertex_bytes,
+									 sizeof(*mesh->vertices));
+	mesh_decode(src, geometry + vertex_bytes, index_bytes, mesh_indexstride(mesh) * 3);
+
+	mesh->restored = geometry;
+	mesh->vertices = (struct Vertex *)geometry;
+	mesh->indices = (index_bytes > 0) ? geometry + vertex_bytes : NULL;
+	return true;
+}
+
+// Brings back dropped geometry from a copy of its vertices followed by its indices
+bool mesh_restore(struct EngineMesh *mesh, const void *geometry) {
+	if (mesh->vertices != NULL) {
+		return true;
+	}
+
+	VkDeviceSize vertex_bytes = mesh_vertexbytes(mesh);
+	VkDeviceSize index_bytes = mesh_indexstride(mesh) * mesh_indexcount(mesh);
+	uint8_t *restored = malloc(vertex_bytes + index_bytes);
+	if (restored == NULL) {
+		fprintf(stderr, "Failure to allocate memory. Line: #%d.\n", __LINE__);
+		return false;
+	}
+	memcpy(restored, geometry, vertex_bytes + index_bytes);
+
+	mesh->restored = restored;
+	mesh->vertices = (struct Vertex *)restored;
+	mesh->indices = (index_bytes > 0) ? restored + vertex_bytes : NULL;
+	return true;
+}
+
+/*
+	Encodes each byte as its difference from the byte 'stride' earlier, so repeated attributes
+	become zeros, then run-length encodes the zeros. A length byte with the high bit set stands for
+	a run of zeros, otherwise that many literal bytes follow it. Returns the bytes written.
+*/
+size_t mesh_encode(const uint8_t *src, size_t size, size_t stride, uint8_t *dst) {
+	size_t i = 0, out = 0, run, length_pos;
+	uint8_t delta;
+
+	while (i < size) {
+		for (run = 0; i < size && run < MESH_RUN_MAX; i++, run++) {
+			delta = src[i] - ((i >= stride) ? src[i - stride] : 0);
+			if (delta != 0) {
+				break;
+			}
+		}
+		if (run > 0) {
+			dst[out++] = 0x80 | (uint8_t)(run - 1);
+			continue;
+		}
+
+		length_pos = out++;
+		for (run = 0; i < size && run < MESH_RUN_MAX; i++, run++) {
+			delta = src[i] - ((i >= stride) ? src[i - stride] : 0);
+			if (delta == 0) {
+				break;
+			}
+			dst[out++] = delta;
+		}
+		dst[length_pos] = (uint8_t)(run - 1);
+	}
+
+	return out;
+}
+
+// Decodes 'size' bytes written by mesh_encode, returning the end of the encoded input
+const uint8_t *mesh_decode(const uint8_t *src, uint8_t *dst, size_t size, size_t stride) {
+	size_t i = 0, run;
+	uint8_t delta;
+	bool zeros;
+
+	while (i < size) {
+		zeros = (*src & 0x80) != 0;
+		run = (size_t)(*src++ & 0x7F) + 1;
+		for (; run > 0 && i < size; run--, i++) {
+			delta = zeros ? 0 : *src++;
+			dst[i] = delta + ((i >= stride) ? dst[i - stride] : 0);
+		}
+	}
+
+	return src;
+}
+
+/*
+	Grows the mesh's dirty range to cover [start, end) bytes of its vertices. Returns true if the
+	mesh was clean before, meaning it still has to be queued for a flush.
+*/
+bool mesh_markdirty(struct EngineMesh *mesh, VkDeviceSize start, VkDeviceSize end) {
+	if (mesh->dirty == false) {
+		mesh->dirty_start = start;
+		mesh->dirty_end = end;
+		mesh->dirty = true;
+		return true;
+	}
+
+	if (start < mesh->dirty_start) {
+		mesh->dirty_start = start;
+	}
+	if (end > mesh->dirty_end) {
+		mesh->dirty_end = end;
+	}
+	return false;
+}
+
+// Grows the local bounds to cover 'vertices', returns true if they changed
+bool mesh_growbounds(struct EngineMesh *mesh, struct Vertex *vertices, size_t vertices_size) {
+	bool grown = false;
+	size_t i;
+	int j;
+
+	for (i = 0; i < vertices_size; i++) {
+		for (j = 0; j < 2; j++) {
+			if (vertices[i].pos[j] < mesh->bounds_min[j]) {
+				mesh->bounds_min[j] = vertices[i].pos[j];
+				grown = true;
+			}
+			if (vertices[i].pos[j] > mesh->bounds_max[j]) {
+				mesh->bounds_max[j] = vertices[i].pos[j];
+				grown = true;
+			}
+		}
+	}
+
+	return grown;
+}
+
+VkDeviceSize mesh_vertexbytes(struct EngineMesh *mesh) {
+	return sizeof(*mesh->vertices) * mesh->vertices_size;
+}
+
+// Indices of every level of detail
+size_t mesh_indexcount(struct EngineMesh *mesh) {
+	return mesh->indices_size + mesh->lod_indices_size;
+}
+
+// Bytes taken by the indices in a shared buffer, padded to keep 32-bit indices aligned
+VkDeviceSize mesh_indexbytes(struct EngineMesh *mesh) {
+	VkDeviceSize size = mesh_indexstride(mesh) * mesh_indexcount(mesh);
+	return (size + 3) & ~(VkDeviceSize)3;
+}
+
+size_t mesh_indexstride(struct EngineMesh *mesh) {
+	return (mesh->index_type == VK_INDEX_TYPE_UINT16) ? sizeof(uint16_t) : sizeof(uint32_t);
+}
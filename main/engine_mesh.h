@@ -0,0 +1,140 @@
+#include "GLFW/glfw3.h"
+#include "engine_arena.h"
+#include "engine_lod.h"
+#include "engine_vertex.h"
+#include "engine_vkmemory.h"
+#include "hashdata.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef ENGINE_MESH_H
+#define ENGINE_MESH_H
+
+#define MESH_REGISTRY_SIZE 4096
+#define MESH_HASH_SEED 0x766c6b656e67696eULL
+
+// Levels of detail including the full mesh, built for static meshes with enough triangles
+#define MESH_MAX_LODS 4
+#define MESH_LOD_MIN_TRIANGLES 256
+// Each level aims for this fraction of the previous level's triangles
+#define MESH_LOD_REDUCTION 0.5f
+// Levels stop once their error passes this fraction of the mesh's size
+#define MESH_LOD_MAX_ERROR 0.02f
+
+// Encoded runs hold at most this many bytes, so a run length fits in 7 bits
+#define MESH_RUN_MAX 128
+
+/*
+	What a static mesh keeps on the CPU once uploaded. Dynamic meshes always keep their geometry
+	so it can be updated in place.
+*/
+enum MeshRetention {
+	MESH_RETAIN_DEFAULT,
+	MESH_RETAIN_KEEP,
+	MESH_RETAIN_DISCARD,
+	MESH_RETAIN_COMPRESSED
+};
+
+// Range of a mesh's indices drawing one level of detail, 'error' is in mesh units
+struct MeshLod {
+	uint32_t first;
+	uint32_t count;
+	float error;
+};
+
+/*
+	Geometry shared by every object drawing the same vertices and indices. Registered meshes are
+	found by content hash, unregistered ones belong to a single object.
+*/
+struct EngineMesh {
+	uint64_t hash;
+
+	// Vertices
+	struct Vertex *vertices;
+	size_t vertices_size;
+
+	// Local bounds of the vertex positions, z is always 0
+	float bounds_min[3];
+	float bounds_max[3];
+
+	// Indices, stored as 16-bit when every index fits, 32-bit otherwise
+	void *indices;
+	size_t indices_size;
+	VkIndexType index_type;
+
+	// Levels of detail, level 0 is the full mesh. Simplified levels reuse the vertices and store
+	// 'lod_indices_size' more indices after the full ones, so they are uploaded together
+	struct MeshLod lods[MESH_MAX_LODS];
+	uint32_t lods_size;
+	size_t lod_indices_size;
+
+	// Vertex & index buffer location, NULL until uploaded
+	struct VulkanBuffer *vi_buffer;
+	VkDeviceSize vertex_offset;
+	VkDeviceSize index_offset;
+
+	// Byte range of 'vertices' changed since the last flush
+	VkDeviceSize dirty_start;
+	VkDeviceSize dirty_end;
+	bool dirty;
+
+	// CPU geometry policy. While dropped, 'vertices' and 'indices' are NULL and only the delta
+	// encoded 'compressed' copy, if any, is kept. Restored geometry, and geometry given room for
+	// levels of detail, is held in 'restored'
+	enum MeshRetention retention;
+	void *compressed;
+	size_t compressed_size;
+	void *restored;
+
+	// Memory allocation information, 'block' holds this mesh when it was stored in an arena
+	_Atomic uint32_t retain_count;
+	struct ArenaBlock *block;
+	struct MeshRegistry *registry;
+	struct EngineMesh *next;
+};
+
+struct MeshRegistry {
+	struct EngineMesh **table;
+	size_t size;
+	size_t meshes_size;
+	pthread_mutex_t lock;
+	struct VulkanMemory *memory_pool;
+};
+
+// Mesh registry functions
+bool meshreg_init(struct MeshRegistry *, struct VulkanMemory *);
+void meshreg_destroy(struct MeshRegistry *);
+struct EngineMesh *meshreg_acquire(struct MeshRegistry *, struct EngineMesh *, struct Arena *,
+								   bool, bool *);
+void meshreg_unlink(struct MeshRegistry *, struct EngineMesh *);
+
+// Mesh functions
+struct EngineMesh *mesh_create(void *, struct Vertex *, size_t, uint32_t *, size_t);
+struct EngineMesh *mesh_store(struct Arena *, struct EngineMesh *, bool);
+size_t mesh_storagesize(size_t, size_t);
+bool mesh_buildlods(struct EngineMesh *);
+bool mesh_wantslods(struct EngineMesh *);
+uint32_t mesh_selectlod(struct EngineMesh *, float);
+void mesh_retain(struct EngineMesh *);
+void mesh_release(struct VulkanMemory *, struct EngineMesh *);
+void mesh_free(struct VulkanMemory *, struct EngineMesh *);
+bool mesh_equals(struct EngineMesh *, struct EngineMesh *);
+bool mesh_dropgeometry(struct EngineMesh *);
+bool mesh_decompress(struct EngineMesh *);
+bool mesh_restore(struct EngineMesh *, const void *);
+size_t mesh_encode(const uint8_t *, size_t, size_t, uint8_t *);
+const uint8_t *mesh_decode(const uint8_t *, uint8_t *, size_t, size_t);
+bool mesh_markdirty(struct EngineMesh *, VkDeviceSize, VkDeviceSize);
+bool mesh_growbounds(struct EngineMesh *, struct Vertex *, size_t);
+VkDeviceSize mesh_vertexbytes(struct EngineMesh *);
+VkDeviceSize mesh_indexbytes(struct EngineMesh *);
+size_t mesh_indexcount(struct EngineMesh *);
+size_t mesh_indexstride(struct EngineMesh *);
+
+#endif	// ENGINE_MESH_H
@@ -1,46 +1,125 @@
 #include "engine_object.h"
 
+// Chunk holding position 'i' of a pipeline, the object's index in it is i % OBJECT_CHUNK_CAPACITY
+static inline struct EngineObjectAllocation *objgrp_chunkat(struct EnginePipeline *pipeline,
+															size_t i) {
+	return pipeline->chunks[i / OBJECT_CHUNK_CAPACITY];
+}
+
 /*			Engine object group functions		*/
 bool objgrp_init(struct ObjectGroup *obj_grp, struct VulkanMemory *vmem) {
 	int i;
 	for (i = 0; i < NUM_PIPELINES; i++) {
+		spatial_init(&obj_grp->spatial[i]);
+		obj_grp->views[i].planes_size = 0;
 		obj_grp->pipelines[i].pltype = i;
-		obj_grp->pipelines[i].allocations = NULL;
+		obj_grp->pipelines[i].chunks = NULL;
+		obj_grp->pipelines[i].chunks_size = 0;
+		obj_grp->pipelines[i].chunks_allocated = 0;
+		obj_grp->pipelines[i].chunks_capacity = 0;
+		obj_grp->pipelines[i].objects_size = 0;
 		obj_grp->queue[i] = NULL;
 		obj_grp->queue_size[i] = 0;
+		obj_grp->queue_capacity[i] = 0;
 	}
 
+	// 2D objects are placed in clip space, so their view is the [-1, 1] square
+	cull_viewport2d(&obj_grp->views[PIPELINE_2D], -1.0f, -1.0f, 1.0f, 1.0f);
+
 	obj_grp->object_table = hashtable_create(OBJECT_HASHTABLE_SIZE);
 	obj_grp->memory_pool = vmem;
-	return true;
+	obj_grp->retention = MESH_RETAIN_KEEP;
+	obj_grp->transforms = NULL;
+	obj_grp->transforms_size = 0;
+	obj_grp->transforms_capacity = 0;
+	obj_grp->cull_data = NULL;
+	obj_grp->batches = NULL;
+	obj_grp->batches_size = 0;
+	obj_grp->batches_capacity = 0;
+	obj_grp->commands_size = 0;
+	obj_grp->dirty_meshes = NULL;
+	obj_grp->dirty_size = 0;
+	obj_grp->dirty_capacity = 0;
+	pthread_mutex_init(&obj_grp->dirty_lock, NULL);
+	obj_grp->hierarchy = NULL;
+	obj_grp->hierarchy_changed = NULL;
+	obj_grp->hierarchy_size = 0;
+	obj_grp->hierarchy_capacity = 0;
+	obj_grp->hierarchy_sorted = true;
+	atomic_init(&obj_grp->hierarchy_dirty, false);
+	pthread_mutex_init(&obj_grp->hierarchy_lock, NULL);
+	obj_grp->retired = NULL;
+	obj_grp->retired_size = 0;
+	obj_grp->retired_capacity = 0;
+	pthread_mutex_init(&obj_grp->retired_lock, NULL);
+	atomic_init(&obj_grp->generation, 0);
+	atomic_init(&obj_grp->draw_generation, 0);
+	atomic_init(&obj_grp->static_generation, 0);
+	arena_init(&obj_grp->scratch, 0);
+	arena_init(&obj_grp->mesh_arena, 0);
+	pool_init(&obj_grp->allocation_pool, sizeof(struct EngineObjectAllocation),
+			  OBJGRP_ALLOCATIONS_PER_BLOCK);
+	pool_init(&obj_grp->object_pool, sizeof(struct EngineObject), OBJGRP_OBJECTS_PER_BLOCK);
+	return meshreg_init(&obj_grp->mesh_registry, vmem);
 }
 
 bool objgrp_queue(struct ObjectGroup *obj_grp, struct EngineObjectCreateInfo *eo_create_info) {
-	struct ObjectGroupQueue *link = malloc(sizeof(*link));
-	if (link == NULL) {
-		fprintf(stderr, "Failure to allocate link for object group.\n");
-		return false;
+	return objgrp_queuebulk(obj_grp, eo_create_info, 1);
+}
+
+/*
+	Create infos are copied, but the vertex and index arrays they point to are not. The caller
+	must keep them alive and unchanged until objgrp_processqueue has run. Either every info is
+	queued or, on failure, none is.
+*/
+bool objgrp_queuebulk(struct ObjectGroup *obj_grp, struct EngineObjectCreateInfo *eo_create_infos,
+					  size_t infos_size) {
+	size_t needed[NUM_PIPELINES] = {0};
+	enum PipelineType pltype;
+	size_t i;
+
+	// Check and count every info before touching the queues
+	for (i = 0; i < infos_size; i++) {
+		pltype = eo_create_infos[i].pltype;
+		if (pltype <= NO_PIPELINE || pltype >= NUM_PIPELINES) {
+			fprintf(stderr, "Invalid pipeline type for queued object.\n");
+			return false;
+		}
+		needed[pltype]++;
 	}
 
-	link->info = eo_create_info;
-	link->next = NULL;
+	// Grow queues geometrically to fit the whole batch
+	for (pltype = NO_PIPELINE + 1; pltype < NUM_PIPELINES; pltype++) {
+		needed[pltype] += obj_grp->queue_size[pltype];
+		if (needed[pltype] <= obj_grp->queue_capacity[pltype]) {
+			continue;
+		}
 
-	struct ObjectGroupQueue *curr = obj_grp->queue[eo_create_info->pltype];
+		size_t capacity = obj_grp->queue_capacity[pltype] * 2;
+		if (capacity < needed[pltype]) {
+			capacity = needed[pltype];
+		}
+		if (capacity < OBJGRP_QUEUE_MIN_CAPACITY) {
+			capacity = OBJGRP_QUEUE_MIN_CAPACITY;
+		}
 
-	// Get to end of queue
-	while (curr != NULL && curr->next != NULL) {
-		curr = curr->next;
-	}
+		struct EngineObjectCreateInfo *queue =
+			realloc(obj_grp->queue[pltype], sizeof(*queue) * capacity);
+		if (queue == NULL) {
+			fprintf(stderr, "Failure to allocate queue for object group.\n");
+			return false;
+		}
 
-	// Assign to end of queue
-	if (curr == NULL) {
-		obj_grp->queue[eo_create_info->pltype] = link;
-	} else {
-		curr->next = link;
+		obj_grp->queue[pltype] = queue;
+		obj_grp->queue_capacity[pltype] = capacity;
 	}
 
-	// Increment queue size
-	obj_grp->queue_size[eo_create_info->pltype]++;
+	// Append copies to the end of their queues
+	for (i = 0; i < infos_size; i++) {
+		pltype = eo_create_infos[i].pltype;
+		obj_grp->queue[pltype][obj_grp->queue_size[pltype]] = eo_create_infos[i];
+		obj_grp->queue_size[pltype]++;
+	}
 
 	return true;
 }
@@ -55,230 +134,1779 @@ bool objgrp_processqueue(struct ObjectGroup *obj_grp, struct Application *app) {
 			continue;
 		}
 
-		// Allocate engine object block
-		struct EngineObjectAllocation *allocation = malloc(sizeof(*allocation));
-		if (allocation == NULL) {
-			fprintf(stderr, "Failure to allocate engine object block.\n");
+		// Everything temporary for this batch comes from the scratch arena
+		arena_reset(&obj_grp->scratch);
+
+		// New objects follow the pipeline's last one, filling its last chunk first
+		struct EnginePipeline *pipeline = &obj_grp->pipelines[pltype];
+		size_t objects_size = obj_grp->queue_size[pltype], first = pipeline->objects_size;
+		if (objgrp_reservechunks(obj_grp, pipeline, first + objects_size) == false) {
 			return false;
 		}
 
-		// Set object block values
-		allocation->objects_size = obj_grp->queue_size[pltype];
-		allocation->next = NULL;
+		// Handles come from the pool on this thread, slices only fill them in
+		size_t i;
+		for (i = 0; i < objects_size; i++) {
+			struct EngineObject *handle = pool_alloc(&obj_grp->object_pool);
+			if (handle == NULL) {
+				fprintf(stderr, "Failure to allocate objects.\n");
+				objgrp_discardbatch(obj_grp, pipeline, first, i, 0, NULL);
+				return false;
+			}
+			objgrp_chunkat(pipeline, first + i)->objects[(first + i) % OBJECT_CHUNK_CAPACITY] =
+				handle;
+		}
+
+		// Split large batches across the thread pool, small ones run on this thread
+		uint32_t slices_size = 1;
+		if (objects_size >= OBJGRP_PARALLEL_THRESHOLD && app->thread_pool != NULL) {
+			slices_size = threadpool_slicecount(app->thread_pool);
+		}
 
-		// Allocate objects
-		allocation->objects = malloc(sizeof(*allocation->objects) * allocation->objects_size);
-		if (allocation->objects == NULL) {
-			fprintf(stderr, "Failure to allocate objects.\n");
+		struct ObjectGroupSlice *slices =
+			arena_alloc(&obj_grp->scratch, sizeof(*slices) * slices_size);
+		size_t *mesh_offsets = arena_alloc(&obj_grp->scratch, sizeof(*mesh_offsets) * objects_size);
+		if (slices == NULL || mesh_offsets == NULL) {
+			fprintf(stderr, "Failure to allocate object group slices.\n");
+			objgrp_discardbatch(obj_grp, pipeline, first, objects_size, 0, NULL);
 			return false;
 		}
+		memset(slices, 0, sizeof(*slices) * slices_size);
+
+		// Lay out every private mesh back to back so slices can build them without allocating
+		struct EngineObjectCreateInfo *infos = obj_grp->queue[pltype];
+		size_t mesh_bytes = 0;
+		for (i = 0; i < objects_size; i++) {
+			mesh_offsets[i] = mesh_bytes;
+			mesh_bytes +=
+				arena_alignsize(mesh_storagesize(infos[i].vertices_size, infos[i].indices_size));
+		}
 
-		// Clear all object data
-		memset(allocation->objects, 0, sizeof(*allocation->objects) * allocation->objects_size);
+		char *mesh_storage = arena_alloc(&obj_grp->scratch, mesh_bytes);
+		if (mesh_storage == NULL) {
+			fprintf(stderr, "Failure to allocate object group meshes.\n");
+			objgrp_discardbatch(obj_grp, pipeline, first, objects_size, 0, NULL);
+			return false;
+		}
 
-		// Go through every object on queue and create them
-		// Also count bytes for buffer allocation
-		struct ObjectGroupQueue *prev, *curr = obj_grp->queue[pltype];
-		VkDeviceSize buffer_size = 0;
-		union HashTableValue val;
-		size_t i = 0;
+		struct ObjectGroupJob job = {.app = app,
+									 .pipeline = pipeline,
+									 .first = first,
+									 .infos = infos,
+									 .slices = slices,
+									 .mesh_storage = mesh_storage,
+									 .mesh_offsets = mesh_offsets};
 
-		while (curr != NULL) {
-			// Create object & put on allocated array
-			object_init(&allocation->objects[i], app, curr->info);
+		// Go through every object on queue and create them, hashing their geometry
+		if (slices_size > 1) {
+			threadpool_dispatch(app->thread_pool, objgrp_buildslice, &job, objects_size);
+		} else {
+			objgrp_buildslice(&job, 0, objects_size, 0);
+		}
 
-			buffer_size += allocation->objects[i].render_data.vertices_size *
-						   sizeof(*allocation->objects[i].render_data.vertices);
-			buffer_size += allocation->objects[i].render_data.indices_size *
-						   sizeof(*allocation->objects[i].render_data.indices);
+		uint32_t k;
+		for (k = 0; k < slices_size; k++) {
+			if (slices[k].failed) {
+				fprintf(stderr, "Failure to create object from queue.\n");
+				objgrp_discardbatch(obj_grp, pipeline, first, objects_size, 0, NULL);
+				return false;
+			}
+		}
 
-			// Store object in hashtable
-			val.ptr = &allocation->objects[i];
-			hashtable_store(obj_grp->object_table, curr->info->name, val, HASHTABLE_PTR);
+		struct EngineMesh **meshes =
+			arena_alloc(&obj_grp->scratch, sizeof(*meshes) * objects_size);
+		union HashTableValue *names = arena_alloc(&obj_grp->scratch, sizeof(*names) * objects_size);
+		if (meshes == NULL || names == NULL) {
+			fprintf(stderr, "Failure to allocate object group meshes.\n");
+			objgrp_discardbatch(obj_grp, pipeline, first, objects_size, 0, NULL);
+			return false;
+		}
 
-			// Move to next item in queue
-			prev = curr;
-			curr = curr->next;
-			i++;
+		// Swap each static mesh for a registered copy in queue order, only meshes new to the
+		// registry are uploaded. Dynamic meshes get a private copy so they can be updated in place
+		// and are packed from the back of the array. Both copies live in the group's mesh arena.
+		// Also store named objects in hashtable, keyed by the object's own name
+		struct EngineObject *engine_object;
+		struct RenderData *render_data;
+		struct EngineMesh *mesh;
+		union HashTableValue val;
+		size_t static_size = 0, dynamic_size = 0, position;
+		bool created;
+
+		for (i = 0; i < objects_size; i++) {
+			position = first + i;
+			engine_object =
+				objgrp_chunkat(pipeline, position)->objects[position % OBJECT_CHUNK_CAPACITY];
+			render_data = &engine_object->render_data;
+			render_data->mesh->retention = infos[i].retention;
+			if (infos[i].retention == MESH_RETAIN_DEFAULT) {
+				render_data->mesh->retention = obj_grp->retention;
+			}
+
+			if ((object_getflags(engine_object) & OBJECT_FLAG_STATIC) == 0) {
+				render_data->mesh->retention = MESH_RETAIN_KEEP;
+				mesh = mesh_store(&obj_grp->mesh_arena, render_data->mesh, false);
+				created = false;
+				if (mesh != NULL) {
+					dynamic_size++;
+					meshes[objects_size - dynamic_size] = mesh;
+				}
+			} else {
+				mesh = meshreg_acquire(&obj_grp->mesh_registry, render_data->mesh,
+									   &obj_grp->mesh_arena, true, &created);
+				if (created) {
+					meshes[static_size++] = mesh;
+				}
+			}
+			if (mesh == NULL) {
+				fprintf(stderr, "Failure to store object mesh.\n");
+				objgrp_discardbatch(obj_grp, pipeline, first, objects_size, i, names);
+				return false;
+			}
+			render_data->mesh = mesh;
+
+			// The object the name pointed to is kept, so a failed batch can give the name back
+			if (engine_object->name[0] != '\0') {
+				names[i].ptr = NULL;
+				hashtable_access(obj_grp->object_table, engine_object->name, &names[i]);
+				val.ptr = engine_object;
+				hashtable_store(obj_grp->object_table, engine_object->name, val, HASHTABLE_PTR);
+			}
+		}
 
-			// Free queue item
-			free(prev);
-			prev = NULL;
+		// Levels of detail are built once per mesh new to the registry, not per object sharing it
+		bool ret = true;
+		if (static_size > 0) {
+			job.meshes = meshes;
+			memset(slices, 0, sizeof(*slices) * slices_size);
+			if (slices_size > 1) {
+				threadpool_dispatch(app->thread_pool, objgrp_lodslice, &job, static_size);
+			} else {
+				objgrp_lodslice(&job, 0, static_size, 0);
+			}
+			for (k = 0; k < slices_size; k++) {
+				ret = ret && slices[k].failed == false;
+			}
 		}
 
-		// Create buffer for objects in allocation
-		struct VulkanBuffer *obj_buffer;
-		bool ret = vkmemory_createbuffer(obj_grp->memory_pool, buffer_size,
-										 VK_BUFFER_USAGE_VERTEX_BUFFER_BIT |
-											 VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-										 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &obj_buffer);
+		// Upload new static and dynamic meshes to separate buffers, updates only touch the latter
+		if (ret && static_size > 0) {
+			ret = objgrp_uploadmeshes(obj_grp, app, &job, meshes, static_size, false);
+
+			// Static meshes may borrow scratch geometry, which must be let go before the reset
+			for (i = 0; i < static_size; i++) {
+				mesh_dropgeometry(meshes[i]);
+			}
+		}
+		if (ret && dynamic_size > 0) {
+			struct EngineMesh **dynamic_meshes = meshes + objects_size - dynamic_size;
+			ret = objgrp_uploadmeshes(obj_grp, app, &job, dynamic_meshes, dynamic_size, true);
+		}
 		if (ret == false) {
-			fprintf(stderr, "Failure creating Vulkan buffer.\n");
+			objgrp_discardbatch(obj_grp, pipeline, first, objects_size, objects_size, names);
 			return false;
 		}
 
-		// Assign buffer data to each object, copy data
-		struct VulkanBuffer *temp_buff;
-		VkDeviceSize v_offset = 0;
-		size_t j;
-
-		for (j = 0; j < allocation->objects_size; j++) {
-			printf("Setting object buffer to %p\n", obj_buffer->buffer);
-			allocation->objects[j].render_data.vi_buffer = obj_buffer;
-			allocation->objects[j].render_data.vertex_offset = v_offset;
-
-			ret = vkmemory_createbuffer(obj_grp->memory_pool,
-										sizeof(*allocation->objects[j].render_data.vertices) *
-											allocation->objects[j].render_data.vertices_size,
-										VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-										VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-											VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-										&temp_buff);
-			if (ret == false) {
-				fprintf(stderr, "Failure transfering vertex data to GPU.\n");
+		// Objects join their chunks and draw batches, then fill their transform slots once every
+		// one of them has a batch
+		struct EngineObjectAllocation *chunk;
+		size_t start, count;
+		pipeline->objects_size += objects_size;
+		pipeline->chunks_size =
+			(pipeline->objects_size + OBJECT_CHUNK_CAPACITY - 1) / OBJECT_CHUNK_CAPACITY;
+
+		for (position = first; position < pipeline->objects_size; position += count) {
+			chunk = objgrp_chunkat(pipeline, position);
+			start = position % OBJECT_CHUNK_CAPACITY;
+			count = OBJECT_CHUNK_CAPACITY - start;
+			if (count > pipeline->objects_size - position) {
+				count = pipeline->objects_size - position;
+			}
+			chunk->objects_size = start + count;
+
+			if (objgrp_assignbatches(obj_grp, chunk, start) == false) {
+				objgrp_discardbatch(obj_grp, pipeline, first, objects_size, objects_size, names);
 				return false;
 			}
+		}
+
+		for (position = first; position < pipeline->objects_size; position += count) {
+			chunk = objgrp_chunkat(pipeline, position);
+			start = position % OBJECT_CHUNK_CAPACITY;
+			count = chunk->objects_size - start;
+			objalloc_writetransforms(chunk, pltype, obj_grp, start, true);
+			if (start == 0) {
+				atomic_store(&chunk->transforms_dirty, false);
+			}
+		}
 
-			void *data;
-			vkmemory_mapbuffer(obj_grp->memory_pool, temp_buff, &data);
-			memcpy(data, allocation->objects[j].render_data.vertices,
-				   sizeof(*allocation->objects[j].render_data.vertices) *
-					   allocation->objects[j].render_data.vertices_size);
-			vkmemory_unmapbuffer(obj_grp->memory_pool, temp_buff);
+		// Empty current queue, keeping its capacity for the next batch
+		obj_grp->queue_size[pltype] = 0;
+		atomic_fetch_add(&obj_grp->generation, 1);
+	}
 
-			vulkan_copybuffer(app, obj_grp->memory_pool, temp_buff, obj_buffer,
-							  sizeof(*allocation->objects[j].render_data.vertices) *
-								  allocation->objects[j].render_data.vertices_size,
-							  v_offset);
+	return true;
+}
 
-			vkmemory_destroybuffer(obj_grp->memory_pool, temp_buff);
+/*
+	Undoes a failed batch of objgrp_processqueue, leaving the queue to be processed again. Of the
+	'handles' objects allocated from position 'first', those already in draw batches leave them,
+	the first 'stored' give back their stored mesh and name, and every handle returns to the pool.
+	Names go back to the object in 'names', NULL if they had none. The pipeline's object and chunk
+	counts go back to where the batch started.
+*/
+void objgrp_discardbatch(struct ObjectGroup *obj_grp, struct EnginePipeline *pipeline,
+						 size_t first, size_t handles, size_t stored, union HashTableValue *names) {
+	struct EngineObjectAllocation *chunk;
+	struct EngineObject *engine_object;
+	struct ObjectDrawBatch *batch;
+	struct ObjectCullData *cull;
+	size_t i, index, c;
 
-			v_offset += sizeof(*allocation->objects[j].render_data.vertices) *
-						allocation->objects[j].render_data.vertices_size;
+	// Latest names first, so a name taken twice in the batch ends up where it was before it
+	for (i = stored; i-- > 0;) {
+		engine_object =
+			objgrp_chunkat(pipeline, first + i)->objects[(first + i) % OBJECT_CHUNK_CAPACITY];
+		if (engine_object->name[0] == '\0') {
+			continue;
 		}
+		if (names[i].ptr == NULL) {
+			hashtable_remove(obj_grp->object_table, engine_object->name);
+		} else {
+			hashtable_store(obj_grp->object_table, engine_object->name, names[i], HASHTABLE_PTR);
+		}
+	}
 
-		assert(i == obj_grp->queue_size[pltype]);
-
-		// Put allocation on pipeline list
-		struct EngineObjectAllocation *plcurr = obj_grp->pipelines[pltype].allocations;
+	for (i = 0; i < handles; i++) {
+		chunk = objgrp_chunkat(pipeline, first + i);
+		index = (first + i) % OBJECT_CHUNK_CAPACITY;
+		engine_object = chunk->objects[index];
 
-		while (plcurr != NULL && plcurr->next != NULL) {
-			plcurr = plcurr->next;
+		// The batch slots were the last handed out, so giving them back moves no other object.
+		// Batches left empty drop their buffer like those emptied by destruction
+		cull = &obj_grp->cull_data[chunk->transform_base + index];
+		if (cull->batch != OBJECT_BATCH_NONE) {
+			batch = &obj_grp->batches[cull->batch];
+			batch->objects_size--;
+			if (--batch->live_size == 0) {
+				vkmemory_releasebuffer(obj_grp->memory_pool, batch->buffer);
+				batch->buffer = NULL;
+			}
 		}
+		objgrp_clearslot(obj_grp, chunk, index);
+		chunk->flags[index] = 0;
 
-		if (plcurr == NULL) {
-			obj_grp->pipelines[pltype].allocations = allocation;
-		} else {
-			plcurr->next = allocation;
+		if (i < stored) {
+			mesh_release(obj_grp->memory_pool, engine_object->render_data.mesh);
 		}
 
-		// Empty current queue
-		obj_grp->queue[pltype] = NULL;
-		obj_grp->queue_size[pltype] = 0;
+		chunk->objects[index] = NULL;
+		pool_free(&obj_grp->object_pool, engine_object);
+	}
+
+	// Chunks stay allocated for the next batch, only their counts shrink
+	pipeline->objects_size = first;
+	pipeline->chunks_size = (first + OBJECT_CHUNK_CAPACITY - 1) / OBJECT_CHUNK_CAPACITY;
+	for (c = first / OBJECT_CHUNK_CAPACITY; c < pipeline->chunks_allocated; c++) {
+		pipeline->chunks[c]->objects_size =
+			first > c * OBJECT_CHUNK_CAPACITY ? first - c * OBJECT_CHUNK_CAPACITY : 0;
+	}
+	objgrp_layoutcommands(obj_grp);
+}
+
+/*
+	Packs 'meshes_size' meshes into one device-local buffer through a single staging buffer,
+	vertices first and indices after them. Dynamic meshes receive their updates as copies into it.
+*/
+bool objgrp_uploadmeshes(struct ObjectGroup *obj_grp, struct Application *app,
+						 struct ObjectGroupJob *job, struct EngineMesh **meshes, size_t meshes_size,
+						 bool dynamic) {
+	job->meshes = meshes;
+
+	// Reuse the object slicing only when there are enough meshes to be worth it
+	uint32_t slices_size = 1;
+	if (meshes_size >= OBJGRP_PARALLEL_THRESHOLD && app->thread_pool != NULL) {
+		slices_size = threadpool_slicecount(app->thread_pool);
+	}
+	memset(job->slices, 0, sizeof(*job->slices) * slices_size);
+
+	if (slices_size > 1) {
+		threadpool_dispatch(app->thread_pool, objgrp_sizeslice, job, meshes_size);
+	} else {
+		objgrp_sizeslice(job, 0, meshes_size, 0);
+	}
+
+	// Exclusive prefix sums over slices give each slice's first vertex and index offset
+	// Indices are packed after every vertex of the batch
+	VkDeviceSize buffer_size = 0, v_offset = 0, i_offset = 0;
+	uint32_t k;
+
+	for (k = 0; k < slices_size; k++) {
+		job->slices[k].vertex_base = v_offset;
+		v_offset += job->slices[k].vertex_bytes;
+	}
+	for (k = 0; k < slices_size; k++) {
+		job->slices[k].index_base = v_offset + i_offset;
+		i_offset += job->slices[k].index_bytes;
+	}
+	buffer_size = v_offset + i_offset;
+
+	// Create buffer for meshes in batch, updates are always copied in on the GPU
+	VkBufferUsageFlags usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT |
+							   VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+	if (dynamic == false) {
+		// Readable so geometry dropped from the CPU can be brought back
+		usage |= VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+	}
+
+	struct VulkanBuffer *obj_buffer;
+	bool ret = vkmemory_createbuffer(obj_grp->memory_pool, buffer_size, usage,
+									 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &obj_buffer);
+	if (ret == false) {
+		fprintf(stderr, "Failure creating Vulkan buffer.\n");
+		return false;
+	}
+	job->buffer = obj_buffer;
+
+	// Stage the whole batch at once so the copy can be split across transfer queues
+	struct VulkanBuffer *temp_buff;
+	ret = vkmemory_createbuffer(
+		obj_grp->memory_pool, buffer_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &temp_buff);
+	if (ret == false) {
+		fprintf(stderr, "Failure transfering vertex data to GPU.\n");
+		vkmemory_releasebuffer(obj_grp->memory_pool, obj_buffer);
+		return false;
+	}
+
+	// Assign buffer data to each mesh, copy data
+	if (vkmemory_mapbuffer(obj_grp->memory_pool, temp_buff, &job->staging) == false) {
+		vkmemory_destroybuffer(obj_grp->memory_pool, temp_buff);
+		vkmemory_releasebuffer(obj_grp->memory_pool, obj_buffer);
+		return false;
+	}
+
+	if (slices_size > 1) {
+		threadpool_dispatch(app->thread_pool, objgrp_stageslice, job, meshes_size);
+	} else {
+		objgrp_stageslice(job, 0, meshes_size, 0);
+	}
+
+	vkmemory_unmapbuffer(obj_grp->memory_pool, temp_buff);
+
+	// Every mesh holds its own reference now, drop the creation reference
+	vkmemory_releasebuffer(obj_grp->memory_pool, obj_buffer);
+
+	ret = vulkan_copybuffer(app, obj_grp->memory_pool, temp_buff, obj_buffer, buffer_size, 0);
+	vkmemory_destroybuffer(obj_grp->memory_pool, temp_buff);
+	if (ret == false) {
+		fprintf(stderr, "Failure transfering vertex data to GPU.\n");
+		return false;
 	}
 
 	return true;
 }
 
-bool objgrp_destroy(struct ObjectGroup *objgrp) {
-	enum PipelineType pltype;
+/*
+	Writes every queued vertex update to the GPU. Updates are gathered into the current frame's
+	staging memory and copied with merged regions by its update command buffer, which runs ahead
+	of the frame's draws and after the frames still in flight, so they never see partial data.
+*/
+bool objgrp_flushupdates(struct ObjectGroup *obj_grp, struct Application *app) {
+	// Destroy released objects here so flags, hierarchy and trees are only changed by this thread
+	objgrp_destroyretired(obj_grp);
+
+	pthread_mutex_lock(&obj_grp->dirty_lock);
+
+	struct ObjectGroupUpdate *updates = NULL;
+	size_t i, updates_size = 0;
+	VkDeviceSize staging_size = 0;
+	bool ret = true;
+
+	if (obj_grp->dirty_size > 0) {
+		updates = malloc(sizeof(*updates) * obj_grp->dirty_size);
+		if (updates == NULL) {
+			fprintf(stderr, "Failure to allocate object group updates.\n");
+			pthread_mutex_unlock(&obj_grp->dirty_lock);
+			return false;
+		}
+	}
+
+	// Collect the changed range of every mesh that has a buffer
+	struct EngineMesh *mesh;
+	for (i = 0; i < obj_grp->dirty_size; i++) {
+		mesh = obj_grp->dirty_meshes[i];
+		if (mesh->vi_buffer != NULL) {
+			updates[updates_size].buffer = mesh->vi_buffer;
+			updates[updates_size].offset = mesh->vertex_offset + mesh->dirty_start;
+			updates[updates_size].size = mesh->dirty_end - mesh->dirty_start;
+			updates[updates_size].data = (char *)mesh->vertices + mesh->dirty_start;
+			staging_size += updates[updates_size].size;
+			updates_size++;
+		}
+	}
+
+	if (updates_size > 0) {
+		ret = objgrp_uploadupdates(app, updates, updates_size, staging_size);
+	}
 
+	// Updates are written, drop the references taken when they were queued
+	for (i = 0; i < obj_grp->dirty_size; i++) {
+		obj_grp->dirty_meshes[i]->dirty = false;
+		mesh_release(obj_grp->memory_pool, obj_grp->dirty_meshes[i]);
+	}
+	obj_grp->dirty_size = 0;
+
+	pthread_mutex_unlock(&obj_grp->dirty_lock);
+	free(updates);
+
+	// Hierarchy members first, while their dirty flags still tell which subtrees moved
+	if (objgrp_updatehierarchy(obj_grp) == false) {
+		ret = false;
+	}
+
+	// Rebuild changed transforms in the CPU copy, the whole copy is sent with the frame. Objects
+	// destroyed since the last flush leave their batches here, then their slots are filled
+	enum PipelineType pltype;
+	struct EnginePipeline *pipeline;
+	struct EngineObjectAllocation *curr;
+	size_t c;
 	for (pltype = NO_PIPELINE; pltype < NUM_PIPELINES; pltype++) {
-		struct EngineObjectAllocation *prev, *curr = objgrp->pipelines[pltype].allocations;
-		while (curr != NULL) {
-			prev = curr;
-			curr = curr->next;
-
-			size_t i;
-			for (i = 0; i < prev->objects_size; i++) {
-				object_destroy(&prev->objects[i]);
+		pipeline = &obj_grp->pipelines[pltype];
+		for (c = 0; c < pipeline->chunks_size; c++) {
+			curr = pipeline->chunks[c];
+			if (atomic_exchange(&curr->transforms_dirty, false)) {
+				objalloc_writetransforms(curr, pltype, obj_grp, 0, false);
+			}
+		}
+		objgrp_compact(obj_grp, pipeline);
+	}
+
+	return ret;
+}
+
+/*
+	Sorts updates by destination, merges touching ranges and records their copies from the
+	current frame's update staging, with one region per merged range.
+*/
+bool objgrp_uploadupdates(struct Application *app, struct ObjectGroupUpdate *updates,
+						  size_t updates_size, VkDeviceSize staging_size) {
+	qsort(updates, updates_size, sizeof(*updates), objgrp_compareupdates);
+
+	VkBufferCopy *regions = malloc(sizeof(*regions) * updates_size);
+	void *staging;
+	if (regions == NULL || vulkan_beginupdates(app, staging_size, &staging) == false) {
+		fprintf(stderr, "Failure staging object updates.\n");
+		free(regions);
+		return false;
+	}
+
+	// Ranges that touch or overlap in the same buffer become one region, later data wins
+	VkDeviceSize src_offset = 0, end;
+	size_t i, first = 0;
+	uint32_t regions_size = 0;
+
+	for (i = 0; i < updates_size; i++) {
+		bool merge = regions_size > 0 && updates[i].buffer == updates[first].buffer &&
+					 updates[i].offset <= regions[regions_size - 1].dstOffset +
+											  regions[regions_size - 1].size;
+		if (merge) {
+			VkBufferCopy *region = &regions[regions_size - 1];
+			memcpy((char *)staging + region->srcOffset + (updates[i].offset - region->dstOffset),
+				   updates[i].data, updates[i].size);
+
+			end = updates[i].offset + updates[i].size;
+			if (end > region->dstOffset + region->size) {
+				src_offset += end - (region->dstOffset + region->size);
+				region->size = end - region->dstOffset;
 			}
+			continue;
+		}
 
-			free(prev->objects);
-			prev->objects = NULL;
-			free(prev);
-			prev = NULL;
+		// New destination buffer, copy the regions gathered for the previous one
+		if (regions_size > 0 && updates[i].buffer != updates[first].buffer) {
+			vulkan_recordupdates(app, updates[first].buffer, regions, regions_size);
+			regions_size = 0;
 		}
+
+		first = i;
+		regions[regions_size].srcOffset = src_offset;
+		regions[regions_size].dstOffset = updates[i].offset;
+		regions[regions_size].size = updates[i].size;
+		memcpy((char *)staging + src_offset, updates[i].data, updates[i].size);
+		src_offset += updates[i].size;
+		regions_size++;
 	}
 
-	hashtable_destroy(objgrp->object_table);
+	if (regions_size > 0) {
+		vulkan_recordupdates(app, updates[first].buffer, regions, regions_size);
+	}
+
+	free(regions);
 	return true;
 }
 
-/*          Render object functions         */
+// Orders updates by destination buffer, then by offset within it
+int objgrp_compareupdates(const void *a, const void *b) {
+	const struct ObjectGroupUpdate *ua = a, *ub = b;
 
-bool object_init(struct EngineObject *engine_object, struct Application *app,
-				 struct EngineObjectCreateInfo *eo_create_info) {
-	// Clear data
-	memset(engine_object, 0, sizeof(*engine_object));
+	if (ua->buffer != ub->buffer) {
+		return ((uintptr_t)ua->buffer < (uintptr_t)ub->buffer) ? -1 : 1;
+	}
+	if (ua->offset != ub->offset) {
+		return (ua->offset < ub->offset) ? -1 : 1;
+	}
+	return 0;
+}
 
-	// Set render data
-	engine_object->render_data.pltype = eo_create_info->pltype;
+// Grows the transform and cull data arrays to fit 'count' more slots
+bool objgrp_reservetransforms(struct ObjectGroup *obj_grp, size_t count) {
+	size_t needed = obj_grp->transforms_size + count;
+	if (needed <= obj_grp->transforms_capacity) {
+		return true;
+	}
+
+	size_t capacity = obj_grp->transforms_capacity * 2;
+	if (capacity < needed) {
+		capacity = needed;
+	}
+
+	union ObjectTransform *transforms =
+		realloc(obj_grp->transforms, sizeof(*transforms) * capacity);
+	if (transforms == NULL) {
+		fprintf(stderr, "Failure to allocate object transforms.\n");
+		return false;
+	}
+
+	obj_grp->transforms = transforms;
+
+	struct ObjectCullData *cull_data = realloc(obj_grp->cull_data, sizeof(*cull_data) * capacity);
+	if (cull_data == NULL) {
+		fprintf(stderr, "Failure to allocate object cull data.\n");
+		return false;
+	}
+
+	obj_grp->cull_data = cull_data;
+	obj_grp->transforms_capacity = capacity;
+	return true;
+}
+
+/*
+	Makes sure a pipeline has chunks for 'objects_size' objects. Each new chunk takes the next
+	OBJECT_CHUNK_CAPACITY transform slots, left empty until objects are placed in them.
+*/
+bool objgrp_reservechunks(struct ObjectGroup *obj_grp, struct EnginePipeline *pipeline,
+						  size_t objects_size) {
+	size_t needed = (objects_size + OBJECT_CHUNK_CAPACITY - 1) / OBJECT_CHUNK_CAPACITY;
+
+	if (needed > pipeline->chunks_capacity) {
+		size_t capacity = pipeline->chunks_capacity * 2;
+		if (capacity < OBJGRP_CHUNK_MIN_CAPACITY) {
+			capacity = OBJGRP_CHUNK_MIN_CAPACITY;
+		}
+		if (capacity < needed) {
+			capacity = needed;
+		}
 
-	if (eo_create_info->vertices_size > 0) {
-		engine_object->render_data.vertices_size = eo_create_info->vertices_size;
-		engine_object->render_data.vertices = malloc(sizeof(*engine_object->render_data.vertices) *
-													 engine_object->render_data.vertices_size);
-		if (engine_object->render_data.vertices == NULL) {
-			fprintf(stderr, "Failure to allocate memory. Line: #%d.\n", __LINE__);
+		struct EngineObjectAllocation **chunks =
+			realloc(pipeline->chunks, sizeof(*chunks) * capacity);
+		if (chunks == NULL) {
+			fprintf(stderr, "Failure to allocate object chunks.\n");
 			return false;
 		}
 
-		memcpy(engine_object->render_data.vertices, eo_create_info->vertices,
-			   sizeof(*engine_object->render_data.vertices) * eo_create_info->vertices_size);
-	} else {
-		engine_object->render_data.vertices_size = 0;
-		engine_object->render_data.vertices = NULL;
+		pipeline->chunks = chunks;
+		pipeline->chunks_capacity = capacity;
 	}
 
-	if (eo_create_info->indices_size > 0) {
-		engine_object->render_data.indices_size = eo_create_info->indices_size;
-		engine_object->render_data.indices = malloc(sizeof(*engine_object->render_data.indices) *
-													engine_object->render_data.indices_size);
-		if (engine_object->render_data.indices == NULL) {
-			fprintf(stderr, "Failure to allocate memory. Line: #%d.\n", __LINE__);
+	struct EngineObjectAllocation *chunk;
+	size_t i;
+	while (pipeline->chunks_allocated < needed) {
+		chunk = pool_alloc(&obj_grp->allocation_pool);
+		if (chunk == NULL || objalloc_init(chunk) == false) {
+			fprintf(stderr, "Failure to allocate engine object block.\n");
+			if (chunk != NULL) {
+				pool_free(&obj_grp->allocation_pool, chunk);
+			}
+			return false;
+		}
+		if (objgrp_reservetransforms(obj_grp, OBJECT_CHUNK_CAPACITY) == false) {
+			objalloc_destroy(chunk);
+			pool_free(&obj_grp->allocation_pool, chunk);
 			return false;
 		}
 
-		memcpy(engine_object->render_data.indices, eo_create_info->indices,
-			   sizeof(*engine_object->render_data.indices) * eo_create_info->indices_size);
-	} else {
-		engine_object->render_data.indices_size = 0;
-		engine_object->render_data.indices = NULL;
+		chunk->transform_base = obj_grp->transforms_size;
+		obj_grp->transforms_size += OBJECT_CHUNK_CAPACITY;
+		memset(obj_grp->transforms + chunk->transform_base, 0,
+			   sizeof(*obj_grp->transforms) * OBJECT_CHUNK_CAPACITY);
+		for (i = 0; i < OBJECT_CHUNK_CAPACITY; i++) {
+			objgrp_clearslot(obj_grp, chunk, i);
+		}
+
+		pipeline->chunks[pipeline->chunks_allocated++] = chunk;
 	}
 
-	// Set default struct data
-	engine_object->owner = app;
-	memset(engine_object->pos, 0, sizeof(engine_object->pos));
-	memset(engine_object->rot, 0, sizeof(engine_object->rot));
-	engine_object->is_static = eo_create_info->is_static;
-	engine_object->retain_count = 1;
 	return true;
 }
 
-bool object_retain(struct EngineObject *engine_object) {
-	engine_object->retain_count++;
-	return true;
+/*
+	Fills the position of every destroyed object with the pipeline's last object, so every chunk
+	stays full but the last. Only objects whose destruction was already flushed are taken out, their
+	handles go back to the pool and their name leaves the object table. Objects move, so this must
+	not run while other threads use them.
+*/
+void objgrp_compact(struct ObjectGroup *obj_grp, struct EnginePipeline *pipeline) {
+	struct EngineObjectAllocation *chunk;
+	struct EngineObject *engine_object;
+	union HashTableValue val;
+	size_t i = 0, index, last, removed = 0;
+
+	while (i < pipeline->objects_size) {
+		chunk = objgrp_chunkat(pipeline, i);
+		index = i % OBJECT_CHUNK_CAPACITY;
+		if ((chunk->flags[index] & OBJECT_FLAG_RETIRED) == 0 ||
+			(obj_grp->cull_data[chunk->transform_base + index].flags & OBJECT_CULL_LIVE)) {
+			i++;
+			continue;
+		}
+
+		// The table keeps the first key stored under a name, so an entry that now points to
+		// another object is stored again under that object's name
+		engine_object = chunk->objects[index];
+		if (engine_object->name[0] != '\0' &&
+			hashtable_access(obj_grp->object_table, engine_object->name, &val)) {
+			hashtable_remove(obj_grp->object_table, engine_object->name);
+			if (val.ptr != engine_object) {
+				hashtable_store(obj_grp->object_table, ((struct EngineObject *)val.ptr)->name, val,
+								HASHTABLE_PTR);
+			}
+		}
+		pool_free(&obj_grp->object_pool, engine_object);
+		removed++;
+
+		// Last object takes the slot and is checked next, the last chunk shrinks
+		last = --pipeline->objects_size;
+		if (i != last) {
+			objgrp_moveobject(obj_grp, pipeline, last, i);
+		} else {
+			objgrp_clearslot(obj_grp, chunk, index);
+		}
+		objgrp_chunkat(pipeline, last)->objects_size--;
+	}
+
+	pipeline->chunks_size =
+		(pipeline->objects_size + OBJECT_CHUNK_CAPACITY - 1) / OBJECT_CHUNK_CAPACITY;
+	if (removed > 0) {
+		objgrp_renumberbatches(obj_grp, pipeline);
+		atomic_fetch_add(&obj_grp->generation, 1);
+	}
 }
 
-bool object_release(struct EngineObject *engine_object) {
-	engine_object->retain_count--;
-	if (engine_object->retain_count == 0)
-		object_destroy(engine_object);
-	return true;
+/*
+	Gives the live objects of a pipeline consecutive slots in their batches again, so a batch owns
+	only as many commands as it has objects and the commands of removed objects are reclaimed.
+*/
+void objgrp_renumberbatches(struct ObjectGroup *obj_grp, struct EnginePipeline *pipeline) {
+	struct EngineObjectAllocation *chunk;
+	struct ObjectCullData *cull;
+	size_t c, i;
+	uint32_t b;
+
+	for (b = 0; b < obj_grp->batches_size; b++) {
+		if (obj_grp->batches[b].pltype == pipeline->pltype) {
+			obj_grp->batches[b].objects_size = 0;
+		}
+	}
+
+	for (c = 0; c < pipeline->chunks_size; c++) {
+		chunk = pipeline->chunks[c];
+		for (i = 0; i < chunk->objects_size; i++) {
+			cull = &obj_grp->cull_data[chunk->transform_base + i];
+			if ((cull->flags & OBJECT_CULL_LIVE) && cull->batch != OBJECT_BATCH_NONE) {
+				cull->batch_slot = obj_grp->batches[cull->batch].objects_size++;
+			}
+		}
+	}
+
+	objgrp_layoutcommands(obj_grp);
 }
 
-bool object_destroy(struct EngineObject *engine_object) {
-	free(engine_object->render_data.vertices);
-	engine_object->render_data.vertices = NULL;
-	free(engine_object->render_data.indices);
-	engine_object->render_data.indices = NULL;
-	object_destroybuffers(engine_object);
+/*
+	Moves the object at position 'from' of a pipeline to the free position 'to' with its streams,
+	transform and cull data, and leaves 'from' empty. The handle follows it to the new slot.
+*/
+void objgrp_moveobject(struct ObjectGroup *obj_grp, struct EnginePipeline *pipeline, size_t from,
+					   size_t to) {
+	struct EngineObjectAllocation *src = objgrp_chunkat(pipeline, from);
+	struct EngineObjectAllocation *dst = objgrp_chunkat(pipeline, to);
+	size_t s = from % OBJECT_CHUNK_CAPACITY, d = to % OBJECT_CHUNK_CAPACITY;
+	int j;
+
+	for (j = 0; j < 3; j++) {
+		dst->pos[j][d] = src->pos[j][s];
+		dst->rot[j][d] = src->rot[j][s];
+		dst->bounds_min[j][d] = src->bounds_min[j][s];
+		dst->bounds_max[j][d] = src->bounds_max[j][s];
+	}
+	dst->flags[d] = src->flags[s];
+	src->flags[s] = 0;
+
+	dst->objects[d] = src->objects[s];
+	dst->objects[d]->allocation = dst;
+	dst->objects[d]->index = d;
+
+	// Batch slot moves with the cull data, so the object keeps its indirect command
+	obj_grp->transforms[dst->transform_base + d] = obj_grp->transforms[src->transform_base + s];
+	obj_grp->cull_data[dst->transform_base + d] = obj_grp->cull_data[src->transform_base + s];
+	objgrp_clearslot(obj_grp, src, s);
+
+	// A pending transform change follows the object, visible lists are rebuilt by the next cull
+	if (dst->flags[d] & OBJECT_FLAG_DIRTY) {
+		atomic_store(&dst->transforms_dirty, true);
+	}
+	src->visible_size = dst->visible_size = 0;
+}
+
+// Leaves a transform slot without an object, so the cull pass skips it
+void objgrp_clearslot(struct ObjectGroup *obj_grp, struct EngineObjectAllocation *allocation,
+					  size_t index) {
+	struct ObjectCullData *cull = &obj_grp->cull_data[allocation->transform_base + index];
+	memset(cull, 0, sizeof(*cull));
+	cull->batch = OBJECT_BATCH_NONE;
+}
+
+/*
+	Fills the cull data of an allocation's objects from 'start' and adds each to the draw batch of
+	its mesh's buffer, then lays every batch's commands out back to back. Meshes must be uploaded.
+*/
+bool objgrp_assignbatches(struct ObjectGroup *obj_grp, struct EngineObjectAllocation *allocation,
+						  size_t start) {
+	struct ObjectCullData *cull_data = obj_grp->cull_data + allocation->transform_base;
+	struct EngineObject *engine_object;
+	struct EngineMesh *mesh;
+	struct ObjectDrawBatch *batch;
+	uint32_t b;
+	size_t i;
+
+	for (i = start; i < allocation->objects_size; i++) {
+		engine_object = allocation->objects[i];
+		mesh = engine_object->render_data.mesh;
+
+		memset(&cull_data[i], 0, sizeof(cull_data[i]));
+		memcpy(cull_data[i].tint, engine_object->render_data.tint, sizeof(cull_data[i].tint));
+		cull_data[i].batch = OBJECT_BATCH_NONE;
+
+		b = objgrp_findbatch(obj_grp, engine_object->render_data.pltype, mesh);
+		if (b == OBJECT_BATCH_NONE) {
+			return false;
+		}
+		batch = &obj_grp->batches[b];
+
+		// Buffers are bound at offset 0, so byte offsets become element offsets
+		if (batch->indexed) {
+			cull_data[i].count = mesh->indices_size;
+			cull_data[i].first = mesh->index_offset / mesh_indexstride(mesh);
+			cull_data[i].vertex_offset = mesh->vertex_offset / sizeof(struct Vertex);
+		} else {
+			cull_data[i].count = mesh->vertices_size;
+			cull_data[i].first = mesh->vertex_offset / sizeof(struct Vertex);
+		}
+		cull_data[i].batch = b;
+		cull_data[i].batch_slot = batch->objects_size++;
+		cull_data[i].flags = OBJECT_CULL_LIVE;
+		batch->live_size++;
+	}
 
+	objgrp_layoutcommands(obj_grp);
 	return true;
 }
 
-void object_destroybuffers(struct EngineObject *engine_object) {
-	vkmemory_destroybuffer(&engine_object->owner->vulkan_data->vmemory,
-						   engine_object->render_data.vi_buffer);
-}
\ No newline at end of file
+// Lays every batch's indirect commands out back to back
+void objgrp_layoutcommands(struct ObjectGroup *obj_grp) {
+	uint32_t b;
+
+	obj_grp->commands_size = 0;
+	for (b = 0; b < obj_grp->batches_size; b++) {
+		obj_grp->batches[b].command_base = obj_grp->commands_size;
+		obj_grp->commands_size += obj_grp->batches[b].objects_size;
+	}
+}
+
+// Returns the batch drawing 'mesh' for 'pltype', creating it if needed, or OBJECT_BATCH_NONE
+uint32_t objgrp_findbatch(struct ObjectGroup *obj_grp, enum PipelineType pltype,
+						  struct EngineMesh *mesh) {
+	bool indexed = mesh->indices_size > 0;
+	struct ObjectDrawBatch *batch;
+	uint32_t b, unused = OBJECT_BATCH_NONE;
+
+	for (b = 0; b < obj_grp->batches_size; b++) {
+		batch = &obj_grp->batches[b];
+		if (batch->buffer == mesh->vi_buffer && batch->pltype == pltype &&
+			batch->indexed == indexed &&
+			(indexed == false || batch->index_type == mesh->index_type)) {
+			return b;
+		}
+		if (unused == OBJECT_BATCH_NONE && batch->buffer == NULL && batch->objects_size == 0) {
+			unused = b;
+		}
+	}
+
+	// A batch whose objects are all gone is taken over before the array grows
+	if (unused != OBJECT_BATCH_NONE) {
+		b = unused;
+	} else if (obj_grp->batches_size == obj_grp->batches_capacity) {
+		uint32_t capacity = obj_grp->batches_capacity * 2;
+		if (capacity < OBJGRP_BATCH_MIN_CAPACITY) {
+			capacity = OBJGRP_BATCH_MIN_CAPACITY;
+		}
+
+		struct ObjectDrawBatch *batches = realloc(obj_grp->batches, sizeof(*batches) * capacity);
+		if (batches == NULL) {
+			fprintf(stderr, "Failure to allocate object draw batches.\n");
+			return OBJECT_BATCH_NONE;
+		}
+
+		obj_grp->batches = batches;
+		obj_grp->batches_capacity = capacity;
+	}
+	if (b == obj_grp->batches_size) {
+		obj_grp->batches_size++;
+	}
+
+	batch = &obj_grp->batches[b];
+	memset(batch, 0, sizeof(*batch));
+	batch->pltype = pltype;
+	batch->buffer = mesh->vi_buffer;
+	batch->index_type = mesh->index_type;
+	batch->indexed = indexed;
+	vkmemory_retainbuffer(batch->buffer);
+
+	return b;
+}
+
+// Sets what static meshes keep on the CPU after upload, for objects queued from now on
+void objgrp_setretention(struct ObjectGroup *obj_grp, enum MeshRetention retention) {
+	obj_grp->retention = (retention == MESH_RETAIN_DEFAULT) ? MESH_RETAIN_KEEP : retention;
+}
+
+/*
+	Brings back the CPU geometry of a mesh that dropped it after upload, from its compressed copy
+	when it has one, otherwise by reading it back from the GPU. Uses the transfer queue, so it must
+	be called from the thread processing the queue.
+*/
+bool objgrp_restoremesh(struct ObjectGroup *obj_grp, struct Application *app,
+						struct EngineMesh *mesh) {
+	if (mesh->vertices != NULL || mesh->vertices_size == 0) {
+		return true;
+	}
+	if (mesh->compressed != NULL) {
+		return mesh_decompress(mesh);
+	}
+	if (mesh->vi_buffer == NULL) {
+		fprintf(stderr, "Mesh geometry was discarded before upload.\n");
+		return false;
+	}
+
+	VkDeviceSize vertex_bytes = mesh_vertexbytes(mesh);
+	VkDeviceSize index_bytes = mesh_indexstride(mesh) * mesh_indexcount(mesh);
+
+	struct VulkanBuffer *temp_buff;
+	bool ret = vkmemory_createbuffer(
+		obj_grp->memory_pool, vertex_bytes + index_bytes, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &temp_buff);
+	if (ret == false) {
+		fprintf(stderr, "Failure reading mesh back from GPU.\n");
+		return false;
+	}
+
+	// Vertices and indices land back to back, as mesh_restore expects
+	VkBufferCopy regions[2] = {0};
+	regions[0].srcOffset = mesh->vertex_offset;
+	regions[0].size = vertex_bytes;
+	regions[1].srcOffset = mesh->index_offset;
+	regions[1].dstOffset = vertex_bytes;
+	regions[1].size = index_bytes;
+
+	void *data;
+	ret = vulkan_copybufferregions(app, mesh->vi_buffer, temp_buff, regions,
+								   (index_bytes > 0) ? 2 : 1);
+	if (ret && vkmemory_mapbuffer(obj_grp->memory_pool, temp_buff, &data)) {
+		ret = mesh_restore(mesh, data);
+		vkmemory_unmapbuffer(obj_grp->memory_pool, temp_buff);
+	} else {
+		fprintf(stderr, "Failure reading mesh back from GPU.\n");
+		ret = false;
+	}
+
+	vkmemory_destroybuffer(obj_grp->memory_pool, temp_buff);
+	return ret;
+}
+
+// Replaces the planes a pipeline's objects are culled against, none keeps every object
+void objgrp_setview(struct ObjectGroup *obj_grp, enum PipelineType pltype, const float (*planes)[4],
+					uint32_t planes_size) {
+	if (planes_size > CULL_MAX_PLANES) {
+		planes_size = CULL_MAX_PLANES;
+	}
+	memcpy(obj_grp->views[pltype].planes, planes, sizeof(*planes) * planes_size);
+	obj_grp->views[pltype].planes_size = planes_size;
+
+	// Cull passes record the planes, so GPU-culled frames are stale too
+	atomic_fetch_add(&obj_grp->generation, 1);
+}
+
+/*
+	Rebuilds every allocation's visible list against its pipeline's view. Must run after transforms
+	are flushed so the bounds are current. Counts are added to 'visible' & 'culled'.
+*/
+void objgrp_cull(struct ObjectGroup *obj_grp, size_t *visible, size_t *culled) {
+	enum PipelineType pltype;
+	struct EnginePipeline *pipeline;
+	size_t c, live, visible_size;
+
+	for (pltype = NO_PIPELINE; pltype < NUM_PIPELINES; pltype++) {
+		pipeline = &obj_grp->pipelines[pltype];
+		for (c = 0; c < pipeline->chunks_size; c++) {
+			visible_size = cull_allocation(pipeline->chunks[c], &obj_grp->views[pltype], &live);
+			*visible += visible_size;
+			*culled += live - visible_size;
+		}
+	}
+}
+
+/*
+	Adds an object to the hierarchy array, must be called with the hierarchy lock held. Objects
+	already in the array are left where they are.
+*/
+bool objgrp_addhierarchy(struct ObjectGroup *obj_grp, struct EngineObject *engine_object) {
+	if (engine_object->hierarchy_index != OBJECT_HIERARCHY_NONE) {
+		return true;
+	}
+
+	if (obj_grp->hierarchy_size == obj_grp->hierarchy_capacity) {
+		size_t capacity = obj_grp->hierarchy_capacity * 2;
+		if (capacity < OBJGRP_HIERARCHY_MIN_CAPACITY) {
+			capacity = OBJGRP_HIERARCHY_MIN_CAPACITY;
+		}
+
+		struct EngineObject **hierarchy =
+			realloc(obj_grp->hierarchy, sizeof(*hierarchy) * capacity);
+		if (hierarchy == NULL) {
+			fprintf(stderr, "Failure to allocate object hierarchy.\n");
+			return false;
+		}
+		obj_grp->hierarchy = hierarchy;
+
+		bool *changed = realloc(obj_grp->hierarchy_changed, sizeof(*changed) * capacity);
+		if (changed == NULL) {
+			fprintf(stderr, "Failure to allocate object hierarchy.\n");
+			return false;
+		}
+		obj_grp->hierarchy_changed = changed;
+		obj_grp->hierarchy_capacity = capacity;
+	}
+
+	engine_object->hierarchy_index = obj_grp->hierarchy_size;
+	obj_grp->hierarchy[obj_grp->hierarchy_size++] = engine_object;
+	obj_grp->hierarchy_sorted = false;
+	return true;
+}
+
+/*
+	Takes an object out of the hierarchy array and detaches its children, which keep their
+	position & rotation as world values. Must be called with the hierarchy lock held.
+*/
+void objgrp_removehierarchy(struct ObjectGroup *obj_grp, struct EngineObject *engine_object) {
+	size_t i = engine_object->hierarchy_index;
+	if (i == OBJECT_HIERARCHY_NONE) {
+		return;
+	}
+
+	size_t j;
+	for (j = 0; j < obj_grp->hierarchy_size; j++) {
+		if (obj_grp->hierarchy[j]->parent == engine_object) {
+			obj_grp->hierarchy[j]->parent = NULL;
+			object_marktransformdirty(obj_grp->hierarchy[j]);
+		}
+	}
+
+	// Fill gap with last entry, order is restored by the next sort
+	obj_grp->hierarchy_size--;
+	obj_grp->hierarchy[i] = obj_grp->hierarchy[obj_grp->hierarchy_size];
+	obj_grp->hierarchy[i]->hierarchy_index = i;
+	engine_object->hierarchy_index = OBJECT_HIERARCHY_NONE;
+	engine_object->parent = NULL;
+	obj_grp->hierarchy_sorted = false;
+}
+
+/*
+	Orders the hierarchy array breadth-first with a stable counting sort on depth, so every parent
+	is placed before its children. Must be called with the hierarchy lock held.
+*/
+bool objgrp_sorthierarchy(struct ObjectGroup *obj_grp) {
+	struct EngineObject *curr;
+	uint32_t max_depth = 0;
+	size_t i;
+
+	// Depth is the length of the parent chain
+	for (i = 0; i < obj_grp->hierarchy_size; i++) {
+		curr = obj_grp->hierarchy[i];
+		curr->depth = 0;
+		while (curr->parent != NULL) {
+			curr = curr->parent;
+			obj_grp->hierarchy[i]->depth++;
+		}
+		if (obj_grp->hierarchy[i]->depth > max_depth) {
+			max_depth = obj_grp->hierarchy[i]->depth;
+		}
+	}
+
+	size_t *offsets = calloc(max_depth + 2, sizeof(*offsets));
+	struct EngineObject **sorted = malloc(sizeof(*sorted) * obj_grp->hierarchy_capacity);
+	if (offsets == NULL || sorted == NULL) {
+		fprintf(stderr, "Failure to sort object hierarchy.\n");
+		free(offsets);
+		free(sorted);
+		return false;
+	}
+
+	// Count each depth, then turn counts into starting offsets
+	for (i = 0; i < obj_grp->hierarchy_size; i++) {
+		offsets[obj_grp->hierarchy[i]->depth + 1]++;
+	}
+	for (i = 1; i <= max_depth + 1; i++) {
+		offsets[i] += offsets[i - 1];
+	}
+
+	for (i = 0; i < obj_grp->hierarchy_size; i++) {
+		curr = obj_grp->hierarchy[i];
+		curr->hierarchy_index = offsets[curr->depth]++;
+		sorted[curr->hierarchy_index] = curr;
+	}
+
+	free(obj_grp->hierarchy);
+	free(offsets);
+	obj_grp->hierarchy = sorted;
+	obj_grp->hierarchy_sorted = true;
+	return true;
+}
+
+/*
+	Rebuilds world transforms of hierarchy members whose local transform or any ancestor's changed
+	since the last flush, clearing their dirty flags. Nothing is done while no member has moved.
+*/
+bool objgrp_updatehierarchy(struct ObjectGroup *obj_grp) {
+	if (atomic_exchange(&obj_grp->hierarchy_dirty, false) == false) {
+		return true;
+	}
+
+	pthread_mutex_lock(&obj_grp->hierarchy_lock);
+
+	if (obj_grp->hierarchy_sorted == false && objgrp_sorthierarchy(obj_grp) == false) {
+		atomic_store(&obj_grp->hierarchy_dirty, true);
+		pthread_mutex_unlock(&obj_grp->hierarchy_lock);
+		return false;
+	}
+
+	// Parents come first, so their change state is known before their children are visited
+	struct EngineObject *curr;
+	uint32_t flags;
+	bool changed;
+	size_t i;
+	for (i = 0; i < obj_grp->hierarchy_size; i++) {
+		curr = obj_grp->hierarchy[i];
+		flags = object_getflags(curr);
+		changed = (flags & OBJECT_FLAG_DIRTY) != 0;
+		if (curr->parent != NULL && obj_grp->hierarchy_changed[curr->parent->hierarchy_index]) {
+			changed = true;
+		}
+		obj_grp->hierarchy_changed[i] = changed;
+
+		if (changed) {
+			object_setflags(curr, flags & ~(uint32_t)OBJECT_FLAG_DIRTY);
+			object_buildworld(curr, obj_grp);
+		}
+	}
+
+	pthread_mutex_unlock(&obj_grp->hierarchy_lock);
+	return true;
+}
+
+/*
+	Destroys the objects queued by their last object_release. Must be called from the thread owning
+	the object group.
+*/
+void objgrp_destroyretired(struct ObjectGroup *obj_grp) {
+	pthread_mutex_lock(&obj_grp->retired_lock);
+	struct EngineObject **retired = obj_grp->retired;
+	size_t i, retired_size = obj_grp->retired_size;
+	obj_grp->retired = NULL;
+	obj_grp->retired_size = obj_grp->retired_capacity = 0;
+	pthread_mutex_unlock(&obj_grp->retired_lock);
+
+	for (i = 0; i < retired_size; i++) {
+		object_destroy(retired[i]);
+	}
+	free(retired);
+}
+
+bool objgrp_destroy(struct ObjectGroup *objgrp) {
+	enum PipelineType pltype;
+
+	for (pltype = NO_PIPELINE; pltype < NUM_PIPELINES; pltype++) {
+		struct EnginePipeline *pipeline = &objgrp->pipelines[pltype];
+		struct EngineObjectAllocation *curr;
+		size_t c, i;
+		for (c = 0; c < pipeline->chunks_allocated; c++) {
+			curr = pipeline->chunks[c];
+
+			// Objects already released elsewhere are skipped by object_destroy
+			for (i = 0; i < curr->objects_size; i++) {
+				object_destroy(curr->objects[i]);
+			}
+
+			objalloc_destroy(curr);
+			pool_free(&objgrp->allocation_pool, curr);
+		}
+
+		free(pipeline->chunks);
+		pipeline->chunks = NULL;
+		pipeline->chunks_size = pipeline->chunks_allocated = pipeline->chunks_capacity = 0;
+		pipeline->objects_size = 0;
+
+		free(objgrp->queue[pltype]);
+		objgrp->queue[pltype] = NULL;
+		objgrp->queue_size[pltype] = 0;
+		objgrp->queue_capacity[pltype] = 0;
+	}
+
+	// Drop pending updates before the meshes they reference
+	size_t i;
+	for (i = 0; i < objgrp->dirty_size; i++) {
+		mesh_release(objgrp->memory_pool, objgrp->dirty_meshes[i]);
+	}
+	free(objgrp->dirty_meshes);
+	objgrp->dirty_meshes = NULL;
+	objgrp->dirty_size = objgrp->dirty_capacity = 0;
+	pthread_mutex_destroy(&objgrp->dirty_lock);
+
+	free(objgrp->hierarchy);
+	free(objgrp->hierarchy_changed);
+	objgrp->hierarchy = NULL;
+	objgrp->hierarchy_changed = NULL;
+	objgrp->hierarchy_size = objgrp->hierarchy_capacity = 0;
+	pthread_mutex_destroy(&objgrp->hierarchy_lock);
+
+	// Queued objects were destroyed with their chunks above
+	free(objgrp->retired);
+	objgrp->retired = NULL;
+	objgrp->retired_size = objgrp->retired_capacity = 0;
+	pthread_mutex_destroy(&objgrp->retired_lock);
+
+	free(objgrp->transforms);
+	free(objgrp->cull_data);
+	objgrp->transforms = NULL;
+	objgrp->cull_data = NULL;
+	objgrp->transforms_size = objgrp->transforms_capacity = 0;
+
+	// Batches whose objects are all gone already dropped their buffer
+	uint32_t b;
+	for (b = 0; b < objgrp->batches_size; b++) {
+		if (objgrp->batches[b].buffer != NULL) {
+			vkmemory_releasebuffer(objgrp->memory_pool, objgrp->batches[b].buffer);
+		}
+	}
+	free(objgrp->batches);
+	objgrp->batches = NULL;
+	objgrp->batches_size = objgrp->batches_capacity = objgrp->commands_size = 0;
+
+	// Objects left their trees when destroyed
+	for (pltype = NO_PIPELINE; pltype < NUM_PIPELINES; pltype++) {
+		spatial_destroy(&objgrp->spatial[pltype]);
+	}
+
+	// Every object has released its mesh, so this only frees leftovers. Blocks still holding
+	// meshes are freed by the last release
+	meshreg_destroy(&objgrp->mesh_registry);
+	arena_destroy(&objgrp->mesh_arena);
+	arena_destroy(&objgrp->scratch);
+	pool_destroy(&objgrp->allocation_pool);
+	pool_destroy(&objgrp->object_pool);
+	hashtable_destroy(objgrp->object_table);
+	return true;
+}
+
+/*
+	Thread pool jobs for objgrp_processqueue. Each slice only touches its own range of objects and
+	its own ObjectGroupSlice, so the result is identical however the queue is split.
+*/
+void objgrp_buildslice(void *ctx, size_t start, size_t end, uint32_t slice) {
+	struct ObjectGroupJob *job = ctx;
+	size_t i, position;
+
+	for (i = start; i < end; i++) {
+		// Create object in the handle already placed at its chunk slot
+		position = job->first + i;
+		if (object_init(objgrp_chunkat(job->pipeline, position),
+						position % OBJECT_CHUNK_CAPACITY, job->app, &job->infos[i],
+						job->mesh_storage + job->mesh_offsets[i]) == false) {
+			job->slices[slice].failed = true;
+			return;
+		}
+	}
+}
+
+void objgrp_lodslice(void *ctx, size_t start, size_t end, uint32_t slice) {
+	struct ObjectGroupJob *job = ctx;
+	size_t i;
+
+	for (i = start; i < end; i++) {
+		if (mesh_buildlods(job->meshes[i]) == false) {
+			job->slices[slice].failed = true;
+			return;
+		}
+	}
+}
+
+void objgrp_sizeslice(void *ctx, size_t start, size_t end, uint32_t slice) {
+	struct ObjectGroupJob *job = ctx;
+	size_t i;
+
+	for (i = start; i < end; i++) {
+		job->slices[slice].vertex_bytes += mesh_vertexbytes(job->meshes[i]);
+		job->slices[slice].index_bytes += mesh_indexbytes(job->meshes[i]);
+	}
+}
+
+void objgrp_stageslice(void *ctx, size_t start, size_t end, uint32_t slice) {
+	struct ObjectGroupJob *job = ctx;
+	VkDeviceSize v_offset = job->slices[slice].vertex_base, v_size;
+	VkDeviceSize i_offset = job->slices[slice].index_base;
+	struct EngineMesh *mesh;
+	size_t i;
+
+	for (i = start; i < end; i++) {
+		mesh = job->meshes[i];
+		mesh->vi_buffer = job->buffer;
+		mesh->vertex_offset = v_offset;
+		mesh->index_offset = i_offset;
+		vkmemory_retainbuffer(job->buffer);
+
+		v_size = mesh_vertexbytes(mesh);
+		memcpy((char *)job->staging + v_offset, mesh->vertices, v_size);
+		v_offset += v_size;
+
+		if (mesh->indices_size > 0) {
+			memcpy((char *)job->staging + i_offset, mesh->indices,
+				   mesh_indexstride(mesh) * mesh_indexcount(mesh));
+			i_offset += mesh_indexbytes(mesh);
+		}
+	}
+}
+
+/*          Allocation storage functions         */
+
+// Prepares an empty chunk with room for OBJECT_CHUNK_CAPACITY objects
+bool objalloc_init(struct EngineObjectAllocation *allocation) {
+	allocation->objects_size = 0;
+
+	// One block holds the handle pointers and every stream, each starting on an aligned boundary
+	size_t padded = objalloc_paddedsize(OBJECT_CHUNK_CAPACITY);
+	size_t objects_bytes = arena_alignsize(sizeof(*allocation->objects) * OBJECT_CHUNK_CAPACITY);
+	size_t block_size = objects_bytes +
+						padded * (sizeof(float) * 12 + sizeof(uint32_t) * 2) + OBJECT_SOA_ALIGNMENT;
+
+	allocation->soa_block = calloc(1, block_size);
+	if (allocation->soa_block == NULL) {
+		fprintf(stderr, "Failure to allocate objects.\n");
+		allocation->objects = NULL;
+		return false;
+	}
+
+	uintptr_t base = ((uintptr_t)allocation->soa_block + OBJECT_SOA_ALIGNMENT - 1) &
+					 ~(uintptr_t)(OBJECT_SOA_ALIGNMENT - 1);
+	allocation->objects = (struct EngineObject **)base;
+	base += objects_bytes;
+	int i;
+	for (i = 0; i < 3; i++) {
+		allocation->pos[i] = (float *)base + padded * i;
+		allocation->rot[i] = (float *)base + padded * (i + 3);
+		allocation->bounds_min[i] = (float *)base + padded * (i + 6);
+		allocation->bounds_max[i] = (float *)base + padded * (i + 9);
+	}
+	allocation->flags = (uint32_t *)((float *)base + padded * 12);
+	allocation->visible = allocation->flags + padded;
+	allocation->visible_size = 0;
+
+	atomic_init(&allocation->transforms_dirty, false);
+	return true;
+}
+
+void objalloc_destroy(struct EngineObjectAllocation *allocation) {
+	allocation->objects = NULL;
+	free(allocation->soa_block);
+	allocation->soa_block = NULL;
+	allocation->objects_size = 0;
+}
+
+/*
+	Converts position and rotation streams into transform buffer entries at the allocation's slots
+	in the group's transforms, from object 'first' on. Only objects with OBJECT_FLAG_DIRTY are
+	written unless 'all' is set, and their flag is cleared. Consecutive dirty objects are converted
+	as one batch by the transform kernel, then their bounds are refreshed.
+*/
+void objalloc_writetransforms(struct EngineObjectAllocation *allocation, enum PipelineType pltype,
+							  struct ObjectGroup *obj_grp, size_t first, bool all) {
+	const float *const *pos = (const float *const *)allocation->pos;
+	const float *const *rot = (const float *const *)allocation->rot;
+	union ObjectTransform *out = obj_grp->transforms + allocation->transform_base;
+	size_t i = first, start;
+
+	while (i < allocation->objects_size) {
+		// Find the next run of objects to convert
+		if (all == false && (allocation->flags[i] & OBJECT_FLAG_DIRTY) == 0) {
+			i++;
+			continue;
+		}
+		for (start = i; i < allocation->objects_size; i++) {
+			if (all == false && (allocation->flags[i] & OBJECT_FLAG_DIRTY) == 0) {
+				break;
+			}
+			allocation->flags[i] &= ~(uint32_t)OBJECT_FLAG_DIRTY;
+		}
+
+		if (pltype == PIPELINE_3D) {
+			transform_build3d(pos, rot, start, i - start, out + start);
+		} else {
+			transform_build2d(pos, rot, start, i - start, out + start);
+		}
+		objalloc_writebounds(allocation, pltype, obj_grp, start, i - start);
+	}
+}
+
+/*
+	Transforms each object's mesh bounds by its world transform into the allocation's bounds
+	streams and cull data, and inserts or moves the object in the pipeline's spatial tree. Retired
+	objects are dropped from their draw batch, whose buffer is released with its last object.
+*/
+void objalloc_writebounds(struct EngineObjectAllocation *allocation, enum PipelineType pltype,
+						  struct ObjectGroup *obj_grp, size_t start, size_t count) {
+	union ObjectTransform *transforms = obj_grp->transforms;
+	struct SpatialTree *tree = &obj_grp->spatial[pltype];
+	struct ObjectCullData *cull;
+	struct ObjectDrawBatch *batch;
+	struct SpatialBounds bounds;
+	struct EngineObject *engine_object;
+	struct EngineMesh *mesh;
+	const float *m;
+	float center[3], extent[3];
+	size_t i;
+	int j;
+	bool statics = false, dynamics = false;
+
+	for (i = start; i < start + count; i++) {
+		// Moved and retired objects change what CPU-culled frames record
+		if (allocation->flags[i] & OBJECT_FLAG_STATIC) {
+			statics = true;
+		} else {
+			dynamics = true;
+		}
+
+		engine_object = allocation->objects[i];
+		mesh = engine_object->render_data.mesh;
+		cull = &obj_grp->cull_data[allocation->transform_base + i];
+
+		if (allocation->flags[i] & OBJECT_FLAG_RETIRED) {
+			if ((cull->flags & OBJECT_CULL_LIVE) && cull->batch != OBJECT_BATCH_NONE) {
+				batch = &obj_grp->batches[cull->batch];
+				if (--batch->live_size == 0) {
+					vkmemory_releasebuffer(obj_grp->memory_pool, batch->buffer);
+					batch->buffer = NULL;
+					atomic_fetch_add(&obj_grp->generation, 1);
+				}
+			}
+			cull->flags &= ~OBJECT_CULL_LIVE;
+			continue;
+		}
+		if (mesh == NULL) {
+			continue;
+		}
+
+		for (j = 0; j < 3; j++) {
+			center[j] = (mesh->bounds_min[j] + mesh->bounds_max[j]) * 0.5f;
+			extent[j] = (mesh->bounds_max[j] - mesh->bounds_min[j]) * 0.5f;
+		}
+
+		// Center moves with the transform, extents grow by the absolute rotation
+		if (pltype == PIPELINE_3D) {
+			m = transforms[allocation->transform_base + i].model;
+			for (j = 0; j < 3; j++) {
+				float c =
+					m[j] * center[0] + m[4 + j] * center[1] + m[8 + j] * center[2] + m[12 + j];
+				float e = fabsf(m[j]) * extent[0] + fabsf(m[4 + j]) * extent[1] +
+						  fabsf(m[8 + j]) * extent[2];
+				bounds.min[j] = c - e;
+				bounds.max[j] = c + e;
+			}
+		} else {
+			const float(*a)[4] = transforms[allocation->transform_base + i].t2d.affine;
+			for (j = 0; j < 2; j++) {
+				float c = a[j][0] * center[0] + a[j][1] * center[1] + a[j][2];
+				float e = fabsf(a[j][0]) * extent[0] + fabsf(a[j][1]) * extent[1];
+				bounds.min[j] = c - e;
+				bounds.max[j] = c + e;
+			}
+			bounds.min[2] = bounds.max[2] = 0.0f;
+		}
+
+		for (j = 0; j < 3; j++) {
+			allocation->bounds_min[j][i] = cull->bounds_min[j] = bounds.min[j];
+			allocation->bounds_max[j][i] = cull->bounds_max[j] = bounds.max[j];
+		}
+
+		if (engine_object->spatial_proxy == SPATIAL_NULL) {
+			engine_object->spatial_proxy = spatial_insert(tree, &bounds, engine_object);
+		} else {
+			spatial_move(tree, engine_object->spatial_proxy, &bounds);
+		}
+	}
+
+	if (statics) {
+		atomic_fetch_add(&obj_grp->static_generation, 1);
+	}
+	if (dynamics) {
+		atomic_fetch_add(&obj_grp->draw_generation, 1);
+	}
+}
+
+// Rounds a stream length up to a whole number of aligned vectors
+size_t objalloc_paddedsize(size_t objects_size) {
+	size_t per_vector = OBJECT_SOA_ALIGNMENT / sizeof(float);
+	return (objects_size + per_vector - 1) / per_vector * per_vector;
+}
+
+/*          Render object functions         */
+
+/*
+	'mesh_storage' must hold mesh_storagesize bytes for the create info's geometry and outlive the
+	object's private mesh, which the object group replaces with a stored copy.
+*/
+bool object_init(struct EngineObjectAllocation *allocation, size_t index, struct Application *app,
+				 struct EngineObjectCreateInfo *eo_create_info, void *mesh_storage) {
+	struct EngineObject *engine_object = allocation->objects[index];
+
+	// Clear data
+	memset(engine_object, 0, sizeof(*engine_object));
+	engine_object->allocation = allocation;
+	engine_object->index = index;
+	engine_object->hierarchy_index = OBJECT_HIERARCHY_NONE;
+
+	// Set render data
+	engine_object->render_data.pltype = eo_create_info->pltype;
+
+	// Private mesh until the object group swaps it for a registered one
+	engine_object->render_data.mesh =
+		mesh_create(mesh_storage, eo_create_info->vertices, eo_create_info->vertices_size,
+					eo_create_info->indices, eo_create_info->indices_size);
+	if (engine_object->render_data.mesh == NULL) {
+		return false;
+	}
+
+	// Set default struct data
+	engine_object->render_data.tint[0] = engine_object->render_data.tint[1] = 1.0f;
+	engine_object->render_data.tint[2] = engine_object->render_data.tint[3] = 1.0f;
+	engine_object->owner = app;
+	object_setposition(engine_object, eo_create_info->pos);
+	object_setrotation(engine_object, eo_create_info->rot);
+	object_setflags(engine_object, eo_create_info->is_static ? OBJECT_FLAG_STATIC : 0);
+	atomic_init(&engine_object->retain_count, 1);
+	memcpy(engine_object->name, eo_create_info->name, sizeof(engine_object->name));
+	engine_object->name[sizeof(engine_object->name) - 1] = '\0';
+	return true;
+}
+
+bool object_retain(struct EngineObject *engine_object) {
+	atomic_fetch_add(&engine_object->retain_count, 1);
+	return true;
+}
+
+/*
+	Safe from any thread. The last release only queues the object, the next flush destroys it on
+	the owning thread, so it may still be drawn until then.
+*/
+bool object_release(struct EngineObject *engine_object) {
+	if (atomic_fetch_sub(&engine_object->retain_count, 1) != 1) {
+		return true;
+	}
+
+	struct ObjectGroup *obj_grp = engine_object->owner->object_group;
+	pthread_mutex_lock(&obj_grp->retired_lock);
+	if (obj_grp->retired_size == obj_grp->retired_capacity) {
+		size_t capacity = obj_grp->retired_capacity > 0 ? obj_grp->retired_capacity * 2 : 16;
+		struct EngineObject **retired =
+			realloc(obj_grp->retired, sizeof(*obj_grp->retired) * capacity);
+		if (retired == NULL) {
+			// The object stays alive until the group is destroyed
+			fprintf(stderr, "Failure to allocate retired objects.\n");
+			pthread_mutex_unlock(&obj_grp->retired_lock);
+			return false;
+		}
+		obj_grp->retired = retired;
+		obj_grp->retired_capacity = capacity;
+	}
+	obj_grp->retired[obj_grp->retired_size++] = engine_object;
+	pthread_mutex_unlock(&obj_grp->retired_lock);
+	return true;
+}
+
+// Must be called from the thread owning the object group, other threads go through object_release
+bool object_destroy(struct EngineObject *engine_object) {
+	// Retired objects keep their slot but own nothing
+	uint32_t flags = object_getflags(engine_object);
+	if (flags & OBJECT_FLAG_RETIRED) {
+		return true;
+	}
+	// Dirty so the next flush drops the object from its draw batch
+	object_setflags(engine_object, flags | OBJECT_FLAG_RETIRED | OBJECT_FLAG_DIRTY);
+	atomic_store(&engine_object->allocation->transforms_dirty, true);
+
+	// Leave the scene graph, children are detached
+	if (engine_object->hierarchy_index != OBJECT_HIERARCHY_NONE) {
+		struct ObjectGroup *obj_grp = engine_object->owner->object_group;
+		pthread_mutex_lock(&obj_grp->hierarchy_lock);
+		objgrp_removehierarchy(obj_grp, engine_object);
+		pthread_mutex_unlock(&obj_grp->hierarchy_lock);
+	}
+
+	// Parented objects keep their leaf through the hierarchy removal above, so it is dropped here
+	if (engine_object->spatial_proxy != SPATIAL_NULL) {
+		struct ObjectGroup *obj_grp = engine_object->owner->object_group;
+		spatial_remove(&obj_grp->spatial[engine_object->render_data.pltype],
+					   engine_object->spatial_proxy);
+		engine_object->spatial_proxy = SPATIAL_NULL;
+	}
+
+	object_destroybuffers(engine_object);
+
+	return true;
+}
+
+/*
+	Replaces 'count' vertices starting at 'first' and queues the changed range for the next flush.
+	Static objects share their mesh with every object of the same geometry and cannot be updated.
+*/
+bool object_updatevertices(struct EngineObject *engine_object, size_t first,
+						   struct Vertex *vertices, size_t count) {
+	struct EngineMesh *mesh = engine_object->render_data.mesh;
+	if (mesh == NULL || first > mesh->vertices_size || count > mesh->vertices_size - first) {
+		fprintf(stderr, "Object vertex update out of range.\n");
+		return false;
+	}
+	if (object_getflags(engine_object) & OBJECT_FLAG_STATIC) {
+		fprintf(stderr, "Static object meshes are shared and cannot be updated.\n");
+		return false;
+	}
+	if (count == 0) {
+		return true;
+	}
+
+	struct ObjectGroup *obj_grp = engine_object->owner->object_group;
+	pthread_mutex_lock(&obj_grp->dirty_lock);
+
+	// Queue mesh with a reference so it outlives the object until flushed
+	if (mesh->dirty == false) {
+		if (obj_grp->dirty_size == obj_grp->dirty_capacity) {
+			size_t capacity = obj_grp->dirty_capacity * 2;
+			if (capacity < OBJGRP_QUEUE_MIN_CAPACITY) {
+				capacity = OBJGRP_QUEUE_MIN_CAPACITY;
+			}
+
+			struct EngineMesh **dirty_meshes =
+				realloc(obj_grp->dirty_meshes, sizeof(*dirty_meshes) * capacity);
+			if (dirty_meshes == NULL) {
+				fprintf(stderr, "Failure to allocate object group updates.\n");
+				pthread_mutex_unlock(&obj_grp->dirty_lock);
+				return false;
+			}
+
+			obj_grp->dirty_meshes = dirty_meshes;
+			obj_grp->dirty_capacity = capacity;
+		}
+
+		mesh_retain(mesh);
+		obj_grp->dirty_meshes[obj_grp->dirty_size++] = mesh;
+	}
+
+	memcpy(mesh->vertices + first, vertices, sizeof(*vertices) * count);
+	mesh_markdirty(mesh, sizeof(*vertices) * first, sizeof(*vertices) * (first + count));
+
+	// Bounds only grow, rebuilding the transform refreshes the object's world bounds
+	bool grown = mesh_growbounds(mesh, vertices, count);
+
+	pthread_mutex_unlock(&obj_grp->dirty_lock);
+
+	if (grown) {
+		object_marktransformdirty(engine_object);
+	}
+	return true;
+}
+
+/*
+	Attaches 'engine_object' to 'parent', or detaches it when 'parent' is NULL. Its position &
+	rotation become relative to the parent, which must use the same pipeline. World transforms are
+	rebuilt on the next flush.
+*/
+bool object_setparent(struct EngineObject *engine_object, struct EngineObject *parent) {
+	struct ObjectGroup *obj_grp = engine_object->owner->object_group;
+
+	if (parent != NULL) {
+		if (parent->owner != engine_object->owner ||
+			parent->render_data.pltype != engine_object->render_data.pltype) {
+			fprintf(stderr, "Object parent must share the object's group and pipeline.\n");
+			return false;
+		}
+		if ((object_getflags(parent) | object_getflags(engine_object)) & OBJECT_FLAG_RETIRED) {
+			fprintf(stderr, "Cannot parent destroyed objects.\n");
+			return false;
+		}
+	}
+
+	pthread_mutex_lock(&obj_grp->hierarchy_lock);
+
+	// Refuse links that would make the object its own ancestor
+	struct EngineObject *curr;
+	for (curr = parent; curr != NULL; curr = curr->parent) {
+		if (curr == engine_object) {
+			fprintf(stderr, "Object parent would create a cycle.\n");
+			pthread_mutex_unlock(&obj_grp->hierarchy_lock);
+			return false;
+		}
+	}
+
+	if (objgrp_addhierarchy(obj_grp, engine_object) == false ||
+		(parent != NULL && objgrp_addhierarchy(obj_grp, parent) == false)) {
+		pthread_mutex_unlock(&obj_grp->hierarchy_lock);
+		return false;
+	}
+
+	engine_object->parent = parent;
+	obj_grp->hierarchy_sorted = false;
+	pthread_mutex_unlock(&obj_grp->hierarchy_lock);
+
+	object_marktransformdirty(engine_object);
+	return true;
+}
+
+struct EngineObject *object_getparent(struct EngineObject *engine_object) {
+	return engine_object->parent;
+}
+
+/*
+	Writes the object's world transform to its slot in the group's transforms, composing its local
+	transform with the parent's slot, which must already hold the parent's world transform.
+*/
+void object_buildworld(struct EngineObject *engine_object, struct ObjectGroup *obj_grp) {
+	struct EngineObjectAllocation *allocation = engine_object->allocation;
+	union ObjectTransform *transforms = obj_grp->transforms;
+	const float *const *pos = (const float *const *)allocation->pos;
+	const float *const *rot = (const float *const *)allocation->rot;
+	union ObjectTransform *out = &transforms[allocation->transform_base + engine_object->index];
+	union ObjectTransform local;
+	bool is_3d = engine_object->render_data.pltype == PIPELINE_3D;
+
+	if (engine_object->parent == NULL) {
+		if (is_3d) {
+			transform_build3d(pos, rot, engine_object->index, 1, out);
+		} else {
+			transform_build2d(pos, rot, engine_object->index, 1, out);
+		}
+	} else {
+		struct EngineObjectAllocation *parent_alloc = engine_object->parent->allocation;
+		union ObjectTransform *parent_world =
+			&transforms[parent_alloc->transform_base + engine_object->parent->index];
+		if (is_3d) {
+			transform_build3d(pos, rot, engine_object->index, 1, &local);
+			transform_compose3d(parent_world, &local, out);
+		} else {
+			transform_build2d(pos, rot, engine_object->index, 1, &local);
+			transform_compose2d(parent_world, &local, out);
+		}
+	}
+
+	objalloc_writebounds(allocation, engine_object->render_data.pltype, obj_grp,
+						 engine_object->index, 1);
+}
+
+// Drops the object's mesh reference, the mesh and its buffer go once no object uses them
+void object_destroybuffers(struct EngineObject *engine_object) {
+	if (engine_object->render_data.mesh == NULL) {
+		return;
+	}
+
+	mesh_release(&engine_object->owner->vulkan_data->vmemory, engine_object->render_data.mesh);
+	engine_object->render_data.mesh = NULL;
+}
+
+/*          Object transform accessors         */
+
+void object_getposition(struct EngineObject *engine_object, float pos[3]) {
+	int i;
+	for (i = 0; i < 3; i++) {
+		pos[i] = engine_object->allocation->pos[i][engine_object->index];
+	}
+}
+
+void object_setposition(struct EngineObject *engine_object, const float pos[3]) {
+	int i;
+	for (i = 0; i < 3; i++) {
+		engine_object->allocation->pos[i][engine_object->index] = pos[i];
+	}
+	object_marktransformdirty(engine_object);
+}
+
+void object_getrotation(struct EngineObject *engine_object, float rot[3]) {
+	int i;
+	for (i = 0; i < 3; i++) {
+		rot[i] = engine_object->allocation->rot[i][engine_object->index];
+	}
+}
+
+void object_setrotation(struct EngineObject *engine_object, const float rot[3]) {
+	int i;
+	for (i = 0; i < 3; i++) {
+		engine_object->allocation->rot[i][engine_object->index] = rot[i];
+	}
+	object_marktransformdirty(engine_object);
+}
+
+// Indirect draws read the tint from the cull data, which the object has once queued
+void object_settint(struct EngineObject *engine_object, const float tint[4]) {
+	struct EngineObjectAllocation *allocation = engine_object->allocation;
+	struct ObjectGroup *obj_grp = engine_object->owner->object_group;
+
+	memcpy(engine_object->render_data.tint, tint, sizeof(engine_object->render_data.tint));
+	memcpy(obj_grp->cull_data[allocation->transform_base + engine_object->index].tint, tint,
+		   sizeof(engine_object->render_data.tint));
+	if (object_getflags(engine_object) & OBJECT_FLAG_STATIC) {
+		atomic_fetch_add(&obj_grp->static_generation, 1);
+	} else {
+		atomic_fetch_add(&obj_grp->draw_generation, 1);
+	}
+}
+
+uint32_t object_getflags(struct EngineObject *engine_object) {
+	return engine_object->allocation->flags[engine_object->index];
+}
+
+void object_setflags(struct EngineObject *engine_object, uint32_t flags) {
+	engine_object->allocation->flags[engine_object->index] = flags;
+}
+
+void object_marktransformdirty(struct EngineObject *engine_object) {
+	engine_object->allocation->flags[engine_object->index] |= OBJECT_FLAG_DIRTY;
+	atomic_store(&engine_object->allocation->transforms_dirty, true);
+	if (engine_object->hierarchy_index != OBJECT_HIERARCHY_NONE) {
+		atomic_store(&engine_object->owner->object_group->hierarchy_dirty, true);
+	}
+}
@@ -1,10 +1,15 @@
 #include "application.h"
+#include "engine_cull.h"
+#include "engine_mesh.h"
+#include "engine_transform.h"
 #include "engine_vertex.h"
 #include "engine_vulkan.h"
 #include "GLFW/glfw3.h"
 #include "object_struct.h"
+#include "threadpool.h"
 
 #include <assert.h>
+#include <math.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -14,20 +19,116 @@
 #ifndef ENGINE_OBJECT_H
 #define ENGINE_OBJECT_H
 
-#define OBJECT_HASHTABLE_SIZE 256
+#define OBJECT_HASHTABLE_SIZE 4096
+#define OBJGRP_QUEUE_MIN_CAPACITY 64
+#define OBJGRP_PARALLEL_THRESHOLD 4096
+#define OBJGRP_HIERARCHY_MIN_CAPACITY 64
+#define OBJGRP_BATCH_MIN_CAPACITY 16
+#define OBJGRP_ALLOCATIONS_PER_BLOCK 64
+#define OBJGRP_OBJECTS_PER_BLOCK 1024
+#define OBJGRP_CHUNK_MIN_CAPACITY 16
+
+// Per-slice results of a (possibly parallel) queue build
+struct ObjectGroupSlice {
+	VkDeviceSize vertex_bytes;
+	VkDeviceSize index_bytes;
+	VkDeviceSize vertex_base;
+	VkDeviceSize index_base;
+	bool failed;
+};
+
+struct ObjectGroupJob {
+	struct Application *app;
+
+	// Queued objects go to consecutive positions of the pipeline from 'first'
+	struct EnginePipeline *pipeline;
+	size_t first;
+	struct EngineObjectCreateInfo *infos;
+	struct ObjectGroupSlice *slices;
+
+	// Scratch memory each object's private mesh is built in, at 'mesh_offsets'
+	char *mesh_storage;
+	size_t *mesh_offsets;
+
+	// Meshes registered by this batch that still need uploading
+	struct EngineMesh **meshes;
+	struct VulkanBuffer *buffer;
+	void *staging;
+};
+
+// Changed range of a device-local buffer gathered by objgrp_flushupdates
+struct ObjectGroupUpdate {
+	struct VulkanBuffer *buffer;
+	VkDeviceSize offset;
+	VkDeviceSize size;
+	const void *data;
+};
 
 // Engine object group functions
 bool objgrp_init(struct ObjectGroup *, struct VulkanMemory *);
 bool objgrp_queue(struct ObjectGroup *, struct EngineObjectCreateInfo *);
+bool objgrp_queuebulk(struct ObjectGroup *, struct EngineObjectCreateInfo *, size_t);
 bool objgrp_processqueue(struct ObjectGroup *, struct Application *);
-bool objgrp_createallocationbuffers(struct ObjectGroup *, struct EngineObjectAllocation *);
+void objgrp_discardbatch(struct ObjectGroup *, struct EnginePipeline *, size_t, size_t, size_t,
+						 union HashTableValue *);
+bool objgrp_uploadmeshes(struct ObjectGroup *, struct Application *, struct ObjectGroupJob *,
+						 struct EngineMesh **, size_t, bool);
+void objgrp_setretention(struct ObjectGroup *, enum MeshRetention);
+bool objgrp_restoremesh(struct ObjectGroup *, struct Application *, struct EngineMesh *);
+bool objgrp_flushupdates(struct ObjectGroup *, struct Application *);
+bool objgrp_uploadupdates(struct Application *, struct ObjectGroupUpdate *, size_t, VkDeviceSize);
+int objgrp_compareupdates(const void *, const void *);
+bool objgrp_reservetransforms(struct ObjectGroup *, size_t);
+bool objgrp_reservechunks(struct ObjectGroup *, struct EnginePipeline *, size_t);
+void objgrp_compact(struct ObjectGroup *, struct EnginePipeline *);
+void objgrp_renumberbatches(struct ObjectGroup *, struct EnginePipeline *);
+void objgrp_moveobject(struct ObjectGroup *, struct EnginePipeline *, size_t, size_t);
+void objgrp_clearslot(struct ObjectGroup *, struct EngineObjectAllocation *, size_t);
+bool objgrp_assignbatches(struct ObjectGroup *, struct EngineObjectAllocation *, size_t);
+void objgrp_layoutcommands(struct ObjectGroup *);
+uint32_t objgrp_findbatch(struct ObjectGroup *, enum PipelineType, struct EngineMesh *);
+void objgrp_setview(struct ObjectGroup *, enum PipelineType, const float (*)[4], uint32_t);
+void objgrp_cull(struct ObjectGroup *, size_t *, size_t *);
+bool objgrp_addhierarchy(struct ObjectGroup *, struct EngineObject *);
+void objgrp_removehierarchy(struct ObjectGroup *, struct EngineObject *);
+bool objgrp_sorthierarchy(struct ObjectGroup *);
+bool objgrp_updatehierarchy(struct ObjectGroup *);
+void objgrp_destroyretired(struct ObjectGroup *);
 bool objgrp_destroy(struct ObjectGroup *);
+void objgrp_buildslice(void *, size_t, size_t, uint32_t);
+void objgrp_lodslice(void *, size_t, size_t, uint32_t);
+void objgrp_sizeslice(void *, size_t, size_t, uint32_t);
+void objgrp_stageslice(void *, size_t, size_t, uint32_t);
+
+// Allocation storage functions
+bool objalloc_init(struct EngineObjectAllocation *);
+void objalloc_destroy(struct EngineObjectAllocation *);
+void objalloc_writetransforms(struct EngineObjectAllocation *, enum PipelineType,
+							  struct ObjectGroup *, size_t, bool);
+void objalloc_writebounds(struct EngineObjectAllocation *, enum PipelineType, struct ObjectGroup *,
+						  size_t, size_t);
+size_t objalloc_paddedsize(size_t);
 
 // Object functions
-bool object_init(struct EngineObject *, struct Application *, struct EngineObjectCreateInfo *);
+bool object_init(struct EngineObjectAllocation *, size_t, struct Application *,
+				 struct EngineObjectCreateInfo *, void *);
 bool object_retain(struct EngineObject *);
 bool object_release(struct EngineObject *);
 bool object_destroy(struct EngineObject *);
 void object_destroybuffers(struct EngineObject *);
+bool object_updatevertices(struct EngineObject *, size_t, struct Vertex *, size_t);
+bool object_setparent(struct EngineObject *, struct EngineObject *);
+struct EngineObject *object_getparent(struct EngineObject *);
+void object_buildworld(struct EngineObject *, struct ObjectGroup *);
+
+// Object transform accessors
+void object_getposition(struct EngineObject *, float[3]);
+void object_setposition(struct EngineObject *, const float[3]);
+void object_getrotation(struct EngineObject *, float[3]);
+void object_setrotation(struct EngineObject *, const float[3]);
+void object_settint(struct EngineObject *, const float[4]);
+uint32_t object_getflags(struct EngineObject *);
+void object_setflags(struct EngineObject *, uint32_t);
+void object_marktransformdirty(struct EngineObject *);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,600 @@
+#include "engine_spatial.h"
+
+/*			Spatial tree functions		*/
+
+/**
+ * @brief Sets up an empty tree, nodes are allocated on first insertion
+ *
+ * @param tree SpatialTree to initialize
+ */
+void spatial_init(struct SpatialTree *tree) {
+	tree->nodes = NULL;
+	tree->nodes_capacity = 0;
+	tree->root = SPATIAL_NULL;
+	tree->free_list = SPATIAL_NULL;
+	tree->leaves_size = 0;
+	pthread_mutex_init(&tree->lock, NULL);
+}
+
+/**
+ * @brief Frees every node, leaf data is not touched
+ *
+ * @param tree SpatialTree to destroy
+ */
+void spatial_destroy(struct SpatialTree *tree) {
+	free(tree->nodes);
+	tree->nodes = NULL;
+	tree->nodes_capacity = 0;
+	tree->root = SPATIAL_NULL;
+	tree->free_list = SPATIAL_NULL;
+	tree->leaves_size = 0;
+	pthread_mutex_destroy(&tree->lock);
+}
+
+/**
+ * @brief Adds a leaf covering 'bounds'
+ *
+ * The stored box is enlarged by SPATIAL_MARGIN_RATIO so later moves inside it cost nothing
+ *
+ * @param tree SpatialTree to insert into
+ * @param bounds Tight bounds of the new leaf
+ * @param data User data given back by queries
+ * @return uint32_t Leaf handle for spatial_move & spatial_remove, SPATIAL_NULL on failure
+ */
+uint32_t spatial_insert(struct SpatialTree *tree, const struct SpatialBounds *bounds, void *data) {
+	pthread_mutex_lock(&tree->lock);
+
+	// Leaf and the internal node joining it to the tree
+	if (spatial_reserve(tree, 2) == false) {
+		pthread_mutex_unlock(&tree->lock);
+		return SPATIAL_NULL;
+	}
+
+	uint32_t leaf = spatial_allocnode(tree);
+	struct SpatialNode *node = &tree->nodes[leaf];
+	float extent = 0.0f;
+	int i;
+
+	for (i = 0; i < 3; i++) {
+		if (bounds->max[i] - bounds->min[i] > extent) {
+			extent = bounds->max[i] - bounds->min[i];
+		}
+	}
+	for (i = 0; i < 3; i++) {
+		node->bounds.min[i] = bounds->min[i] - extent * SPATIAL_MARGIN_RATIO;
+		node->bounds.max[i] = bounds->max[i] + extent * SPATIAL_MARGIN_RATIO;
+	}
+	node->data = data;
+
+	spatial_insertleaf(tree, leaf);
+	tree->leaves_size++;
+
+	pthread_mutex_unlock(&tree->lock);
+	return leaf;
+}
+
+/**
+ * @brief Removes a leaf returned by spatial_insert
+ *
+ * @param tree SpatialTree holding the leaf
+ * @param leaf Leaf handle
+ */
+void spatial_remove(struct SpatialTree *tree, uint32_t leaf) {
+	pthread_mutex_lock(&tree->lock);
+	spatial_removeleaf(tree, leaf);
+	spatial_freenode(tree, leaf);
+	tree->leaves_size--;
+	pthread_mutex_unlock(&tree->lock);
+}
+
+/**
+ * @brief Updates a leaf's bounds
+ *
+ * Nothing changes while the new bounds stay inside the enlarged box, otherwise the leaf is
+ * reinserted with a new enlarged box. The leaf keeps its handle either way
+ *
+ * @param tree SpatialTree holding the leaf
+ * @param leaf Leaf handle
+ * @param bounds New tight bounds
+ * @return true Leaf was reinserted
+ * @return false Leaf still fit its enlarged box
+ */
+bool spatial_move(struct SpatialTree *tree, uint32_t leaf, const struct SpatialBounds *bounds) {
+	pthread_mutex_lock(&tree->lock);
+
+	struct SpatialNode *node = &tree->nodes[leaf];
+	if (spatial_contains(&node->bounds, bounds)) {
+		pthread_mutex_unlock(&tree->lock);
+		return false;
+	}
+
+	// Removal frees the leaf's parent, which the reinsertion reuses
+	spatial_removeleaf(tree, leaf);
+
+	node = &tree->nodes[leaf];
+	float extent = 0.0f;
+	int i;
+	for (i = 0; i < 3; i++) {
+		if (bounds->max[i] - bounds->min[i] > extent) {
+			extent = bounds->max[i] - bounds->min[i];
+		}
+	}
+	for (i = 0; i < 3; i++) {
+		node->bounds.min[i] = bounds->min[i] - extent * SPATIAL_MARGIN_RATIO;
+		node->bounds.max[i] = bounds->max[i] + extent * SPATIAL_MARGIN_RATIO;
+	}
+
+	spatial_insertleaf(tree, leaf);
+
+	pthread_mutex_unlock(&tree->lock);
+	return true;
+}
+
+/**
+ * @brief Calls 'callback' for every leaf whose box overlaps 'bounds'
+ *
+ * A 2D viewport query is an AABB query with a zero z range. Leaf boxes are enlarged, so results
+ * may include objects just outside 'bounds'
+ *
+ * @param tree SpatialTree to query
+ * @param bounds Query box
+ * @param callback Called with 'ctx' and each leaf's data
+ * @param ctx User context
+ */
+void spatial_queryaabb(struct SpatialTree *tree, const struct SpatialBounds *bounds,
+					   SpatialQueryCallback callback, void *ctx) {
+	uint32_t stack[SPATIAL_STACK_SIZE];
+	uint32_t stack_size = 0;
+	struct SpatialNode *node;
+
+	pthread_mutex_lock(&tree->lock);
+
+	if (tree->root != SPATIAL_NULL) {
+		stack[stack_size++] = tree->root;
+	}
+
+	while (stack_size > 0) {
+		node = &tree->nodes[stack[--stack_size]];
+		if (spatial_overlaps(&node->bounds, bounds) == false) {
+			continue;
+		}
+
+		if (node->child[0] == SPATIAL_NULL) {
+			if (callback(ctx, node->data) == false) {
+				break;
+			}
+		} else {
+			stack[stack_size++] = node->child[0];
+			stack[stack_size++] = node->child[1];
+		}
+	}
+
+	pthread_mutex_unlock(&tree->lock);
+}
+
+/**
+ * @brief Calls 'callback' for every leaf whose box is not fully outside any plane
+ *
+ * Planes are (a, b, c, d) with the inside where ax + by + cz + d >= 0, and need not be normalized
+ *
+ * @param tree SpatialTree to query
+ * @param planes Frustum planes
+ * @param planes_size Number of planes, e.g. 6 for a camera frustum or 4 for a 2D viewport
+ * @param callback Called with 'ctx' and each leaf's data
+ * @param ctx User context
+ */
+void spatial_queryfrustum(struct SpatialTree *tree, const float (*planes)[4], size_t planes_size,
+						  SpatialQueryCallback callback, void *ctx) {
+	uint32_t stack[SPATIAL_STACK_SIZE];
+	uint32_t stack_size = 0;
+	struct SpatialNode *node;
+
+	pthread_mutex_lock(&tree->lock);
+
+	if (tree->root != SPATIAL_NULL) {
+		stack[stack_size++] = tree->root;
+	}
+
+	while (stack_size > 0) {
+		node = &tree->nodes[stack[--stack_size]];
+		if (spatial_infrustum(&node->bounds, planes, planes_size) == false) {
+			continue;
+		}
+
+		if (node->child[0] == SPATIAL_NULL) {
+			if (callback(ctx, node->data) == false) {
+				break;
+			}
+		} else {
+			stack[stack_size++] = node->child[0];
+			stack[stack_size++] = node->child[1];
+		}
+	}
+
+	pthread_mutex_unlock(&tree->lock);
+}
+
+/**
+ * @brief Calls 'callback' for every leaf box hit by the ray within 'max_distance'
+ *
+ * The callback returns the new maximum distance, so returning the hit distance keeps only closer
+ * hits, returning the current maximum keeps all hits and returning 0 ends the cast
+ *
+ * @param tree SpatialTree to query
+ * @param origin Ray start
+ * @param direction Ray direction, distances are in multiples of its length
+ * @param max_distance Farthest distance to test
+ * @param callback Called with 'ctx', each leaf's data and its hit distance
+ * @param ctx User context
+ */
+void spatial_raycast(struct SpatialTree *tree, const float origin[3], const float direction[3],
+					 float max_distance, SpatialRayCallback callback, void *ctx) {
+	uint32_t stack[SPATIAL_STACK_SIZE];
+	uint32_t stack_size = 0;
+	struct SpatialNode *node;
+	float distance;
+
+	pthread_mutex_lock(&tree->lock);
+
+	if (tree->root != SPATIAL_NULL) {
+		stack[stack_size++] = tree->root;
+	}
+
+	while (stack_size > 0 && max_distance > 0.0f) {
+		node = &tree->nodes[stack[--stack_size]];
+		if (spatial_intersectray(&node->bounds, origin, direction, max_distance, &distance) ==
+			false) {
+			continue;
+		}
+
+		if (node->child[0] == SPATIAL_NULL) {
+			max_distance = callback(ctx, node->data, distance);
+		} else {
+			stack[stack_size++] = node->child[0];
+			stack[stack_size++] = node->child[1];
+		}
+	}
+
+	pthread_mutex_unlock(&tree->lock);
+}
+
+/*			Tree maintenance functions		*/
+
+/**
+ * @brief Makes sure 'count' nodes can be allocated without failing
+ *
+ * @param tree SpatialTree to grow
+ * @param count Number of nodes needed
+ * @return true Nodes available
+ * @return false Allocation failed
+ */
+bool spatial_reserve(struct SpatialTree *tree, uint32_t count) {
+	uint32_t available = 0, curr = tree->free_list;
+	while (curr != SPATIAL_NULL && available < count) {
+		available++;
+		curr = tree->nodes[curr].parent;
+	}
+	if (available >= count) {
+		return true;
+	}
+
+	uint32_t capacity = tree->nodes_capacity * 2;
+	if (capacity < SPATIAL_MIN_CAPACITY) {
+		capacity = SPATIAL_MIN_CAPACITY;
+	}
+
+	struct SpatialNode *nodes = realloc(tree->nodes, sizeof(*nodes) * capacity);
+	if (nodes == NULL) {
+		fprintf(stderr, "Failure to allocate spatial tree nodes.\n");
+		return false;
+	}
+
+	// Chain new nodes in front of the free list
+	uint32_t i;
+	for (i = capacity; i > tree->nodes_capacity; i--) {
+		nodes[i - 1].parent = tree->free_list;
+		tree->free_list = i - 1;
+	}
+
+	tree->nodes = nodes;
+	tree->nodes_capacity = capacity;
+	return true;
+}
+
+// Takes a node from the free list, spatial_reserve must have been called
+uint32_t spatial_allocnode(struct SpatialTree *tree) {
+	uint32_t index = tree->free_list;
+	struct SpatialNode *node = &tree->nodes[index];
+
+	tree->free_list = node->parent;
+	node->parent = SPATIAL_NULL;
+	node->child[0] = node->child[1] = SPATIAL_NULL;
+	node->height = 0;
+	node->data = NULL;
+	return index;
+}
+
+void spatial_freenode(struct SpatialTree *tree, uint32_t index) {
+	tree->nodes[index].parent = tree->free_list;
+	tree->nodes[index].height = -1;
+	tree->free_list = index;
+}
+
+/**
+ * @brief Links a leaf next to the sibling that grows the tree's total cost the least
+ *
+ * Descends from the root comparing the cost of pairing with the current node against the cost
+ * of pushing the leaf further down, then rebalances the path back to the root. Needs one free
+ * node for the new parent
+ *
+ * @param tree SpatialTree to insert into
+ * @param leaf Leaf with its bounds set
+ */
+void spatial_insertleaf(struct SpatialTree *tree, uint32_t leaf) {
+	if (tree->root == SPATIAL_NULL) {
+		tree->root = leaf;
+		tree->nodes[leaf].parent = SPATIAL_NULL;
+		return;
+	}
+
+	struct SpatialBounds leaf_bounds = tree->nodes[leaf].bounds, combined;
+	uint32_t index = tree->root;
+
+	while (tree->nodes[index].child[0] != SPATIAL_NULL) {
+		struct SpatialNode *node = &tree->nodes[index];
+
+		spatial_union(&node->bounds, &leaf_bounds, &combined);
+		float cost = 2.0f * spatial_cost(&combined);
+
+		// Cost every ancestor pays for growing to include the leaf
+		float inherited = 2.0f * (spatial_cost(&combined) - spatial_cost(&node->bounds));
+
+		float child_cost[2];
+		int k;
+		for (k = 0; k < 2; k++) {
+			struct SpatialNode *child = &tree->nodes[node->child[k]];
+			spatial_union(&child->bounds, &leaf_bounds, &combined);
+			child_cost[k] = spatial_cost(&combined) + inherited;
+			if (child->child[0] != SPATIAL_NULL) {
+				child_cost[k] -= spatial_cost(&child->bounds);
+			}
+		}
+
+		if (cost < child_cost[0] && cost < child_cost[1]) {
+			break;
+		}
+		index = (child_cost[0] < child_cost[1]) ? node->child[0] : node->child[1];
+	}
+
+	// New parent takes the sibling's place
+	uint32_t sibling = index;
+	uint32_t old_parent = tree->nodes[sibling].parent;
+	uint32_t new_parent = spatial_allocnode(tree);
+
+	tree->nodes[new_parent].parent = old_parent;
+	spatial_union(&tree->nodes[sibling].bounds, &leaf_bounds, &tree->nodes[new_parent].bounds);
+	tree->nodes[new_parent].height = tree->nodes[sibling].height + 1;
+	tree->nodes[new_parent].child[0] = sibling;
+	tree->nodes[new_parent].child[1] = leaf;
+	tree->nodes[sibling].parent = new_parent;
+	tree->nodes[leaf].parent = new_parent;
+
+	if (old_parent == SPATIAL_NULL) {
+		tree->root = new_parent;
+	} else {
+		spatial_replacechild(tree, old_parent, sibling, new_parent);
+	}
+
+	spatial_refit(tree, new_parent);
+}
+
+/**
+ * @brief Unlinks a leaf, its sibling takes its parent's place and the parent node is freed
+ *
+ * @param tree SpatialTree holding the leaf
+ * @param leaf Leaf to unlink, its node stays allocated
+ */
+void spatial_removeleaf(struct SpatialTree *tree, uint32_t leaf) {
+	if (leaf == tree->root) {
+		tree->root = SPATIAL_NULL;
+		return;
+	}
+
+	uint32_t parent = tree->nodes[leaf].parent;
+	uint32_t grandparent = tree->nodes[parent].parent;
+	uint32_t sibling = (tree->nodes[parent].child[0] == leaf) ? tree->nodes[parent].child[1]
+															  : tree->nodes[parent].child[0];
+
+	tree->nodes[sibling].parent = grandparent;
+	tree->nodes[leaf].parent = SPATIAL_NULL;
+	spatial_freenode(tree, parent);
+
+	if (grandparent == SPATIAL_NULL) {
+		tree->root = sibling;
+		return;
+	}
+
+	spatial_replacechild(tree, grandparent, parent, sibling);
+	spatial_refit(tree, grandparent);
+}
+
+/**
+ * @brief Rotates the taller grandchild above 'index' when its children differ in height by more
+ * than one
+ *
+ * @param tree SpatialTree to balance
+ * @param index Internal node to check
+ * @return uint32_t Node now at the position of 'index'
+ */
+uint32_t spatial_balance(struct SpatialTree *tree, uint32_t index) {
+	struct SpatialNode *nodes = tree->nodes;
+	struct SpatialNode *a = &nodes[index];
+	if (a->child[0] == SPATIAL_NULL || a->height < 2) {
+		return index;
+	}
+
+	// 'up' is the taller child, it replaces 'a' and 'a' keeps its shorter grandchild
+	int side = (nodes[a->child[1]].height > nodes[a->child[0]].height) ? 1 : 0;
+	int32_t balance = nodes[a->child[side]].height - nodes[a->child[1 - side]].height;
+	if (balance <= 1) {
+		return index;
+	}
+
+	uint32_t up_index = a->child[side];
+	struct SpatialNode *up = &nodes[up_index];
+	uint32_t kept = a->child[1 - side];
+	uint32_t f = up->child[0], g = up->child[1];
+
+	up->child[1 - side] = index;
+	up->parent = a->parent;
+	a->parent = up_index;
+
+	if (up->parent == SPATIAL_NULL) {
+		tree->root = up_index;
+	} else {
+		spatial_replacechild(tree, up->parent, index, up_index);
+	}
+
+	// Taller grandchild stays under 'up', the other moves under 'a'
+	uint32_t stay = (nodes[f].height > nodes[g].height) ? f : g;
+	uint32_t move = (stay == f) ? g : f;
+
+	up->child[side] = stay;
+	a->child[side] = move;
+	a->child[1 - side] = kept;
+	nodes[move].parent = index;
+
+	spatial_union(&nodes[kept].bounds, &nodes[move].bounds, &a->bounds);
+	a->height = 1 + ((nodes[kept].height > nodes[move].height) ? nodes[kept].height
+															   : nodes[move].height);
+	spatial_union(&a->bounds, &nodes[stay].bounds, &up->bounds);
+	up->height = 1 + ((a->height > nodes[stay].height) ? a->height : nodes[stay].height);
+
+	return up_index;
+}
+
+// Walks from 'index' to the root, rebalancing and recomputing bounds and heights
+void spatial_refit(struct SpatialTree *tree, uint32_t index) {
+	struct SpatialNode *node, *c0, *c1;
+
+	while (index != SPATIAL_NULL) {
+		index = spatial_balance(tree, index);
+
+		node = &tree->nodes[index];
+		c0 = &tree->nodes[node->child[0]];
+		c1 = &tree->nodes[node->child[1]];
+		node->height = 1 + ((c0->height > c1->height) ? c0->height : c1->height);
+		spatial_union(&c0->bounds, &c1->bounds, &node->bounds);
+
+		index = node->parent;
+	}
+}
+
+void spatial_replacechild(struct SpatialTree *tree, uint32_t parent, uint32_t old_child,
+						  uint32_t new_child) {
+	if (tree->nodes[parent].child[0] == old_child) {
+		tree->nodes[parent].child[0] = new_child;
+	} else {
+		tree->nodes[parent].child[1] = new_child;
+	}
+}
+
+/*			Bounds functions		*/
+
+void spatial_union(const struct SpatialBounds *a, const struct SpatialBounds *b,
+				   struct SpatialBounds *out) {
+	int i;
+	for (i = 0; i < 3; i++) {
+		out->min[i] = (a->min[i] < b->min[i]) ? a->min[i] : b->min[i];
+		out->max[i] = (a->max[i] > b->max[i]) ? a->max[i] : b->max[i];
+	}
+}
+
+// Half the surface area, which is just the area for flat 2D boxes
+float spatial_cost(const struct SpatialBounds *bounds) {
+	float dx = bounds->max[0] - bounds->min[0];
+	float dy = bounds->max[1] - bounds->min[1];
+	float dz = bounds->max[2] - bounds->min[2];
+	return dx * dy + dy * dz + dz * dx;
+}
+
+// True if 'inner' lies entirely inside 'outer'
+bool spatial_contains(const struct SpatialBounds *outer, const struct SpatialBounds *inner) {
+	int i;
+	for (i = 0; i < 3; i++) {
+		if (inner->min[i] < outer->min[i] || inner->max[i] > outer->max[i]) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool spatial_overlaps(const struct SpatialBounds *a, const struct SpatialBounds *b) {
+	int i;
+	for (i = 0; i < 3; i++) {
+		if (a->max[i] < b->min[i] || a->min[i] > b->max[i]) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// Tests the box corner farthest along each plane normal, outside if it is behind any plane
+bool spatial_infrustum(const struct SpatialBounds *bounds, const float (*planes)[4],
+					   size_t planes_size) {
+	size_t i;
+	for (i = 0; i < planes_size; i++) {
+		float x = (planes[i][0] >= 0.0f) ? bounds->max[0] : bounds->min[0];
+		float y = (planes[i][1] >= 0.0f) ? bounds->max[1] : bounds->min[1];
+		float z = (planes[i][2] >= 0.0f) ? bounds->max[2] : bounds->min[2];
+		if (planes[i][0] * x + planes[i][1] * y + planes[i][2] * z + planes[i][3] < 0.0f) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * @brief Slab test of a ray against a box
+ *
+ * @param bounds Box to test
+ * @param origin Ray start
+ * @param direction Ray direction
+ * @param max_distance Farthest distance to test
+ * @param distance Distance where the ray enters the box, 0 if it starts inside
+ * @return true Ray hits the box within 'max_distance'
+ * @return false Ray misses
+ */
+bool spatial_intersectray(const struct SpatialBounds *bounds, const float origin[3],
+						  const float direction[3], float max_distance, float *distance) {
+	float t_min = 0.0f, t_max = max_distance;
+	int i;
+
+	for (i = 0; i < 3; i++) {
+		// Parallel rays only hit if they start between the slab's planes
+		if (direction[i] == 0.0f) {
+			if (origin[i] < bounds->min[i] || origin[i] > bounds->max[i]) {
+				return false;
+			}
+			continue;
+		}
+
+		float inv = 1.0f / direction[i];
+		float t0 = (bounds->min[i] - origin[i]) * inv;
+		float t1 = (bounds->max[i] - origin[i]) * inv;
+		if (t0 > t1) {
+			float t = t0;
+			t0 = t1;
+			t1 = t;
+		}
+
+		t_min = (t0 > t_min) ? t0 : t_min;
+		t_max = (t1 < t_max) ? t1 : t_max;
+		if (t_min > t_max) {
+			return false;
+		}
+	}
+
+	*distance = t_min;
+	return true;
+}
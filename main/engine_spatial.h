@@ -0,0 +1,88 @@
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef ENGINE_SPATIAL_H
+#define ENGINE_SPATIAL_H
+
+#define SPATIAL_NULL UINT32_MAX
+#define SPATIAL_MIN_CAPACITY 64
+// Leaves are stored enlarged by this fraction of their largest extent so small moves are free
+#define SPATIAL_MARGIN_RATIO 0.125f
+// Balanced trees stay far below this height, traversal stacks are sized from it
+#define SPATIAL_STACK_SIZE 128
+
+// Axis-aligned box, 2D objects lie in the z = 0 plane
+struct SpatialBounds {
+	float min[3];
+	float max[3];
+};
+
+/*
+	Tree node. Leaves have no children and hold the user's data, internal nodes bound both
+	children. Free nodes reuse 'parent' as the next free node.
+*/
+struct SpatialNode {
+	struct SpatialBounds bounds;
+	void *data;
+	uint32_t parent;
+	uint32_t child[2];
+	int32_t height;
+};
+
+/*
+	Dynamic bounding volume hierarchy, rebalanced on every insertion & removal. Every function
+	takes the tree's lock, so callbacks must not modify the tree they are called from.
+*/
+struct SpatialTree {
+	struct SpatialNode *nodes;
+	uint32_t nodes_capacity;
+	uint32_t root;
+	uint32_t free_list;
+	size_t leaves_size;
+	pthread_mutex_t lock;
+};
+
+// Return false to end the query early
+typedef bool (*SpatialQueryCallback)(void *, void *);
+
+// Receives the distance along the ray to the leaf's box, returns the new maximum distance
+typedef float (*SpatialRayCallback)(void *, void *, float);
+
+// Spatial tree functions
+void spatial_init(struct SpatialTree *);
+void spatial_destroy(struct SpatialTree *);
+uint32_t spatial_insert(struct SpatialTree *, const struct SpatialBounds *, void *);
+void spatial_remove(struct SpatialTree *, uint32_t);
+bool spatial_move(struct SpatialTree *, uint32_t, const struct SpatialBounds *);
+void spatial_queryaabb(struct SpatialTree *, const struct SpatialBounds *, SpatialQueryCallback,
+					   void *);
+void spatial_queryfrustum(struct SpatialTree *, const float (*)[4], size_t, SpatialQueryCallback,
+						  void *);
+void spatial_raycast(struct SpatialTree *, const float[3], const float[3], float,
+					 SpatialRayCallback, void *);
+
+// Tree maintenance functions
+bool spatial_reserve(struct SpatialTree *, uint32_t);
+uint32_t spatial_allocnode(struct SpatialTree *);
+void spatial_freenode(struct SpatialTree *, uint32_t);
+void spatial_insertleaf(struct SpatialTree *, uint32_t);
+void spatial_removeleaf(struct SpatialTree *, uint32_t);
+uint32_t spatial_balance(struct SpatialTree *, uint32_t);
+void spatial_refit(struct SpatialTree *, uint32_t);
+void spatial_replacechild(struct SpatialTree *, uint32_t, uint32_t, uint32_t);
+
+// Bounds functions
+void spatial_union(const struct SpatialBounds *, const struct SpatialBounds *,
+				   struct SpatialBounds *);
+float spatial_cost(const struct SpatialBounds *);
+bool spatial_contains(const struct SpatialBounds *, const struct SpatialBounds *);
+bool spatial_overlaps(const struct SpatialBounds *, const struct SpatialBounds *);
+bool spatial_infrustum(const struct SpatialBounds *, const float (*)[4], size_t);
+bool spatial_intersectray(const struct SpatialBounds *, const float[3], const float[3], float,
+						  float *);
+
+#endif	// ENGINE_SPATIAL_H
@@ -0,0 +1,514 @@
+#include "engine_transform.h"
+
+#ifdef TRANSFORM_X86
+#include <immintrin.h>
+#endif
+
+// Selected kernels, scalar until transform_init finds something better
+static enum TransformPath transform_path = TRANSFORM_PATH_SCALAR;
+static TransformKernel transform_kernel2d = transform_build2dscalar;
+static TransformKernel transform_kernel3d = transform_build3dscalar;
+
+/*			Transform kernel functions		*/
+
+/**
+ * @brief Selects the widest kernel the CPU supports
+ *
+ * Every path uses the same polynomial and operation order, so they give identical results and the
+ * choice only affects speed
+ */
+void transform_init() {
+	transform_setpath(transform_bestpath());
+}
+
+/**
+ * @brief Forces a kernel path
+ *
+ * @param path Path to use
+ * @return true Path selected
+ * @return false Path not supported on this CPU, selection unchanged
+ */
+bool transform_setpath(enum TransformPath path) {
+	switch (path) {
+		case TRANSFORM_PATH_SCALAR:
+			transform_kernel2d = transform_build2dscalar;
+			transform_kernel3d = transform_build3dscalar;
+			break;
+#ifdef TRANSFORM_X86
+		case TRANSFORM_PATH_SSE2:
+			if (__builtin_cpu_supports("sse2") == 0) {
+				return false;
+			}
+			transform_kernel2d = transform_build2dsse2;
+			transform_kernel3d = transform_build3dsse2;
+			break;
+		case TRANSFORM_PATH_AVX2:
+			if (__builtin_cpu_supports("avx2") == 0) {
+				return false;
+			}
+			transform_kernel2d = transform_build2davx2;
+			transform_kernel3d = transform_build3davx2;
+			break;
+#endif
+		default:
+			return false;
+	}
+
+	transform_path = path;
+	return true;
+}
+
+/**
+ * @brief Currently selected kernel path
+ *
+ * @return enum TransformPath Path used by transform_build2d & transform_build3d
+ */
+enum TransformPath transform_getpath() {
+	return transform_path;
+}
+
+/**
+ * @brief Finds the widest path supported by the CPU
+ *
+ * @return enum TransformPath Best supported path
+ */
+enum TransformPath transform_bestpath() {
+#ifdef TRANSFORM_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		return TRANSFORM_PATH_AVX2;
+	}
+	if (__builtin_cpu_supports("sse2")) {
+		return TRANSFORM_PATH_SSE2;
+	}
+#endif
+	return TRANSFORM_PATH_SCALAR;
+}
+
+/**
+ * @brief Printable name of a path
+ *
+ * @param path Path to name
+ * @return const char* Static name string
+ */
+const char *transform_pathname(enum TransformPath path) {
+	switch (path) {
+		case TRANSFORM_PATH_SCALAR:
+			return "scalar";
+		case TRANSFORM_PATH_SSE2:
+			return "sse2";
+		case TRANSFORM_PATH_AVX2:
+			return "avx2";
+		default:
+			return "unknown";
+	}
+}
+
+/**
+ * @brief Builds 2D affine transforms with the selected kernel
+ *
+ * @param pos Position streams
+ * @param rot Euler rotation streams, only Z is used
+ * @param start First object in the streams
+ * @param count Number of objects
+ * @param out Destination of object 'start', 'count' entries are written
+ */
+void transform_build2d(const float *const pos[3], const float *const rot[3], size_t start,
+					   size_t count, union ObjectTransform *out) {
+	transform_kernel2d(pos, rot, start, count, out);
+}
+
+/**
+ * @brief Builds column-major 4x4 model matrices with the selected kernel
+ *
+ * Rotation is applied around X, then Y, then Z, followed by the translation
+ *
+ * @param pos Position streams
+ * @param rot Euler rotation streams
+ * @param start First object in the streams
+ * @param count Number of objects
+ * @param out Destination of object 'start', 'count' entries are written
+ */
+void transform_build3d(const float *const pos[3], const float *const rot[3], size_t start,
+					   size_t count, union ObjectTransform *out) {
+	transform_kernel3d(pos, rot, start, count, out);
+}
+
+/*			Transform composition functions		*/
+
+/**
+ * @brief Applies 'local' then 'parent', treating the affines as 3x3 with a last row of (0, 0, 1)
+ *
+ * @param parent Parent's world transform
+ * @param local Child's local transform
+ * @param out Child's world transform, may alias neither input
+ */
+void transform_compose2d(const union ObjectTransform *parent, const union ObjectTransform *local,
+						 union ObjectTransform *out) {
+	const float(*p)[4] = parent->t2d.affine;
+	const float(*l)[4] = local->t2d.affine;
+	int r;
+
+	for (r = 0; r < 2; r++) {
+		out->t2d.affine[r][0] = p[r][0] * l[0][0] + p[r][1] * l[1][0];
+		out->t2d.affine[r][1] = p[r][0] * l[0][1] + p[r][1] * l[1][1];
+		out->t2d.affine[r][2] = p[r][0] * l[0][2] + p[r][1] * l[1][2] + p[r][2];
+		out->t2d.affine[r][3] = 0.0f;
+	}
+	memset(out->t2d.reserved, 0, sizeof(out->t2d.reserved));
+}
+
+/**
+ * @brief Multiplies column-major model matrices, parent * local
+ *
+ * @param parent Parent's world matrix
+ * @param local Child's local matrix
+ * @param out Child's world matrix, may alias neither input
+ */
+void transform_compose3d(const union ObjectTransform *parent, const union ObjectTransform *local,
+						 union ObjectTransform *out) {
+	int c, r;
+
+	for (c = 0; c < 4; c++) {
+		for (r = 0; r < 4; r++) {
+			out->model[c * 4 + r] =
+				parent->model[r] * local->model[c * 4] +
+				parent->model[4 + r] * local->model[c * 4 + 1] +
+				parent->model[8 + r] * local->model[c * 4 + 2] +
+				parent->model[12 + r] * local->model[c * 4 + 3];
+		}
+	}
+}
+
+/*			Scalar path		*/
+
+/**
+ * @brief Sine & cosine with the same reduction and polynomial as the vector paths
+ *
+ * @param x Angle in radians
+ * @param s Output sine
+ * @param c Output cosine
+ */
+void transform_sincos(float x, float *s, float *c) {
+	float qf = rintf(x * TRANSFORM_2_OVER_PI);
+	int32_t q = (int32_t)qf;
+
+	float r = x - qf * TRANSFORM_PI_2_HI;
+	r = r - qf * TRANSFORM_PI_2_MID;
+	r = r - qf * TRANSFORM_PI_2_LO;
+
+	float r2 = r * r;
+	float sr = r + r * r2 * (TRANSFORM_SIN_1 + r2 * (TRANSFORM_SIN_2 + r2 * TRANSFORM_SIN_3));
+	float cr = 1.0f - 0.5f * r2 +
+			   r2 * r2 * (TRANSFORM_COS_1 + r2 * (TRANSFORM_COS_2 + r2 * TRANSFORM_COS_3));
+
+	// Odd quadrants swap sine & cosine, signs follow the quadrant
+	*s = (q & 1) ? cr : sr;
+	*c = (q & 1) ? sr : cr;
+	if (q & 2) {
+		*s = -*s;
+	}
+	if ((q + 1) & 2) {
+		*c = -*c;
+	}
+}
+
+void transform_build2dscalar(const float *const pos[3], const float *const rot[3], size_t start,
+							 size_t count, union ObjectTransform *out) {
+	float s, c;
+	size_t i;
+
+	for (i = 0; i < count; i++) {
+		transform_sincos(rot[2][start + i], &s, &c);
+
+		out[i].t2d.affine[0][0] = c;
+		out[i].t2d.affine[0][1] = -s;
+		out[i].t2d.affine[0][2] = pos[0][start + i];
+		out[i].t2d.affine[0][3] = 0.0f;
+		out[i].t2d.affine[1][0] = s;
+		out[i].t2d.affine[1][1] = c;
+		out[i].t2d.affine[1][2] = pos[1][start + i];
+		out[i].t2d.affine[1][3] = 0.0f;
+		memset(out[i].t2d.reserved, 0, sizeof(out[i].t2d.reserved));
+	}
+}
+
+void transform_build3dscalar(const float *const pos[3], const float *const rot[3], size_t start,
+							 size_t count, union ObjectTransform *out) {
+	float sx, cx, sy, cy, sz, cz;
+	float *m;
+	size_t i;
+
+	for (i = 0; i < count; i++) {
+		transform_sincos(rot[0][start + i], &sx, &cx);
+		transform_sincos(rot[1][start + i], &sy, &cy);
+		transform_sincos(rot[2][start + i], &sz, &cz);
+		m = out[i].model;
+
+		m[0] = cz * cy;
+		m[1] = sz * cy;
+		m[2] = -sy;
+		m[3] = 0.0f;
+		m[4] = cz * sy * sx - sz * cx;
+		m[5] = sz * sy * sx + cz * cx;
+		m[6] = cy * sx;
+		m[7] = 0.0f;
+		m[8] = cz * sy * cx + sz * sx;
+		m[9] = sz * sy * cx - cz * sx;
+		m[10] = cy * cx;
+		m[11] = 0.0f;
+		m[12] = pos[0][start + i];
+		m[13] = pos[1][start + i];
+		m[14] = pos[2][start + i];
+		m[15] = 1.0f;
+	}
+}
+
+#ifdef TRANSFORM_X86
+
+/*			SSE2 path		*/
+
+// Four sines & cosines, lane for lane the same as transform_sincos
+static inline void transform_sincos4(__m128 x, __m128 *s, __m128 *c) {
+	__m128i q = _mm_cvtps_epi32(_mm_mul_ps(x, _mm_set1_ps(TRANSFORM_2_OVER_PI)));
+	__m128 qf = _mm_cvtepi32_ps(q);
+
+	__m128 r = _mm_sub_ps(x, _mm_mul_ps(qf, _mm_set1_ps(TRANSFORM_PI_2_HI)));
+	r = _mm_sub_ps(r, _mm_mul_ps(qf, _mm_set1_ps(TRANSFORM_PI_2_MID)));
+	r = _mm_sub_ps(r, _mm_mul_ps(qf, _mm_set1_ps(TRANSFORM_PI_2_LO)));
+
+	__m128 r2 = _mm_mul_ps(r, r);
+	__m128 sp = _mm_add_ps(_mm_set1_ps(TRANSFORM_SIN_2),
+						   _mm_mul_ps(r2, _mm_set1_ps(TRANSFORM_SIN_3)));
+	sp = _mm_add_ps(_mm_set1_ps(TRANSFORM_SIN_1), _mm_mul_ps(r2, sp));
+	__m128 sr = _mm_add_ps(r, _mm_mul_ps(_mm_mul_ps(r, r2), sp));
+
+	__m128 cp = _mm_add_ps(_mm_set1_ps(TRANSFORM_COS_2),
+						   _mm_mul_ps(r2, _mm_set1_ps(TRANSFORM_COS_3)));
+	cp = _mm_add_ps(_mm_set1_ps(TRANSFORM_COS_1), _mm_mul_ps(r2, cp));
+	__m128 cr = _mm_sub_ps(_mm_set1_ps(1.0f), _mm_mul_ps(_mm_set1_ps(0.5f), r2));
+	cr = _mm_add_ps(cr, _mm_mul_ps(_mm_mul_ps(r2, r2), cp));
+
+	// Odd quadrants swap sine & cosine, no blend in SSE2 so select with masks
+	__m128i one = _mm_set1_epi32(1), two = _mm_set1_epi32(2);
+	__m128 swap = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(q, one), one));
+	__m128 vs = _mm_or_ps(_mm_and_ps(swap, cr), _mm_andnot_ps(swap, sr));
+	__m128 vc = _mm_or_ps(_mm_and_ps(swap, sr), _mm_andnot_ps(swap, cr));
+
+	// Move quadrant bit 1 into the sign bit
+	__m128i s_sign = _mm_slli_epi32(_mm_and_si128(q, two), 30);
+	__m128i c_sign = _mm_slli_epi32(_mm_and_si128(_mm_add_epi32(q, one), two), 30);
+	*s = _mm_xor_ps(vs, _mm_castsi128_ps(s_sign));
+	*c = _mm_xor_ps(vc, _mm_castsi128_ps(c_sign));
+}
+
+// Transposes four lanes of row vectors into four objects' 2D affines
+static inline void transform_store2d4(__m128 c, __m128 s, __m128 tx, __m128 ty,
+									  union ObjectTransform *out) {
+	__m128 zero = _mm_setzero_ps();
+	__m128 a = c, b = _mm_xor_ps(s, _mm_set1_ps(-0.0f)), t = tx, z = zero;
+	_MM_TRANSPOSE4_PS(a, b, t, z);
+	_mm_storeu_ps(out[0].t2d.affine[0], a);
+	_mm_storeu_ps(out[1].t2d.affine[0], b);
+	_mm_storeu_ps(out[2].t2d.affine[0], t);
+	_mm_storeu_ps(out[3].t2d.affine[0], z);
+
+	a = s, b = c, t = ty, z = zero;
+	_MM_TRANSPOSE4_PS(a, b, t, z);
+	_mm_storeu_ps(out[0].t2d.affine[1], a);
+	_mm_storeu_ps(out[1].t2d.affine[1], b);
+	_mm_storeu_ps(out[2].t2d.affine[1], t);
+	_mm_storeu_ps(out[3].t2d.affine[1], z);
+
+	int k;
+	for (k = 0; k < 4; k++) {
+		_mm_storeu_ps(out[k].t2d.reserved, zero);
+		_mm_storeu_ps(out[k].t2d.reserved + 4, zero);
+	}
+}
+
+// Transposes sixteen matrix element vectors into four objects' model matrices
+static inline void transform_store3d4(__m128 m[16], union ObjectTransform *out) {
+	int g;
+	for (g = 0; g < 4; g++) {
+		__m128 a = m[g * 4], b = m[g * 4 + 1], c = m[g * 4 + 2], d = m[g * 4 + 3];
+		_MM_TRANSPOSE4_PS(a, b, c, d);
+		_mm_storeu_ps(out[0].model + g * 4, a);
+		_mm_storeu_ps(out[1].model + g * 4, b);
+		_mm_storeu_ps(out[2].model + g * 4, c);
+		_mm_storeu_ps(out[3].model + g * 4, d);
+	}
+}
+
+// Model matrix elements for four objects, same operation order as the scalar path
+static inline void transform_model4(__m128 px, __m128 py, __m128 pz, __m128 rx, __m128 ry,
+									__m128 rz, __m128 m[16]) {
+	__m128 sx, cx, sy, cy, sz, cz;
+	transform_sincos4(rx, &sx, &cx);
+	transform_sincos4(ry, &sy, &cy);
+	transform_sincos4(rz, &sz, &cz);
+
+	__m128 zero = _mm_setzero_ps();
+	__m128 czsy = _mm_mul_ps(cz, sy), szsy = _mm_mul_ps(sz, sy);
+
+	m[0] = _mm_mul_ps(cz, cy);
+	m[1] = _mm_mul_ps(sz, cy);
+	m[2] = _mm_xor_ps(sy, _mm_set1_ps(-0.0f));
+	m[3] = zero;
+	m[4] = _mm_sub_ps(_mm_mul_ps(czsy, sx), _mm_mul_ps(sz, cx));
+	m[5] = _mm_add_ps(_mm_mul_ps(szsy, sx), _mm_mul_ps(cz, cx));
+	m[6] = _mm_mul_ps(cy, sx);
+	m[7] = zero;
+	m[8] = _mm_add_ps(_mm_mul_ps(czsy, cx), _mm_mul_ps(sz, sx));
+	m[9] = _mm_sub_ps(_mm_mul_ps(szsy, cx), _mm_mul_ps(cz, sx));
+	m[10] = _mm_mul_ps(cy, cx);
+	m[11] = zero;
+	m[12] = px;
+	m[13] = py;
+	m[14] = pz;
+	m[15] = _mm_set1_ps(1.0f);
+}
+
+void transform_build2dsse2(const float *const pos[3], const float *const rot[3], size_t start,
+						   size_t count, union ObjectTransform *out) {
+	__m128 s, c;
+	size_t i;
+
+	for (i = 0; i + 4 <= count; i += 4) {
+		transform_sincos4(_mm_loadu_ps(rot[2] + start + i), &s, &c);
+		transform_store2d4(c, s, _mm_loadu_ps(pos[0] + start + i),
+						   _mm_loadu_ps(pos[1] + start + i), out + i);
+	}
+
+	// Remaining objects
+	transform_build2dscalar(pos, rot, start + i, count - i, out + i);
+}
+
+void transform_build3dsse2(const float *const pos[3], const float *const rot[3], size_t start,
+						   size_t count, union ObjectTransform *out) {
+	__m128 m[16];
+	size_t i;
+
+	for (i = 0; i + 4 <= count; i += 4) {
+		transform_model4(_mm_loadu_ps(pos[0] + start + i), _mm_loadu_ps(pos[1] + start + i),
+						 _mm_loadu_ps(pos[2] + start + i), _mm_loadu_ps(rot[0] + start + i),
+						 _mm_loadu_ps(rot[1] + start + i), _mm_loadu_ps(rot[2] + start + i), m);
+		transform_store3d4(m, out + i);
+	}
+
+	// Remaining objects
+	transform_build3dscalar(pos, rot, start + i, count - i, out + i);
+}
+
+/*			AVX2 path		*/
+
+// Eight sines & cosines, lane for lane the same as transform_sincos
+__attribute__((target("avx2"))) static inline void transform_sincos8(__m256 x, __m256 *s,
+																	  __m256 *c) {
+	__m256i q = _mm256_cvtps_epi32(_mm256_mul_ps(x, _mm256_set1_ps(TRANSFORM_2_OVER_PI)));
+	__m256 qf = _mm256_cvtepi32_ps(q);
+
+	__m256 r = _mm256_sub_ps(x, _mm256_mul_ps(qf, _mm256_set1_ps(TRANSFORM_PI_2_HI)));
+	r = _mm256_sub_ps(r, _mm256_mul_ps(qf, _mm256_set1_ps(TRANSFORM_PI_2_MID)));
+	r = _mm256_sub_ps(r, _mm256_mul_ps(qf, _mm256_set1_ps(TRANSFORM_PI_2_LO)));
+
+	__m256 r2 = _mm256_mul_ps(r, r);
+	__m256 sp = _mm256_add_ps(_mm256_set1_ps(TRANSFORM_SIN_2),
+							  _mm256_mul_ps(r2, _mm256_set1_ps(TRANSFORM_SIN_3)));
+	sp = _mm256_add_ps(_mm256_set1_ps(TRANSFORM_SIN_1), _mm256_mul_ps(r2, sp));
+	__m256 sr = _mm256_add_ps(r, _mm256_mul_ps(_mm256_mul_ps(r, r2), sp));
+
+	__m256 cp = _mm256_add_ps(_mm256_set1_ps(TRANSFORM_COS_2),
+							  _mm256_mul_ps(r2, _mm256_set1_ps(TRANSFORM_COS_3)));
+	cp = _mm256_add_ps(_mm256_set1_ps(TRANSFORM_COS_1), _mm256_mul_ps(r2, cp));
+	__m256 cr = _mm256_sub_ps(_mm256_set1_ps(1.0f), _mm256_mul_ps(_mm256_set1_ps(0.5f), r2));
+	cr = _mm256_add_ps(cr, _mm256_mul_ps(_mm256_mul_ps(r2, r2), cp));
+
+	// Odd quadrants swap sine & cosine
+	__m256i one = _mm256_set1_epi32(1), two = _mm256_set1_epi32(2);
+	__m256 swap = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(q, one), one));
+	__m256 vs = _mm256_blendv_ps(sr, cr, swap);
+	__m256 vc = _mm256_blendv_ps(cr, sr, swap);
+
+	// Move quadrant bit 1 into the sign bit
+	__m256i s_sign = _mm256_slli_epi32(_mm256_and_si256(q, two), 30);
+	__m256i c_sign = _mm256_slli_epi32(_mm256_and_si256(_mm256_add_epi32(q, one), two), 30);
+	*s = _mm256_xor_ps(vs, _mm256_castsi256_ps(s_sign));
+	*c = _mm256_xor_ps(vc, _mm256_castsi256_ps(c_sign));
+}
+
+__attribute__((target("avx2"))) void transform_build2davx2(const float *const pos[3],
+														   const float *const rot[3], size_t start,
+														   size_t count,
+														   union ObjectTransform *out) {
+	__m256 s, c, tx, ty;
+	size_t i;
+
+	for (i = 0; i + 8 <= count; i += 8) {
+		transform_sincos8(_mm256_loadu_ps(rot[2] + start + i), &s, &c);
+		tx = _mm256_loadu_ps(pos[0] + start + i);
+		ty = _mm256_loadu_ps(pos[1] + start + i);
+
+		// Stores go through 128-bit transposes, one per half
+		transform_store2d4(_mm256_castps256_ps128(c), _mm256_castps256_ps128(s),
+						   _mm256_castps256_ps128(tx), _mm256_castps256_ps128(ty), out + i);
+		transform_store2d4(_mm256_extractf128_ps(c, 1), _mm256_extractf128_ps(s, 1),
+						   _mm256_extractf128_ps(tx, 1), _mm256_extractf128_ps(ty, 1),
+						   out + i + 4);
+	}
+
+	// Remaining objects
+	transform_build2dsse2(pos, rot, start + i, count - i, out + i);
+}
+
+__attribute__((target("avx2"))) void transform_build3davx2(const float *const pos[3],
+														   const float *const rot[3], size_t start,
+														   size_t count,
+														   union ObjectTransform *out) {
+	__m256 sx, cx, sy, cy, sz, cz;
+	__m256 m[16];
+	__m128 half[16];
+	size_t i;
+	int k;
+
+	for (i = 0; i + 8 <= count; i += 8) {
+		transform_sincos8(_mm256_loadu_ps(rot[0] + start + i), &sx, &cx);
+		transform_sincos8(_mm256_loadu_ps(rot[1] + start + i), &sy, &cy);
+		transform_sincos8(_mm256_loadu_ps(rot[2] + start + i), &sz, &cz);
+
+		__m256 zero = _mm256_setzero_ps();
+		__m256 czsy = _mm256_mul_ps(cz, sy), szsy = _mm256_mul_ps(sz, sy);
+
+		m[0] = _mm256_mul_ps(cz, cy);
+		m[1] = _mm256_mul_ps(sz, cy);
+		m[2] = _mm256_xor_ps(sy, _mm256_set1_ps(-0.0f));
+		m[3] = zero;
+		m[4] = _mm256_sub_ps(_mm256_mul_ps(czsy, sx), _mm256_mul_ps(sz, cx));
+		m[5] = _mm256_add_ps(_mm256_mul_ps(szsy, sx), _mm256_mul_ps(cz, cx));
+		m[6] = _mm256_mul_ps(cy, sx);
+		m[7] = zero;
+		m[8] = _mm256_add_ps(_mm256_mul_ps(czsy, cx), _mm256_mul_ps(sz, sx));
+		m[9] = _mm256_sub_ps(_mm256_mul_ps(szsy, cx), _mm256_mul_ps(cz, sx));
+		m[10] = _mm256_mul_ps(cy, cx);
+		m[11] = zero;
+		m[12] = _mm256_loadu_ps(pos[0] + start + i);
+		m[13] = _mm256_loadu_ps(pos[1] + start + i);
+		m[14] = _mm256_loadu_ps(pos[2] + start + i);
+		m[15] = _mm256_set1_ps(1.0f);
+
+		// Stores go through 128-bit transposes, one per half
+		for (k = 0; k < 16; k++) {
+			half[k] = _mm256_castps256_ps128(m[k]);
+		}
+		transform_store3d4(half, out + i);
+		for (k = 0; k < 16; k++) {
+			half[k] = _mm256_extractf128_ps(m[k], 1);
+		}
+		transform_store3d4(half, out + i + 4);
+	}
+
+	// Remaining objects
+	transform_build3dsse2(pos, rot, start + i, count - i, out + i);
+}
+
+#endif
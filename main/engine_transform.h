@@ -0,0 +1,77 @@
+#include "object_struct.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifndef ENGINE_TRANSFORM_H
+#define ENGINE_TRANSFORM_H
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define TRANSFORM_X86
+#endif
+
+// Quadrant reduction by pi/2 split in three parts (Cody-Waite) so the remainder stays exact
+#define TRANSFORM_2_OVER_PI 0.636619772367581f
+#define TRANSFORM_PI_2_HI 1.5703125f
+#define TRANSFORM_PI_2_MID 4.837512969970703125e-4f
+#define TRANSFORM_PI_2_LO 7.54978995489188216e-8f
+
+// Minimax sine & cosine on [-pi/4, pi/4]
+#define TRANSFORM_SIN_1 -1.6666654611e-1f
+#define TRANSFORM_SIN_2 8.3321608736e-3f
+#define TRANSFORM_SIN_3 -1.9515295891e-4f
+#define TRANSFORM_COS_1 4.166664568298827e-2f
+#define TRANSFORM_COS_2 -1.388731625493765e-3f
+#define TRANSFORM_COS_3 2.443315711809948e-5f
+
+enum TransformPath { TRANSFORM_PATH_SCALAR, TRANSFORM_PATH_SSE2, TRANSFORM_PATH_AVX2 };
+
+/*
+	Converts 'count' objects starting at 'start' of the position and Euler rotation streams into
+	transform entries at 'out'. 'out' may point at mapped GPU memory.
+*/
+typedef void (*TransformKernel)(const float *const[3], const float *const[3], size_t, size_t,
+								union ObjectTransform *);
+
+// Transform kernel functions
+void transform_init();
+bool transform_setpath(enum TransformPath);
+enum TransformPath transform_getpath();
+enum TransformPath transform_bestpath();
+const char *transform_pathname(enum TransformPath);
+void transform_build2d(const float *const[3], const float *const[3], size_t, size_t,
+					   union ObjectTransform *);
+void transform_build3d(const float *const[3], const float *const[3], size_t, size_t,
+					   union ObjectTransform *);
+
+// Transform composition functions
+void transform_compose2d(const union ObjectTransform *, const union ObjectTransform *,
+						 union ObjectTransform *);
+void transform_compose3d(const union ObjectTransform *, const union ObjectTransform *,
+						 union ObjectTransform *);
+
+// Scalar path
+void transform_sincos(float, float *, float *);
+void transform_build2dscalar(const float *const[3], const float *const[3], size_t, size_t,
+							 union ObjectTransform *);
+void transform_build3dscalar(const float *const[3], const float *const[3], size_t, size_t,
+							 union ObjectTransform *);
+
+#ifdef TRANSFORM_X86
+// SSE2 path
+void transform_build2dsse2(const float *const[3], const float *const[3], size_t, size_t,
+						   union ObjectTransform *);
+void transform_build3dsse2(const float *const[3], const float *const[3], size_t, size_t,
+						   union ObjectTransform *);
+
+// AVX2 path
+void transform_build2davx2(const float *const[3], const float *const[3], size_t, size_t,
+						   union ObjectTransform *);
+void transform_build3davx2(const float *const[3], const float *const[3], size_t, size_t,
+						   union ObjectTransform *);
+#endif
+
+#endif	// ENGINE_TRANSFORM_H
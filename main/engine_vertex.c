@@ -25,4 +25,27 @@ void vertex_getattributedescriptions(uint32_t *attr_count,
 	attr_descriptions[1].location = 1;
 	attr_descriptions[1].format = VK_FORMAT_R32G32B32_SFLOAT;
 	attr_descriptions[1].offset = offsetof(struct Vertex, color);
+}
+
+// Instanced draws read one transform slot per instance from a second binding
+VkVertexInputBindingDescription vertex_getinstancebindingdescription() {
+	VkVertexInputBindingDescription binding_description = {0};
+
+	binding_description.binding = 1;
+	binding_description.stride = sizeof(uint32_t);
+	binding_description.inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+
+	return binding_description;
+}
+
+void vertex_getinstanceattributedescriptions(
+	uint32_t *attr_count, VkVertexInputAttributeDescription *attr_descriptions) {
+	*attr_count = 1;
+	if (attr_descriptions == NULL)
+		return;
+
+	attr_descriptions[0].binding = 1;
+	attr_descriptions[0].location = 2;
+	attr_descriptions[0].format = VK_FORMAT_R32_UINT;
+	attr_descriptions[0].offset = 0;
 }
\ No newline at end of file
@@ -12,5 +12,7 @@ struct Vertex {
 
 VkVertexInputBindingDescription vertex_getbindingdescription();
 void vertex_getattributedescriptions(uint32_t *, VkVertexInputAttributeDescription *);
+VkVertexInputBindingDescription vertex_getinstancebindingdescription();
+void vertex_getinstanceattributedescriptions(uint32_t *, VkVertexInputAttributeDescription *);
 
 #endif
\ No newline at end of file
@@ -7,8 +7,12 @@ bool vkmemory_init(struct VulkanMemory *vmem, VkPhysicalDevice physical_device,
 	vmem->gfx_index = gfx_index;
 	vmem->tfr_index = tfr_index;
 	vmem->allocation = NULL;
+	vmem->next_id = 0;
+	vmem->garbage = NULL;
+	vmem->frame = 0;
 
 	pthread_mutex_init(&vmem->allocation_lock, NULL);
+	pthread_mutex_init(&vmem->garbage_lock, NULL);
 
 	return true;
 }
@@ -39,9 +43,13 @@ bool vkmemory_destroy(struct VulkanMemory *vmem) {
 		curr = next;
 	}
 
+	// Garbage buffers were still on the allocation lists and are freed above
+	vmem->garbage = NULL;
+
 	// Destroy lock
 	pthread_mutex_unlock(&vmem->allocation_lock);
 	pthread_mutex_destroy(&vmem->allocation_lock);
+	pthread_mutex_destroy(&vmem->garbage_lock);
 
 	return true;
 }
@@ -56,12 +64,6 @@ bool vkmemory_createbuffer(struct VulkanMemory *vmem, VkDeviceSize buff_size,
 		printf("Creating GPU buffer... size = %llu\n", buff_size);
 	}
 
-	// Check size
-	if (buff_size > VK_ALLOC_BLOCK_SIZE) {
-		fprintf(stderr, "Trying to allocate a chunk of memory too big.\n");
-		return false;
-	}
-
 	// Create buffer before allocation
 	VkBufferCreateInfo buffer_info = {0};
 
@@ -73,15 +75,21 @@ bool vkmemory_createbuffer(struct VulkanMemory *vmem, VkDeviceSize buff_size,
 	/* Set to concurrent
 	   (non-optimal for mobile GPUs)
 	   Would require ownership transfer if exclusive */
-	buffer_info.sharingMode = VK_SHARING_MODE_CONCURRENT;
-	buffer_info.queueFamilyIndexCount = 2;
-	buffer_info.pQueueFamilyIndices = queue_indices;
+	if (vmem->gfx_index != vmem->tfr_index) {
+		buffer_info.sharingMode = VK_SHARING_MODE_CONCURRENT;
+		buffer_info.queueFamilyIndexCount = 2;
+		buffer_info.pQueueFamilyIndices = queue_indices;
+	} else {
+		// Transfers share the graphics family, concurrent requires unique indices
+		buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	}
 	buffer_info.flags = 0;
 
 	VkBuffer buff;
 
 	if (vkCreateBuffer(vmem->device, &buffer_info, NULL, &buff) != VK_SUCCESS) {
 		fprintf(stderr, "Failured creating buffer before allocation.\n");
+		pthread_mutex_unlock(&vmem->allocation_lock);
 		return false;
 	}
 
@@ -92,6 +100,9 @@ bool vkmemory_createbuffer(struct VulkanMemory *vmem, VkDeviceSize buff_size,
 	uint32_t desired_index =
 		vkmemory_findmemorytype(vmem->physical_device, mem_requirements.memoryTypeBits, properties);
 
+	// Buffers too big for a block get memory of their own instead of being sub-allocated
+	bool dedicated = mem_requirements.size > VK_ALLOC_BLOCK_SIZE;
+
 	// Calculate aligned size of buffer
 	/* VkDeviceSize buff_pgs = buff_size / mem_requirements.alignment;
 	buff_pgs++;
@@ -101,23 +112,23 @@ bool vkmemory_createbuffer(struct VulkanMemory *vmem, VkDeviceSize buff_size,
 	struct VulkanAllocation *prev = NULL, *curr = vmem->allocation;
 	struct VulkanBuffer *new_buff = NULL;
 
-	while (curr != NULL) {
+	while (curr != NULL && new_buff == NULL) {
 		// If memory types are equal
-		if (curr->req == desired_index) {
+		if (curr->req == desired_index && curr->dedicated == false && dedicated == false) {
 			// Traverse through buffers
 			struct VulkanBuffer *bcurr = curr->buffers;
 			struct MemoryOffsets offsets = {0};
 			bool fits = false;
 
-			// Check beginning of linked list
-			if (bcurr != NULL) {
-				fits = vkmemory_calculateoffsets(0, bcurr->start, buff_size,
-												 mem_requirements.alignment, &offsets);
-				if (fits) {
-					new_buff = curr->buffers = vkmemory_createbufferstruct(
-						buff, curr, buff_size, offsets.start, offsets.end);
-					curr->buffers->next = bcurr;
-				}
+			// Check beginning of linked list (whole block if every buffer was released)
+			VkDeviceSize first_start = (bcurr == NULL) ? curr->mem_size : bcurr->start;
+			fits = vkmemory_calculateoffsets(0, first_start, buff_size, mem_requirements.alignment,
+											 &offsets);
+			if (fits) {
+				new_buff = curr->buffers = vkmemory_createbufferstruct(
+					buff, curr, buff_size, offsets.start, offsets.end);
+				curr->buffers->next = bcurr;
+				bcurr = NULL;
 			}
 
 			// Check after every element
@@ -127,8 +138,10 @@ bool vkmemory_createbuffer(struct VulkanMemory *vmem, VkDeviceSize buff_size,
 				fits = vkmemory_calculateoffsets(bcurr->end, next_start, buff_size,
 												 mem_requirements.alignment, &offsets);
 				if (fits) {
+					struct VulkanBuffer *bnext = bcurr->next;
 					new_buff = bcurr->next = vkmemory_createbufferstruct(
 						buff, curr, buff_size, offsets.start, offsets.end);
+					new_buff->next = bnext;
 					break;
 				}
 
@@ -145,9 +158,18 @@ bool vkmemory_createbuffer(struct VulkanMemory *vmem, VkDeviceSize buff_size,
 	if (new_buff == NULL) {
 		// Create alloc structure
 		struct VulkanAllocation *mem_salloc = malloc(sizeof(*mem_salloc));
+		if (mem_salloc == NULL) {
+			fprintf(stderr, "Failure allocating structure memory for memory allocation.\n");
+			vkDestroyBuffer(vmem->device, buff, NULL);
+			pthread_mutex_unlock(&vmem->allocation_lock);
+			return false;
+		}
 
 		mem_salloc->buffers = NULL;
-		mem_salloc->mem_size = VK_ALLOC_BLOCK_SIZE;
+		mem_salloc->mapped = NULL;
+		mem_salloc->map_count = 0;
+		mem_salloc->dedicated = dedicated;
+		mem_salloc->mem_size = dedicated ? mem_requirements.size : VK_ALLOC_BLOCK_SIZE;
 		mem_salloc->req = vkmemory_findmemorytype(vmem->physical_device,
 												  mem_requirements.memoryTypeBits, properties);
 		mem_salloc->next = (curr == NULL) ? NULL : curr->next;
@@ -158,11 +180,14 @@ bool vkmemory_createbuffer(struct VulkanMemory *vmem, VkDeviceSize buff_size,
 		VkMemoryAllocateInfo alloc_info = {0};
 
 		alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-		alloc_info.allocationSize = VK_ALLOC_BLOCK_SIZE;
+		alloc_info.allocationSize = mem_salloc->mem_size;
 		alloc_info.memoryTypeIndex = mem_salloc->req;
 
 		if (vkAllocateMemory(vmem->device, &alloc_info, NULL, &mem_salloc->mem) != VK_SUCCESS) {
 			fprintf(stderr, "Failured to allocate GPU device memory.\n");
+			vkDestroyBuffer(vmem->device, buff, NULL);
+			free(mem_salloc);
+			pthread_mutex_unlock(&vmem->allocation_lock);
 			return false;
 		}
 
@@ -180,9 +205,12 @@ bool vkmemory_createbuffer(struct VulkanMemory *vmem, VkDeviceSize buff_size,
 
 	if (new_buff == NULL) {
 		fprintf(stderr, "Memory allocation failure in vkmemory_createbuffer.\n");
+		pthread_mutex_unlock(&vmem->allocation_lock);
 		return false;
 	}
 
+	new_buff->id = vmem->next_id++;
+
 	// Bind buffer to memory
 	vkBindBufferMemory(vmem->device, new_buff->buffer, new_buff->allocation->mem, new_buff->start);
 
@@ -210,8 +238,9 @@ bool vkmemory_destroybuffer(struct VulkanMemory *vmem, struct VulkanBuffer *stru
 	struct VulkanBuffer *bprev = NULL, *bcurr = curr->buffers;
 	while (bcurr != NULL) {
 		if (bcurr->buffer == struct_buff->buffer) {
-			// Destroy buffer
+			// Destroy buffer, dropping any maps it still holds
 			vkDestroyBuffer(vmem->device, bcurr->buffer, NULL);
+			vkmemory_unmapallocation(vmem, curr, bcurr->map_count);
 
 			// Patch linked list
 			if (bprev == NULL) {
@@ -234,6 +263,17 @@ bool vkmemory_destroybuffer(struct VulkanMemory *vmem, struct VulkanBuffer *stru
 				free(curr);
 			} */
 
+			// Dedicated memory only ever holds this buffer, so it goes right away
+			if (curr->dedicated) {
+				struct VulkanAllocation **link = &vmem->allocation;
+				while (*link != curr) {
+					link = &(*link)->next;
+				}
+				*link = curr->next;
+				vkFreeMemory(vmem->device, curr->mem, NULL);
+				free(curr);
+			}
+
 			// Free allocated buffer struct
 			free(bcurr);
 			bcurr = NULL;
@@ -255,29 +295,117 @@ bool vkmemory_destroybuffer(struct VulkanMemory *vmem, struct VulkanBuffer *stru
 	return false;
 }
 
+/*
+	Mapping is reference counted per allocation since Vulkan allows one map per VkDeviceMemory,
+	so buffers sharing an allocation can stay mapped at the same time.
+*/
 bool vkmemory_mapbuffer(struct VulkanMemory *vmem, struct VulkanBuffer *struct_buff, void **map) {
 	if (struct_buff == NULL || vmem == NULL) {
-		fprintf(stderr, "NULL values passed into destroy buffer function.\n");
-		return true;
+		fprintf(stderr, "NULL values passed into map buffer function.\n");
+		return false;
 	}
 
-	vkMapMemory(vmem->device, struct_buff->allocation->mem, struct_buff->start,
-				struct_buff->buffer_size, 0, map);
+	pthread_mutex_lock(&vmem->allocation_lock);
+
+	struct VulkanAllocation *alloc = struct_buff->allocation;
+	if (alloc->map_count == 0) {
+		if (vkMapMemory(vmem->device, alloc->mem, 0, VK_WHOLE_SIZE, 0, &alloc->mapped) !=
+			VK_SUCCESS) {
+			fprintf(stderr, "Failure mapping GPU memory.\n");
+			pthread_mutex_unlock(&vmem->allocation_lock);
+			return false;
+		}
+	}
+	alloc->map_count++;
+	struct_buff->map_count++;
+	*map = (char *)alloc->mapped + struct_buff->start;
 
+	pthread_mutex_unlock(&vmem->allocation_lock);
 	return true;
 }
 
 bool vkmemory_unmapbuffer(struct VulkanMemory *vmem, struct VulkanBuffer *struct_buff) {
 	if (struct_buff == NULL || vmem == NULL) {
-		fprintf(stderr, "NULL values passed into destroy buffer function.\n");
+		fprintf(stderr, "NULL values passed into unmap buffer function.\n");
 		return false;
 	}
 
-	vkUnmapMemory(vmem->device, struct_buff->allocation->mem);
+	pthread_mutex_lock(&vmem->allocation_lock);
+	if (struct_buff->map_count > 0) {
+		struct_buff->map_count--;
+		vkmemory_unmapallocation(vmem, struct_buff->allocation, 1);
+	}
+	pthread_mutex_unlock(&vmem->allocation_lock);
+
+	return true;
+}
+
+// Drops 'count' maps of an allocation, must be called with the allocation lock held
+void vkmemory_unmapallocation(struct VulkanMemory *vmem, struct VulkanAllocation *alloc,
+							  uint32_t count) {
+	if (count == 0 || alloc->map_count == 0) {
+		return;
+	}
+
+	alloc->map_count = (count >= alloc->map_count) ? 0 : alloc->map_count - count;
+	if (alloc->map_count == 0) {
+		vkUnmapMemory(vmem->device, alloc->mem);
+		alloc->mapped = NULL;
+	}
+}
+
+// Reference counting functions
+void vkmemory_retainbuffer(struct VulkanBuffer *struct_buff) {
+	atomic_fetch_add(&struct_buff->retain_count, 1);
+}
+
+/*
+	Drops a reference from any thread. The last release queues the buffer for destruction instead
+	of destroying it, since frames still in flight may reference it.
+*/
+bool vkmemory_releasebuffer(struct VulkanMemory *vmem, struct VulkanBuffer *struct_buff) {
+	if (struct_buff == NULL || vmem == NULL) {
+		fprintf(stderr, "NULL values passed into release buffer function.\n");
+		return false;
+	}
+
+	if (atomic_fetch_sub(&struct_buff->retain_count, 1) != 1) {
+		return true;
+	}
+
+	pthread_mutex_lock(&vmem->garbage_lock);
+	struct_buff->retire_frame = vmem->frame;
+	struct_buff->garbage_next = vmem->garbage;
+	vmem->garbage = struct_buff;
+	pthread_mutex_unlock(&vmem->garbage_lock);
 
 	return true;
 }
 
+// Advances the frame counter and destroys buffers retired at least 'latency' frames ago
+void vkmemory_collectgarbage(struct VulkanMemory *vmem, uint64_t latency) {
+	pthread_mutex_lock(&vmem->garbage_lock);
+	vmem->frame++;
+
+	struct VulkanBuffer *prev = NULL, *curr = vmem->garbage, *next;
+	while (curr != NULL) {
+		next = curr->garbage_next;
+		if (vmem->frame - curr->retire_frame >= latency) {
+			if (prev == NULL) {
+				vmem->garbage = next;
+			} else {
+				prev->garbage_next = next;
+			}
+			vkmemory_destroybuffer(vmem, curr);
+		} else {
+			prev = curr;
+		}
+		curr = next;
+	}
+
+	pthread_mutex_unlock(&vmem->garbage_lock);
+}
+
 // Helper functions
 struct VulkanBuffer *vkmemory_createbufferstruct(VkBuffer buff, struct VulkanAllocation *vk_alloc,
 												 VkDeviceSize size, VkDeviceSize start,
@@ -294,6 +422,10 @@ struct VulkanBuffer *vkmemory_createbufferstruct(VkBuffer buff, struct VulkanAll
 	ret->start = start;
 	ret->end = end;
 	ret->next = NULL;
+	ret->map_count = 0;
+	ret->retire_frame = 0;
+	ret->garbage_next = NULL;
+	atomic_init(&ret->retain_count, 1);
 	return ret;
 }
 
@@ -317,7 +449,7 @@ uint32_t vkmemory_findmemorytype(VkPhysicalDevice p_device, uint32_t type_filter
 
 bool vkmemory_calculateoffsets(VkDeviceSize start, VkDeviceSize end, VkDeviceSize size,
 							   VkDeviceSize alignment, struct MemoryOffsets *offsets) {
-	VkDeviceSize start_offset = alignment - start % alignment;
+	VkDeviceSize start_offset = (alignment - start % alignment) % alignment;
 	VkDeviceSize area_start = start + start_offset;
 
 	VkDeviceSize area_end = area_start + size;
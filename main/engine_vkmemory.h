@@ -4,6 +4,7 @@
 
 #include <assert.h>
 #include <pthread.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -18,9 +19,19 @@ struct VulkanBuffer {
 	size_t buffer_size;
 	VkDeviceSize start;
 	VkDeviceSize end;
-	uint16_t retain_count;
+	_Atomic uint32_t retain_count;
 	struct VulkanAllocation *allocation;
 	struct VulkanBuffer *next;
+
+	// Creation order, lets draws be grouped by buffer without comparing handles
+	uint32_t id;
+
+	// Outstanding maps of this buffer, dropped when it is destroyed
+	uint32_t map_count;
+
+	// Deferred destruction once the last reference is released
+	uint64_t retire_frame;
+	struct VulkanBuffer *garbage_next;
 };
 
 struct VulkanAllocation {
@@ -28,6 +39,13 @@ struct VulkanAllocation {
 	VkDeviceSize mem_size;
 	uint32_t req;
 	struct VulkanBuffer *buffers;
+
+	// Memory is mapped once and shared by every mapped buffer in it
+	void *mapped;
+	uint32_t map_count;
+
+	// Sized to one buffer larger than a block, freed along with it
+	bool dedicated;
 	struct VulkanAllocation *next;
 };
 
@@ -37,6 +55,12 @@ struct VulkanMemory {
 	uint32_t gfx_index, tfr_index;
 	pthread_mutex_t allocation_lock;
 	struct VulkanAllocation *allocation;
+	uint32_t next_id;
+
+	// Released buffers waiting for the GPU to stop using them
+	pthread_mutex_t garbage_lock;
+	struct VulkanBuffer *garbage;
+	uint64_t frame;
 };
 
 struct MemoryOffsets {
@@ -54,6 +78,12 @@ bool vkmemory_createbuffer(struct VulkanMemory *, VkDeviceSize, VkBufferUsageFla
 bool vkmemory_destroybuffer(struct VulkanMemory *, struct VulkanBuffer *);
 bool vkmemory_mapbuffer(struct VulkanMemory *, struct VulkanBuffer *, void **);
 bool vkmemory_unmapbuffer(struct VulkanMemory *, struct VulkanBuffer *);
+void vkmemory_unmapallocation(struct VulkanMemory *, struct VulkanAllocation *, uint32_t);
+
+// Reference counting functions
+void vkmemory_retainbuffer(struct VulkanBuffer *);
+bool vkmemory_releasebuffer(struct VulkanMemory *, struct VulkanBuffer *);
+void vkmemory_collectgarbage(struct VulkanMemory *, uint64_t);
 
 // Helper functions
 uint32_t vkmemory_findmemorytype(VkPhysicalDevice, uint32_t, VkMemoryPropertyFlags);
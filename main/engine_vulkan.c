@@ -5,7 +5,8 @@
 const char *device_extensions[] = {VK_KHR_SWAPCHAIN_EXTENSION_NAME};
 const char *validation_extensions[] = {VK_EXT_DEBUG_UTILS_EXTENSION_NAME};
 const char *validation_layers[] = {"VK_LAYER_KHRONOS_validation"};
-const char *shader_files[] = {"shaders/shader2d.vs.spv", "shaders/shader2d.fs.spv"};
+const char *shader_files[] = {"shaders/shader2d.vs.spv", "shaders/shader2dinstanced.vs.spv",
+							  "shaders/shader2d.fs.spv", "shaders/shadercull.cs.spv"};
 
 bool vulkan_init(struct Application *app) {
 	bool ret = vulkan_checkextensions();
@@ -65,12 +66,24 @@ bool vulkan_init(struct Application *app) {
 		fprintf(stderr, "Failure creating shader modules.\n");
 		return false;
 	}
+	// Create descriptor layouts & sets
+	ret = vulkan_createdescriptors(app);
+	if (ret == false) {
+		fprintf(stderr, "Failure to create descriptor sets.\n");
+		return false;
+	}
 	// Create pipeline using shaders
 	ret = vulkan_create2Dpipeline(app);
 	if (ret == false) {
 		fprintf(stderr, "Failure to create pipeline.\n");
 		return false;
 	}
+	// Create GPU culling pipeline, doesn't depend on the swapchain
+	ret = vulkan_createcullpipeline(app);
+	if (ret == false) {
+		fprintf(stderr, "Failure to create cull pipeline.\n");
+		return false;
+	}
 	// Create framebuffers
 	ret = vulkan_createframebuffers(app);
 	if (ret == false) {
@@ -280,37 +293,53 @@ struct QueueFamilies vulkan_getqueuefamilies(struct Application *app,
 
 	// Select applicable graphics queue family
 	VkBool32 present_support = VK_FALSE;
-	uint32_t i;
+	VkQueueFlags flags;
+	uint32_t i, transfer_score, best_transfer_score = 0;
 	for (i = 0; i < queue_family_count; i++) {
+		flags = queue_families[i].queueFlags;
+
 		// Check for graphics queue
-		if (queue_families[i].queueFlags & VK_QUEUE_GRAPHICS_BIT &&
-			indices.graphics_count != GFX_INDICES_SIZE) {
+		if (flags & VK_QUEUE_GRAPHICS_BIT && indices.graphics_count != GFX_INDICES_SIZE) {
 			// Add graphics index to struct
 			indices.graphics_indices[indices.graphics_count] = i;
 			indices.graphics_count += 1;
 		}
 
-		// Check for transfer queue
-		if (queue_families[i].queueFlags & VK_QUEUE_TRANSFER_BIT &&
-			!(queue_families[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) &&
-			indices.transfer_count != TRANSFER_INDICES_SIZE) {
-			indices.transfer_indices[indices.transfer_count] = i;
-			indices.transfer_count += 1;
+		// Check for transfer queue, preferring transfer-only (DMA) families over async compute
+		transfer_score = 0;
+		if (flags & VK_QUEUE_TRANSFER_BIT && !(flags & VK_QUEUE_GRAPHICS_BIT)) {
+			transfer_score = (flags & VK_QUEUE_COMPUTE_BIT) ? 1 : 2;
+		}
+		if (transfer_score > best_transfer_score) {
+			best_transfer_score = transfer_score;
+			indices.transfer_indices[0] = i;
+			indices.transfer_count = 1;
+			indices.transfer_queue_count = queue_families[i].queueCount;
+			indices.transfer_dedicated = true;
 		}
 
-		// Check for present queue
+		// Check for present queue, preferring the graphics family
 		vkGetPhysicalDeviceSurfaceSupportKHR(physical_device, i, app->vulkan_data->surface,
 											 &present_support);
-		if (present_support == VK_TRUE && indices.present_count != PRESENT_INDICES_SIZE) {
+		if (present_support == VK_TRUE &&
+			(indices.present_count != PRESENT_INDICES_SIZE ||
+			 (flags & VK_QUEUE_GRAPHICS_BIT && indices.graphics_indices[0] == i))) {
 			// Add present index to struct
-			indices.present_indices[indices.present_count] = i;
-			indices.present_count += 1;
+			indices.present_indices[0] = i;
+			indices.present_count = 1;
 		}
+	}
 
-		// If struct is suitable, exit
-		if (indices.graphics_count > 0 && indices.present_count > 0 && indices.transfer_count > 0) {
-			break;
-		}
+	// Fall back to the graphics family (implicitly transfer capable) for transfers
+	if (indices.transfer_count == 0 && indices.graphics_count > 0) {
+		indices.transfer_indices[0] = indices.graphics_indices[0];
+		indices.transfer_count = 1;
+		indices.transfer_queue_count = 1;
+		indices.transfer_dedicated = false;
+	}
+
+	if (indices.transfer_queue_count > TRANSFER_QUEUES_SIZE) {
+		indices.transfer_queue_count = TRANSFER_QUEUES_SIZE;
 	}
 
 	free(queue_families);
@@ -438,17 +467,36 @@ void vulkan_close(struct Application *app) {
 						   NULL);
 		vkDestroyFence(app->vulkan_data->device, app->vulkan_data->in_flight_fen[i], NULL);
 	}
+	for (i = 0; i < app->vulkan_data->transfer_queues_size; i++) {
+		vkDestroyFence(app->vulkan_data->device, app->vulkan_data->transfer_fences[i], NULL);
+	}
 	free(app->vulkan_data->imgs_in_flight);
+	free(app->vulkan_data->draw_items);
+	free(app->vulkan_data->draw_items_temp);
 
 	// Clean up swapchain
 	vulkan_cleanupswapchain(app);
 
+	// Destroy cull pipeline
+	vkDestroyPipeline(app->vulkan_data->device, app->vulkan_data->cull_pipeline, NULL);
+	vkDestroyPipelineLayout(app->vulkan_data->device, app->vulkan_data->cull_pipeline_layout, NULL);
+
+	// Destroy descriptor pool (frees its sets) & layouts
+	vkDestroyDescriptorPool(app->vulkan_data->device, app->vulkan_data->descriptor_pool, NULL);
+	vkDestroyDescriptorSetLayout(app->vulkan_data->device, app->vulkan_data->transform_set_layout,
+								 NULL);
+	vkDestroyDescriptorSetLayout(app->vulkan_data->device, app->vulkan_data->cull_set_layout, NULL);
+
 	// Free GPU memory
 	vkmemory_destroy(&app->vulkan_data->vmemory);
 
 	// Destroy command pool
 	vkDestroyCommandPool(app->vulkan_data->device, app->vulkan_data->gfx_command_pool, NULL);
 	vkDestroyCommandPool(app->vulkan_data->device, app->vulkan_data->tfr_command_pool, NULL);
+	for (i = 0; i < MAX_FRAMES_IN_FLIGHT * app->vulkan_data->record_slices_size; i++) {
+		vkDestroyCommandPool(app->vulkan_data->device, app->vulkan_data->record_pools[i], NULL);
+	}
+	free(app->vulkan_data->record_pools);
 
 	// Destroy debug messenger
 	if (enable_validation_layers)
@@ -475,12 +523,44 @@ bool vulkan_cleanupswapchain(struct Application *app) {
 	vkFreeCommandBuffers(app->vulkan_data->device, app->vulkan_data->gfx_command_pool,
 						 app->vulkan_data->gfx_command_buffers_size,
 						 app->vulkan_data->gfx_command_buffers);
+	for (i = 0; i < app->vulkan_data->gfx_command_buffers_size; i++) {
+		vulkan_releasestreams(app, &app->vulkan_data->gfx_recordings[i].streams);
+		vulkan_releasestreams(app, &app->vulkan_data->gfx_recordings[i].static_streams);
+	}
+	free(app->vulkan_data->gfx_recordings);
+	app->vulkan_data->gfx_recordings = NULL;
+
+	// Secondary buffers go back to the pool of their slice & frame
+	uint32_t slices_size = app->vulkan_data->record_slices_size;
+	uint32_t frame, slice, buffer;
+	for (frame = 0; frame < MAX_FRAMES_IN_FLIGHT; frame++) {
+		for (slice = 0; slice < slices_size; slice++) {
+			for (buffer = frame; buffer < app->vulkan_data->gfx_command_buffers_size;
+				 buffer += MAX_FRAMES_IN_FLIGHT) {
+				vkFreeCommandBuffers(app->vulkan_data->device,
+									 app->vulkan_data->record_pools[frame * slices_size + slice],
+									 1, &app->vulkan_data->record_buffers[buffer * slices_size +
+																		  slice]);
+			}
+		}
+	}
+	free(app->vulkan_data->record_buffers);
+	app->vulkan_data->record_buffers = NULL;
+	for (buffer = 0; buffer < app->vulkan_data->gfx_command_buffers_size; buffer++) {
+		vkFreeCommandBuffers(app->vulkan_data->device,
+							 app->vulkan_data->record_pools[(buffer % MAX_FRAMES_IN_FLIGHT) *
+															slices_size],
+							 1, &app->vulkan_data->static_buffers[buffer]);
+	}
+	free(app->vulkan_data->static_buffers);
+	app->vulkan_data->static_buffers = NULL;
 	vkFreeCommandBuffers(app->vulkan_data->device, app->vulkan_data->tfr_command_pool,
 						 app->vulkan_data->tfr_command_buffers_size,
 						 app->vulkan_data->tfr_command_buffers);
 
-	// Destroy graphics pipeline
+	// Destroy graphics pipelines
 	vkDestroyPipeline(app->vulkan_data->device, app->vulkan_data->pipeline2d, NULL);
+	vkDestroyPipeline(app->vulkan_data->device, app->vulkan_data->pipeline2d_instanced, NULL);
 	// Destroy graphics pipeline layout
 	vkDestroyPipelineLayout(app->vulkan_data->device, app->vulkan_data->pipeline_layout2d, NULL);
 	// Destroy render pass
@@ -637,78 +717,94 @@ inline bool vulkan_devicesupportsextensions(VkPhysicalDevice physical_device) {
 bool vulkan_createlogicaldevice(struct Application *app) {
 	// Create set of VkDeviceQueueCreateInfos for every index in our QueueFamilies
 	app->vulkan_data->qf_indices = vulkan_getqueuefamilies(app, app->vulkan_data->physical_device);
+	struct QueueFamilies *qf_indices = &app->vulkan_data->qf_indices;
 	uint32_t queue_create_infos_size = 0;
 	VkDeviceQueueCreateInfo
 		queue_create_infos[GFX_INDICES_SIZE + PRESENT_INDICES_SIZE + TRANSFER_INDICES_SIZE] = {0};
 
-	float queue_priority = 1.0f;
+	float queue_priorities[TRANSFER_QUEUES_SIZE] = {1.0f, 1.0f, 1.0f, 1.0f};
+
+	// Family and queue count for every graphics/present/transfer index
+	uint32_t families[GFX_INDICES_SIZE + PRESENT_INDICES_SIZE + TRANSFER_INDICES_SIZE];
+	uint32_t counts[GFX_INDICES_SIZE + PRESENT_INDICES_SIZE + TRANSFER_INDICES_SIZE];
+	uint32_t families_size = 0;
 
-	// Go through every graphics/present/transfer index and add to queue_create_infos if not found
 	size_t i, j;
-	for (i = 0; i < app->vulkan_data->qf_indices.graphics_count; i++) {
-		for (j = 0; j <= queue_create_infos_size; j++) {
-			// If at end of queue_create_infos array, add new element
-			if (j == queue_create_infos_size) {
-				queue_create_infos[j].sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-				queue_create_infos[j].queueFamilyIndex =
-					app->vulkan_data->qf_indices.graphics_indices[i];
-				queue_create_infos[j].queueCount = 1;
-				queue_create_infos[j].pQueuePriorities = &queue_priority;
-				queue_create_infos_size += 1;
-				break;
-			}
-			// If match is found, go to next index
-			if (queue_create_infos[j].queueFamilyIndex ==
-				app->vulkan_data->qf_indices.graphics_indices[i]) {
-				queue_create_infos[j].queueCount++;
-				break;
-			}
-		}
+	for (i = 0; i < qf_indices->graphics_count; i++) {
+		families[families_size] = qf_indices->graphics_indices[i];
+		counts[families_size++] = 1;
+	}
+	for (i = 0; i < qf_indices->present_count; i++) {
+		families[families_size] = qf_indices->present_indices[i];
+		counts[families_size++] = 1;
 	}
-	for (i = 0; i < app->vulkan_data->qf_indices.present_count; i++) {
+	for (i = 0; i < qf_indices->transfer_count; i++) {
+		families[families_size] = qf_indices->transfer_indices[i];
+		counts[families_size++] = qf_indices->transfer_queue_count;
+	}
+
+	// Add every family to queue_create_infos once, queues are shared between roles
+	for (i = 0; i < families_size; i++) {
 		for (j = 0; j <= queue_create_infos_size; j++) {
 			// If at end of queue_create_infos array, add new element
 			if (j == queue_create_infos_size) {
 				queue_create_infos[j].sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-				queue_create_infos[j].queueFamilyIndex =
-					app->vulkan_data->qf_indices.present_indices[i];
-				queue_create_infos[j].queueCount = 1;
-				queue_create_infos[j].pQueuePriorities = &queue_priority;
+				queue_create_infos[j].queueFamilyIndex = families[i];
+				queue_create_infos[j].queueCount = counts[i];
+				queue_create_infos[j].pQueuePriorities = queue_priorities;
 				queue_create_infos_size += 1;
 				break;
 			}
-			// If match is found, go to next index
-			if (queue_create_infos[j].queueFamilyIndex ==
-				app->vulkan_data->qf_indices.present_indices[i]) {
-				queue_create_infos[j].queueCount++;
+			// If match is found, request the larger queue count
+			if (queue_create_infos[j].queueFamilyIndex == families[i]) {
+				if (queue_create_infos[j].queueCount < counts[i]) {
+					queue_create_infos[j].queueCount = counts[i];
+				}
 				break;
 			}
 		}
 	}
-	for (i = 0; i < app->vulkan_data->qf_indices.transfer_count; i++) {
-		for (j = 0; j <= queue_create_infos_size; j++) {
-			// If at the end of the queue_create_infos array, add new element
-			if (j == queue_create_infos_size) {
-				queue_create_infos[j].sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-				queue_create_infos[j].queueFamilyIndex =
-					app->vulkan_data->qf_indices.transfer_indices[i];
-				queue_create_infos[j].queueCount = 1;
-				queue_create_infos[j].pQueuePriorities = &queue_priority;
-				queue_create_infos_size += 1;
-				break;
-			}
 
-			// If match is found, go to next index
-			if (queue_create_infos[j].queueFamilyIndex ==
-				app->vulkan_data->qf_indices.transfer_indices[i]) {
-				queue_create_infos[j].queueCount++;
-				break;
-			}
-		}
+	// GPU culling needs one indirect call to draw many objects, each with its own first instance
+	VkPhysicalDeviceFeatures supported_features;
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceFeatures(app->vulkan_data->physical_device, &supported_features);
+	vkGetPhysicalDeviceProperties(app->vulkan_data->physical_device, &properties);
+
+	VkPhysicalDeviceFeatures device_features = {0};
+	device_features.multiDrawIndirect = supported_features.multiDrawIndirect;
+	device_features.drawIndirectFirstInstance = supported_features.drawIndirectFirstInstance;
+	app->vulkan_data->multi_draw_supported =
+		supported_features.multiDrawIndirect && supported_features.drawIndirectFirstInstance;
+	app->vulkan_data->max_draw_indirect_count = properties.limits.maxDrawIndirectCount;
+#ifdef OBJECT_PUSH_UBO
+	// Indirect draws can't rebind the per-draw uniform block
+	app->vulkan_data->multi_draw_supported = false;
+#endif
+	app->vulkan_data->gpu_cull_supported = app->vulkan_data->multi_draw_supported;
+
+	// Draw counts read from a buffer are optional, culled draws are kept otherwise
+	const char *draw_count_extensions[] = {VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME};
+	const char *extensions[sizeof(device_extensions) / sizeof(*device_extensions) + 1];
+	uint32_t extensions_size = sizeof(device_extensions) / sizeof(*device_extensions);
+	memcpy(extensions, device_extensions, sizeof(device_extensions));
+
+	uint32_t available_size = 0;
+	vkEnumerateDeviceExtensionProperties(app->vulkan_data->physical_device, NULL, &available_size,
+										 NULL);
+	VkExtensionProperties *available = malloc(sizeof(*available) * available_size);
+	bool draw_count = false;
+	if (available != NULL) {
+		vkEnumerateDeviceExtensionProperties(app->vulkan_data->physical_device, NULL,
+											 &available_size, available);
+		draw_count = vulkan_compareextensions(available, available_size, draw_count_extensions, 1);
+		free(available);
+	}
+	if (draw_count) {
+		extensions[extensions_size++] = draw_count_extensions[0];
 	}
 
 	// Create info passed to device creation function
-	VkPhysicalDeviceFeatures device_features = {0};
 	VkDeviceCreateInfo device_info = {0};
 
 	device_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
@@ -716,8 +812,8 @@ bool vulkan_createlogicaldevice(struct Application *app) {
 	device_info.queueCreateInfoCount = queue_create_infos_size;
 	device_info.pEnabledFeatures = &device_features;
 
-	device_info.enabledExtensionCount = sizeof(device_extensions) / sizeof(*device_extensions);
-	device_info.ppEnabledExtensionNames = device_extensions;
+	device_info.enabledExtensionCount = extensions_size;
+	device_info.ppEnabledExtensionNames = extensions;
 
 	if (enable_validation_layers) {
 		int validation_layers_size = sizeof(validation_layers) / sizeof(*validation_layers);
@@ -741,9 +837,44 @@ bool vulkan_createlogicaldevice(struct Application *app) {
 	// Get present queue
 	vkGetDeviceQueue(app->vulkan_data->device, app->vulkan_data->qf_indices.present_indices[0], 0,
 					 &app->vulkan_data->present_queue);
-	// Get transfer queue
-	vkGetDeviceQueue(app->vulkan_data->device, app->vulkan_data->qf_indices.transfer_indices[0], 0,
-					 &app->vulkan_data->transfer_queue);
+	// Get transfer queues, sharing the graphics queue if there is no dedicated family
+	if (qf_indices->transfer_dedicated) {
+		app->vulkan_data->transfer_queues_size = qf_indices->transfer_queue_count;
+		for (i = 0; i < app->vulkan_data->transfer_queues_size; i++) {
+			vkGetDeviceQueue(app->vulkan_data->device, qf_indices->transfer_indices[0], i,
+							 &app->vulkan_data->transfer_queues[i]);
+		}
+	} else {
+		app->vulkan_data->transfer_queues_size = 1;
+		app->vulkan_data->transfer_queues[0] = app->vulkan_data->graphics_queue;
+	}
+
+	printf("Using %u transfer queue(s) from %s family %u.\n",
+		   app->vulkan_data->transfer_queues_size,
+		   qf_indices->transfer_dedicated ? "dedicated" : "graphics",
+		   qf_indices->transfer_indices[0]);
+
+	// Both count entry points come from the extension or neither is used
+	app->vulkan_data->draw_indexed_indirect_count = NULL;
+	app->vulkan_data->draw_indirect_count = NULL;
+	if (draw_count) {
+		app->vulkan_data->draw_indexed_indirect_count =
+			(PFN_vkCmdDrawIndexedIndirectCountKHR)vkGetDeviceProcAddr(
+				app->vulkan_data->device, "vkCmdDrawIndexedIndirectCountKHR");
+		app->vulkan_data->draw_indirect_count = (PFN_vkCmdDrawIndirectCountKHR)vkGetDeviceProcAddr(
+			app->vulkan_data->device, "vkCmdDrawIndirectCountKHR");
+		if (app->vulkan_data->draw_indexed_indirect_count == NULL ||
+			app->vulkan_data->draw_indirect_count == NULL) {
+			app->vulkan_data->draw_indexed_indirect_count = NULL;
+			app->vulkan_data->draw_indirect_count = NULL;
+		}
+	}
+
+	printf("GPU culling %s%s.\n",
+		   app->vulkan_data->gpu_cull_supported ? "available" : "unavailable",
+		   (app->vulkan_data->gpu_cull_supported && app->vulkan_data->draw_indirect_count == NULL)
+			   ? " without draw counts"
+			   : "");
 
 	return true;
 }
@@ -844,6 +975,8 @@ bool vulkan_recreateswapchain(struct Application *app) {
 		return false;
 	}
 
+	// New framebuffers and extent, nothing recorded before can be reused
+	atomic_fetch_add(&app->object_group->generation, 1);
 	return true;
 }
 
@@ -1023,6 +1156,177 @@ bool vulkan_createshaders(struct Application *app) {
 	return true;
 }
 
+/*
+	Transform buffer layout and the cull pass layout, with one set of each per frame in flight.
+	Buffers are attached on first use.
+*/
+bool vulkan_createdescriptors(struct Application *app) {
+	VkDescriptorSetLayoutBinding bindings[3] = {0};
+	uint32_t bindings_size = 2;
+	bindings[0].binding = 0;
+	bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	bindings[0].descriptorCount = 1;
+	bindings[0].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
+	// Cull data, holding the tint of indirect draws
+	bindings[1].binding = 2;
+	bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	bindings[1].descriptorCount = 1;
+	bindings[1].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
+#ifdef OBJECT_PUSH_UBO
+	// Per-draw block in place of push constants
+	bindings[2].binding = 1;
+	bindings[2].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	bindings[2].descriptorCount = 1;
+	bindings[2].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+	bindings_size = 3;
+#endif
+
+	VkDescriptorSetLayoutCreateInfo layout_info = {0};
+	layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layout_info.bindingCount = bindings_size;
+	layout_info.pBindings = bindings;
+
+	VkResult ret = vkCreateDescriptorSetLayout(app->vulkan_data->device, &layout_info, NULL,
+											   &app->vulkan_data->transform_set_layout);
+	if (ret != VK_SUCCESS) {
+		fprintf(stderr, "Failure to create transform descriptor set layout.\n");
+		return false;
+	}
+
+	// Cull pass reads objects & batches, writes commands & counts, in enum CullBuffer order
+	VkDescriptorSetLayoutBinding cull_bindings[NUM_CULL_BUFFERS] = {0};
+	uint32_t i;
+	for (i = 0; i < NUM_CULL_BUFFERS; i++) {
+		cull_bindings[i].binding = i;
+		cull_bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		cull_bindings[i].descriptorCount = 1;
+		cull_bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	}
+
+	layout_info.bindingCount = NUM_CULL_BUFFERS;
+	layout_info.pBindings = cull_bindings;
+
+	ret = vkCreateDescriptorSetLayout(app->vulkan_data->device, &layout_info, NULL,
+									  &app->vulkan_data->cull_set_layout);
+	if (ret != VK_SUCCESS) {
+		fprintf(stderr, "Failure to create cull descriptor set layout.\n");
+		return false;
+	}
+
+	VkDescriptorPoolSize pool_sizes[2] = {0};
+	uint32_t pool_sizes_size = 1;
+	pool_sizes[0].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	pool_sizes[0].descriptorCount = MAX_FRAMES_IN_FLIGHT * (2 + NUM_CULL_BUFFERS);
+#ifdef OBJECT_PUSH_UBO
+	pool_sizes[1].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	pool_sizes[1].descriptorCount = MAX_FRAMES_IN_FLIGHT;
+	pool_sizes_size = 2;
+#endif
+
+	VkDescriptorPoolCreateInfo pool_info = {0};
+	pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	pool_info.poolSizeCount = pool_sizes_size;
+	pool_info.pPoolSizes = pool_sizes;
+	pool_info.maxSets = MAX_FRAMES_IN_FLIGHT * 2;
+
+	ret = vkCreateDescriptorPool(app->vulkan_data->device, &pool_info, NULL,
+								 &app->vulkan_data->descriptor_pool);
+	if (ret != VK_SUCCESS) {
+		fprintf(stderr, "Failure to create descriptor pool.\n");
+		return false;
+	}
+
+	VkDescriptorSetLayout layouts[MAX_FRAMES_IN_FLIGHT], cull_layouts[MAX_FRAMES_IN_FLIGHT];
+	uint32_t j;
+	for (i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+		layouts[i] = app->vulkan_data->transform_set_layout;
+		cull_layouts[i] = app->vulkan_data->cull_set_layout;
+		app->vulkan_data->transform_buffers[i] = NULL;
+		app->vulkan_data->transform_maps[i] = NULL;
+		app->vulkan_data->transform_capacity[i] = 0;
+		app->vulkan_data->cull_counts_size[i] = 0;
+		for (j = 0; j < NUM_CULL_BUFFERS; j++) {
+			app->vulkan_data->cull_buffers[i][j] = NULL;
+			app->vulkan_data->cull_maps[i][j] = NULL;
+			app->vulkan_data->cull_capacity[i][j] = 0;
+		}
+#ifdef OBJECT_PUSH_UBO
+		app->vulkan_data->push_buffers[i] = NULL;
+		app->vulkan_data->push_maps[i] = NULL;
+		app->vulkan_data->push_capacity[i] = 0;
+#endif
+	}
+
+#ifdef OBJECT_PUSH_UBO
+	// Blocks are spaced by the device's dynamic offset alignment
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(app->vulkan_data->physical_device, &properties);
+	VkDeviceSize alignment = properties.limits.minUniformBufferOffsetAlignment;
+	app->vulkan_data->push_stride = (OBJECT_PUSH_SIZE + alignment - 1) / alignment * alignment;
+#endif
+
+	VkDescriptorSetAllocateInfo alloc_info = {0};
+	alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	alloc_info.descriptorPool = app->vulkan_data->descriptor_pool;
+	alloc_info.descriptorSetCount = MAX_FRAMES_IN_FLIGHT;
+	alloc_info.pSetLayouts = layouts;
+
+	ret = vkAllocateDescriptorSets(app->vulkan_data->device, &alloc_info,
+								   app->vulkan_data->transform_sets);
+	if (ret != VK_SUCCESS) {
+		fprintf(stderr, "Failure to allocate transform descriptor sets.\n");
+		return false;
+	}
+
+	alloc_info.pSetLayouts = cull_layouts;
+	ret = vkAllocateDescriptorSets(app->vulkan_data->device, &alloc_info,
+								   app->vulkan_data->cull_sets);
+	if (ret != VK_SUCCESS) {
+		fprintf(stderr, "Failure to allocate cull descriptor sets.\n");
+		return false;
+	}
+
+	return true;
+}
+
+// Layout shared by the 2D and 3D pipelines: transform set plus the per-draw push block
+bool vulkan_createpipelinelayout(struct Application *app, VkPipelineLayout *layout) {
+	VkPipelineLayoutCreateInfo pipeline_layout_info = {0};
+	pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipeline_layout_info.setLayoutCount = 1;
+	pipeline_layout_info.pSetLayouts = &app->vulkan_data->transform_set_layout;
+
+#ifndef OBJECT_PUSH_UBO
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(app->vulkan_data->physical_device, &properties);
+	if (properties.limits.maxPushConstantsSize < OBJECT_PUSH_SIZE) {
+		fprintf(stderr, "Device push constant space too small for per-draw block.\n");
+		return false;
+	}
+
+	VkPushConstantRange push_range = {0};
+	push_range.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+	push_range.offset = 0;
+	push_range.size = OBJECT_PUSH_SIZE;
+
+	pipeline_layout_info.pushConstantRangeCount = 1;
+	pipeline_layout_info.pPushConstantRanges = &push_range;
+#else
+	pipeline_layout_info.pushConstantRangeCount = 0;
+#endif
+
+	VkResult ret = vkCreatePipelineLayout(app->vulkan_data->device, &pipeline_layout_info, NULL,
+										  layout);
+	if (ret != VK_SUCCESS) {
+		fprintf(stderr, "Failure to create graphics pipeline layout.\n");
+		return false;
+	}
+
+	return true;
+}
+
 bool vulkan_create2Dpipeline(struct Application *app) {
 	// Allocate shader stages
 	VkPipelineShaderStageCreateInfo *shader_stages = calloc(2, sizeof(*shader_stages));
@@ -1136,15 +1440,7 @@ bool vulkan_create2Dpipeline(struct Application *app) {
 	colorblending.blendConstants[2] = 0.0f;
 	colorblending.blendConstants[3] = 0.0f;
 
-	VkPipelineLayoutCreateInfo pipeline_layout_info = {0};
-	pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-	pipeline_layout_info.setLayoutCount = 0;
-	pipeline_layout_info.pushConstantRangeCount = 0;
-
-	VkResult ret = vkCreatePipelineLayout(app->vulkan_data->device, &pipeline_layout_info, NULL,
-										  &app->vulkan_data->pipeline_layout2d);
-	if (ret != VK_SUCCESS) {
-		fprintf(stderr, "Failure to create graphics pipeline layout.\n");
+	if (vulkan_createpipelinelayout(app, &app->vulkan_data->pipeline_layout2d) == false) {
 		return false;
 	}
 
@@ -1168,13 +1464,51 @@ bool vulkan_create2Dpipeline(struct Application *app) {
 	pipeline_info.basePipelineHandle = NULL;
 	pipeline_info.basePipelineIndex = -1;
 
-	ret = vkCreateGraphicsPipelines(app->vulkan_data->device, NULL, 1, &pipeline_info, NULL,
-									&app->vulkan_data->pipeline2d);
+	VkResult ret = vkCreateGraphicsPipelines(app->vulkan_data->device, NULL, 1, &pipeline_info,
+											 NULL, &app->vulkan_data->pipeline2d);
 	if (ret != VK_SUCCESS) {
 		fprintf(stderr, "Failure to create graphics pipeline.\n");
 		return false;
 	}
 
+	// Instanced variant reads each instance's transform slot from a second binding
+	VkVertexInputBindingDescription instance_binding_descs[2] = {
+		binding_desc, vertex_getinstancebindingdescription()};
+	uint32_t instance_attr_size = 0;
+
+	vertex_getinstanceattributedescriptions(&instance_attr_size, NULL);
+	VkVertexInputAttributeDescription *instance_attr_descs =
+		malloc(sizeof(*instance_attr_descs) * (attr_size + instance_attr_size));
+	if (instance_attr_descs == NULL) {
+		fprintf(stderr, "Failed to allocate memory.\n");
+		vkDestroyPipeline(app->vulkan_data->device, app->vulkan_data->pipeline2d, NULL);
+		app->vulkan_data->pipeline2d = VK_NULL_HANDLE;
+		free(attr_descs);
+		free(shader_stages);
+		return false;
+	}
+
+	memcpy(instance_attr_descs, attr_descs, sizeof(*attr_descs) * attr_size);
+	vertex_getinstanceattributedescriptions(&instance_attr_size, instance_attr_descs + attr_size);
+
+	vertex_input_info.vertexBindingDescriptionCount = 2;
+	vertex_input_info.pVertexBindingDescriptions = instance_binding_descs;
+	vertex_input_info.vertexAttributeDescriptionCount = attr_size + instance_attr_size;
+	vertex_input_info.pVertexAttributeDescriptions = instance_attr_descs;
+	shader_stages[0].module = app->vulkan_data->shadercache[VERTEX_SHADER_2D_INSTANCED];
+
+	ret = vkCreateGraphicsPipelines(app->vulkan_data->device, NULL, 1, &pipeline_info, NULL,
+									&app->vulkan_data->pipeline2d_instanced);
+	free(instance_attr_descs);
+	if (ret != VK_SUCCESS) {
+		fprintf(stderr, "Failure to create instanced graphics pipeline.\n");
+		vkDestroyPipeline(app->vulkan_data->device, app->vulkan_data->pipeline2d, NULL);
+		app->vulkan_data->pipeline2d = VK_NULL_HANDLE;
+		free(attr_descs);
+		free(shader_stages);
+		return false;
+	}
+
 	// Free vertex descriptions
 	free(attr_descs);
 
@@ -1183,6 +1517,53 @@ bool vulkan_create2Dpipeline(struct Application *app) {
 	return true;
 }
 
+// Compute pipeline of the GPU cull pass, not created on devices that can't use it
+bool vulkan_createcullpipeline(struct Application *app) {
+	app->vulkan_data->cull_pipeline_layout = VK_NULL_HANDLE;
+	app->vulkan_data->cull_pipeline = VK_NULL_HANDLE;
+	if (app->vulkan_data->gpu_cull_supported == false) {
+		return true;
+	}
+
+	VkPushConstantRange push_range = {0};
+	push_range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	push_range.offset = 0;
+	push_range.size = sizeof(struct VulkanCullPush);
+
+	VkPipelineLayoutCreateInfo layout_info = {0};
+	layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	layout_info.setLayoutCount = 1;
+	layout_info.pSetLayouts = &app->vulkan_data->cull_set_layout;
+	layout_info.pushConstantRangeCount = 1;
+	layout_info.pPushConstantRanges = &push_range;
+
+	VkResult ret = vkCreatePipelineLayout(app->vulkan_data->device, &layout_info, NULL,
+										  &app->vulkan_data->cull_pipeline_layout);
+	if (ret != VK_SUCCESS) {
+		fprintf(stderr, "Failure to create cull pipeline layout.\n");
+		return false;
+	}
+
+	VkComputePipelineCreateInfo pipeline_info = {0};
+	pipeline_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipeline_info.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	pipeline_info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	pipeline_info.stage.module = app->vulkan_data->shadercache[COMPUTE_SHADER_CULL];
+	pipeline_info.stage.pName = "main";
+	pipeline_info.layout = app->vulkan_data->cull_pipeline_layout;
+	pipeline_info.basePipelineHandle = NULL;
+	pipeline_info.basePipelineIndex = -1;
+
+	ret = vkCreateComputePipelines(app->vulkan_data->device, NULL, 1, &pipeline_info, NULL,
+								   &app->vulkan_data->cull_pipeline);
+	if (ret != VK_SUCCESS) {
+		fprintf(stderr, "Failure to create cull pipeline.\n");
+		return false;
+	}
+
+	return true;
+}
+
 bool vulkan_createframebuffers(struct Application *app) {
 	app->vulkan_data->swapchain_framebuffers_size = app->vulkan_data->swapchain_imageviews_size;
 	app->vulkan_data->swapchain_framebuffers =
@@ -1243,15 +1624,57 @@ bool vulkan_createcommandpools(struct Application *app) {
 		return false;
 	}
 
+	// Pools for secondary buffers, a pool may only be used by one thread at a time
+	uint32_t slices_size = 1;
+	if (app->thread_pool != NULL) {
+		slices_size = threadpool_slicecount(app->thread_pool);
+	}
+	app->vulkan_data->record_slices_size = 0;
+	app->vulkan_data->record_pools =
+		malloc(sizeof(*app->vulkan_data->record_pools) * MAX_FRAMES_IN_FLIGHT * slices_size);
+	if (app->vulkan_data->record_pools == NULL) {
+		fprintf(stderr, "Failure to allocate recording command pools.\n");
+		return false;
+	}
+
+	uint32_t i;
+	for (i = 0; i < MAX_FRAMES_IN_FLIGHT * slices_size; i++) {
+		ret = vkCreateCommandPool(app->vulkan_data->device, &gfx_pool_info, NULL,
+								  &app->vulkan_data->record_pools[i]);
+		if (ret != VK_SUCCESS) {
+			fprintf(stderr, "Failed to create recording command pool.\n");
+			return false;
+		}
+	}
+	app->vulkan_data->record_slices_size = slices_size;
+
+	// Update buffers outlive swapchain recreation, pending updates are kept across it
+	VkCommandBufferAllocateInfo update_alloc_info = {0};
+	update_alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	update_alloc_info.commandPool = app->vulkan_data->gfx_command_pool;
+	update_alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	update_alloc_info.commandBufferCount = MAX_FRAMES_IN_FLIGHT;
+
+	ret = vkAllocateCommandBuffers(app->vulkan_data->device, &update_alloc_info,
+								   app->vulkan_data->update_buffers);
+	if (ret != VK_SUCCESS) {
+		fprintf(stderr, "Failure to allocate update command buffers.\n");
+		return false;
+	}
+	app->vulkan_data->update_pending = false;
+
 	return true;
 }
 
 bool vulkan_createcommandbuffers(struct Application *app) {
-	// Create one graphics command buffer per swapchain framebuffer
-	app->vulkan_data->gfx_command_buffers_size = app->vulkan_data->swapchain_framebuffers_size;
+	// Create one graphics command buffer per swapchain framebuffer and frame in flight
+	app->vulkan_data->gfx_command_buffers_size =
+		app->vulkan_data->swapchain_framebuffers_size * MAX_FRAMES_IN_FLIGHT;
 	app->vulkan_data->gfx_command_buffers = malloc(sizeof(*app->vulkan_data->gfx_command_buffers) *
 												   app->vulkan_data->gfx_command_buffers_size);
-	if (app->vulkan_data->gfx_command_buffers == NULL) {
+	app->vulkan_data->gfx_recordings = calloc(app->vulkan_data->gfx_command_buffers_size,
+											  sizeof(*app->vulkan_data->gfx_recordings));
+	if (app->vulkan_data->gfx_command_buffers == NULL || app->vulkan_data->gfx_recordings == NULL) {
 		fprintf(stderr, "Failure to allocate command buffers array.\n");
 		return false;
 	}
@@ -1270,8 +1693,57 @@ bool vulkan_createcommandbuffers(struct Application *app) {
 		return false;
 	}
 
-	// Allocate transfer command buffers
-	app->vulkan_data->tfr_command_buffers_size = 1;
+	// Secondary buffers of each graphics command buffer, from the pools of its frame in flight
+	uint32_t slices_size = app->vulkan_data->record_slices_size;
+	app->vulkan_data->record_buffers = malloc(sizeof(*app->vulkan_data->record_buffers) *
+											  app->vulkan_data->gfx_command_buffers_size *
+											  slices_size);
+	if (app->vulkan_data->record_buffers == NULL) {
+		fprintf(stderr, "Failure to allocate secondary command buffers array.\n");
+		return false;
+	}
+
+	VkCommandBufferAllocateInfo record_alloc_info = {0};
+	record_alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	record_alloc_info.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+	record_alloc_info.commandBufferCount = 1;
+
+	uint32_t buffer, slice;
+	for (buffer = 0; buffer < app->vulkan_data->gfx_command_buffers_size; buffer++) {
+		for (slice = 0; slice < slices_size; slice++) {
+			record_alloc_info.commandPool =
+				app->vulkan_data
+					->record_pools[(buffer % MAX_FRAMES_IN_FLIGHT) * slices_size + slice];
+			ret = vkAllocateCommandBuffers(
+				app->vulkan_data->device, &record_alloc_info,
+				&app->vulkan_data->record_buffers[buffer * slices_size + slice]);
+			if (ret != VK_SUCCESS) {
+				fprintf(stderr, "Failure to allocate secondary command buffers.\n");
+				return false;
+			}
+		}
+	}
+
+	app->vulkan_data->static_buffers = malloc(sizeof(*app->vulkan_data->static_buffers) *
+											  app->vulkan_data->gfx_command_buffers_size);
+	if (app->vulkan_data->static_buffers == NULL) {
+		fprintf(stderr, "Failure to allocate static command buffers array.\n");
+		return false;
+	}
+
+	for (buffer = 0; buffer < app->vulkan_data->gfx_command_buffers_size; buffer++) {
+		record_alloc_info.commandPool =
+			app->vulkan_data->record_pools[(buffer % MAX_FRAMES_IN_FLIGHT) * slices_size];
+		ret = vkAllocateCommandBuffers(app->vulkan_data->device, &record_alloc_info,
+									   &app->vulkan_data->static_buffers[buffer]);
+		if (ret != VK_SUCCESS) {
+			fprintf(stderr, "Failure to allocate static command buffers.\n");
+			return false;
+		}
+	}
+
+	// Allocate one transfer command buffer per transfer queue
+	app->vulkan_data->tfr_command_buffers_size = app->vulkan_data->transfer_queues_size;
 	app->vulkan_data->tfr_command_buffers = malloc(sizeof(*app->vulkan_data->tfr_command_buffers) *
 												   app->vulkan_data->tfr_command_buffers_size);
 	if (app->vulkan_data->tfr_command_buffers == NULL) {
@@ -1295,8 +1767,82 @@ bool vulkan_createcommandbuffers(struct Application *app) {
 	return true;
 }
 
-bool vulkan_recordobjgrp(struct Application *app, VkCommandBuffer buff, VkFramebuffer frame,
+/*
+	Picks the command buffer of a framebuffer for the current frame and records it only if the
+	object group changed since it was last recorded, or the frame switched between CPU and GPU
+	culling. Unchanged scenes submit the cached buffer without touching the draw list. When only
+	dynamic objects changed and none moved beneath a static draw, static draws are left out of
+	the draw list and their secondary buffer is executed again.
+*/
+bool vulkan_recordframe(struct Application *app, uint32_t image_index, bool gpu_cull) {
+	uint32_t slot = image_index * MAX_FRAMES_IN_FLIGHT + app->vulkan_data->current_frame;
+	struct VulkanRecording *recording = &app->vulkan_data->gfx_recordings[slot];
+	struct FrameStats *stats = &app->vulkan_data->frame_stats;
+	struct ObjectGroup *obj_grp = app->object_group;
+
+	// Read before recording, so changes made meanwhile are caught by the next frame
+	uint64_t generation = atomic_load(&obj_grp->generation);
+	uint64_t draw_generation = atomic_load(&obj_grp->draw_generation);
+	uint64_t static_generation = atomic_load(&obj_grp->static_generation);
+
+	stats->recorded = false;
+	bool statics_current = recording->valid && recording->gpu_cull == gpu_cull &&
+						   recording->generation == generation &&
+						   recording->static_generation == static_generation;
+	if (statics_current && (gpu_cull || recording->draw_generation == draw_generation)) {
+		return true;
+	}
+
+	recording->valid = false;
+	recording->statics_valid = recording->statics_valid && statics_current && gpu_cull == false;
+	if (gpu_cull == false) {
+		bool ret = vulkan_builddrawlist(app, obj_grp, recording->statics_valid == false);
+
+		// A dynamic draw moved beneath the recorded statics, so they are listed with it again
+		if (ret && recording->statics_valid && recording->statics_size > 0 &&
+			recording->static_order >= app->vulkan_data->draw_dynamic_order) {
+			recording->statics_valid = false;
+			ret = vulkan_builddrawlist(app, obj_grp, true);
+		}
+		if (ret == false) {
+			fprintf(stderr, "Failure to sort object draws.\n");
+			return false;
+		}
+	}
+	if (vulkan_recordobjgrp(app, slot, image_index, obj_grp) == false) {
+		return false;
+	}
+
+	recording->generation = generation;
+	recording->draw_generation = draw_generation;
+	recording->static_generation = static_generation;
+	recording->gpu_cull = gpu_cull;
+	recording->valid = true;
+	stats->recorded = true;
+	stats->frames_recorded++;
+	return true;
+}
+
+bool vulkan_recordobjgrp(struct Application *app, uint32_t slot, uint32_t image_index,
 						 struct ObjectGroup *obj_grp) {
+	VkCommandBuffer buff = app->vulkan_data->gfx_command_buffers[slot];
+	struct VulkanRecording *recording = &app->vulkan_data->gfx_recordings[slot];
+	struct FrameStats *stats = &app->vulkan_data->frame_stats;
+	bool gpu_cull = app->vulkan_data->cull_counts_size[app->vulkan_data->current_frame] > 0;
+
+	// Static draws lead the draw list only when their buffer has to be recorded again
+	size_t first = app->vulkan_data->draw_statics_size;
+	if (gpu_cull == false && recording->statics_valid == false &&
+		vulkan_recordstatics(app, slot, image_index) == false) {
+		return false;
+	}
+
+	if (gpu_cull == false &&
+		vulkan_reservestreams(app, &recording->streams,
+							  app->vulkan_data->draw_list_size - first) == false) {
+		return false;
+	}
+
 	VkCommandBufferBeginInfo begin_info = {0};
 	begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
 
@@ -1310,10 +1856,15 @@ bool vulkan_recordobjgrp(struct Application *app, VkCommandBuffer buff, VkFrameb
 		return false;
 	}
 
+	// Cull pass writes this frame's indirect commands before the render pass draws them
+	if (gpu_cull) {
+		vulkan_recordgpucull(app, buff, obj_grp);
+	}
+
 	VkRenderPassBeginInfo renderpass_info = {0};
 	renderpass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
 	renderpass_info.renderPass = app->vulkan_data->render_pass;
-	renderpass_info.framebuffer = frame;
+	renderpass_info.framebuffer = app->vulkan_data->swapchain_framebuffers[image_index];
 	renderpass_info.renderArea.offset = (VkOffset2D){0, 0};
 	renderpass_info.renderArea.extent = app->vulkan_data->swapchain_extent;
 
@@ -1321,36 +1872,50 @@ bool vulkan_recordobjgrp(struct Application *app, VkCommandBuffer buff, VkFrameb
 	renderpass_info.clearValueCount = 1;
 	renderpass_info.pClearValues = &clear_color;
 
-	vkCmdBeginRenderPass(buff, &renderpass_info, VK_SUBPASS_CONTENTS_INLINE);
-
-	struct EngineObjectAllocation *curr = NULL;
-
-	uint32_t i;
-	for (i = 0; i < NUM_PIPELINES; i++) {
-		curr = obj_grp->pipelines[i].allocations;
-		if (curr == NULL) {
-			continue;
+	// Long dynamic draw lists are split over the thread pool, one secondary buffer per slice
+	bool statics = gpu_cull == false && recording->statics_size > 0;
+	bool parallel = gpu_cull == false && app->vulkan_data->record_slices_size > 1 &&
+					app->vulkan_data->draw_list_size - first >= VULKAN_PARALLEL_RECORD_THRESHOLD;
+	vkCmdBeginRenderPass(buff, &renderpass_info,
+						 (statics || parallel) ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS
+											   : VK_SUBPASS_CONTENTS_INLINE);
+
+	bool success = true;
+	if (statics || parallel) {
+		if (statics) {
+			vkCmdExecuteCommands(buff, 1, &app->vulkan_data->static_buffers[slot]);
 		}
+		success = vulkan_recordsecondaries(app, buff, slot, image_index, first, parallel);
+		stats->binds_issued += recording->static_counts.binds_issued;
+		stats->binds_skipped += recording->static_counts.binds_skipped;
+		stats->draws_merged += recording->static_counts.draws_merged;
+		stats->draws_instanced += recording->static_counts.draws_instanced;
+	} else if (gpu_cull) {
+		VkPipelineLayout layout;
+		uint32_t i;
+		for (i = 0; i < NUM_PIPELINES; i++) {
+			if (obj_grp->pipelines[i].objects_size == 0) {
+				continue;
+			}
 
-		switch (i) {
-			case NO_PIPELINE:
-				break;
-			case PIPELINE_2D:
-				vkCmdBindPipeline(buff, VK_PIPELINE_BIND_POINT_GRAPHICS,
-								  app->vulkan_data->pipeline2d);
-
-				vulkan_recordallocationlist(app, buff, curr);
-				break;
-			case PIPELINE_3D:
-				break;
-			default:
-				break;
+			layout = vulkan_bindpipeline(app, buff, i, false);
+			if (layout != VK_NULL_HANDLE) {
+				vulkan_recordbatches(app, buff, layout, obj_grp, i);
+			}
 		}
+	} else {
+		struct VulkanRecordSlice counts = {0};
+		vulkan_recorddrawlist(app, buff, &recording->streams, 0, 0,
+							  app->vulkan_data->draw_list_size, &counts);
+		stats->binds_issued = counts.binds_issued;
+		stats->binds_skipped = counts.binds_skipped;
+		stats->draws_merged = counts.draws_merged;
+		stats->draws_instanced = counts.draws_instanced;
 	}
 
 	vkCmdEndRenderPass(buff);
 	ret = vkEndCommandBuffer(buff);
-	if (ret != VK_SUCCESS) {
+	if (ret != VK_SUCCESS || success == false) {
 		fprintf(stderr, "Failed to record command buffer.\n");
 		return false;
 	}
@@ -1358,48 +1923,622 @@ bool vulkan_recordobjgrp(struct Application *app, VkCommandBuffer buff, VkFrameb
 	return true;
 }
 
-void vulkan_recordallocationlist(struct Application *app, VkCommandBuffer buff,
-								 struct EngineObjectAllocation *curr) {
-	size_t i;
+/*
+	Records the static draws at the front of the draw list into the static buffer of a graphics
+	command buffer, where they stay until a static object changes. Statics interleaved with dynamic
+	draws are recorded along with them, leaving the static buffer out of date.
+*/
+bool vulkan_recordstatics(struct Application *app, uint32_t slot, uint32_t image_index) {
+	struct VulkanRecording *recording = &app->vulkan_data->gfx_recordings[slot];
+	size_t size = app->vulkan_data->draw_statics_size;
+
+	recording->statics_size = 0;
+	recording->static_counts = (struct VulkanRecordSlice){0};
+	if (app->vulkan_data->draw_statics_split == false) {
+		return true;
+	}
+	if (size > 0) {
+		struct VulkanRecordJob job = {0};
+		job.app = app;
+		job.buffers = &app->vulkan_data->static_buffers[slot];
+		job.framebuffer = app->vulkan_data->swapchain_framebuffers[image_index];
+		job.streams = &recording->static_streams;
+		if (vulkan_reservestreams(app, job.streams, size) == false) {
+			return false;
+		}
+		vulkan_recordslice(&job, 0, size, 0);
+		if (job.slices[0].failed) {
+			fprintf(stderr, "Failed to record static command buffer.\n");
+			return false;
+		}
+		recording->statics_size = size;
+		recording->static_counts = job.slices[0];
+	}
 
-	while (curr != NULL) {
-		for (i = 0; i < curr->objects_size; i++) {
-			VkDeviceSize offset = 0;
-			vkCmdBindVertexBuffers(buff, 0, 1, &curr->objects[i].render_data.vi_buffer->buffer,
-								   &offset);
-			vkCmdDraw(buff, curr->objects[i].render_data.vertices_size, 1, 0, 0);
-			// printf("Vertex buffer: %p\n", curr->objects[i].render_data.vi_buffer->buffer);
-			// printf("Vertex size: %llu\n", curr->objects[i].render_data.vertices_size);
+	recording->static_order = app->vulkan_data->draw_static_order;
+	recording->statics_valid = true;
+	return true;
+}
+
+/*
+	Records the draw list from entry 'first' on into the secondary buffers of a graphics command
+	buffer, then executes them in list order. In parallel each slice of the thread pool takes a
+	contiguous range, otherwise the first slice's buffer takes all of it. Every slice binds its
+	own state, so the binds saved are counted per slice.
+*/
+bool vulkan_recordsecondaries(struct Application *app, VkCommandBuffer buff, uint32_t slot,
+							  uint32_t image_index, size_t first, bool parallel) {
+	struct FrameStats *stats = &app->vulkan_data->frame_stats;
+	struct VulkanRecording *recording = &app->vulkan_data->gfx_recordings[slot];
+	uint32_t slices_size = parallel ? app->vulkan_data->record_slices_size : 1;
+	size_t size = app->vulkan_data->draw_list_size - first;
+
+	struct VulkanRecordJob job = {0};
+	job.app = app;
+	job.buffers = &app->vulkan_data->record_buffers[slot * app->vulkan_data->record_slices_size];
+	job.framebuffer = app->vulkan_data->swapchain_framebuffers[image_index];
+	job.streams = &recording->streams;
+	job.first = first;
+	if (parallel) {
+		threadpool_dispatch(app->thread_pool, vulkan_recordslice, &job, size);
+	} else if (size > 0) {
+		vulkan_recordslice(&job, 0, size, 0);
+	}
+
+	// Empty slices are never called, so only the non-empty ranges have a recording
+	VkCommandBuffer executed[VULKAN_MAX_RECORD_SLICES];
+	uint32_t k, executed_size = 0;
+	size_t start, end;
+	bool success = true;
+
+	stats->binds_issued = 0;
+	stats->binds_skipped = 0;
+	stats->draws_merged = 0;
+	stats->draws_instanced = 0;
+	for (k = 0; k < slices_size; k++) {
+		threadpool_slicerange(size, k, slices_size, &start, &end);
+		if (start == end) {
+			continue;
+		}
+		if (job.slices[k].failed) {
+			success = false;
+			continue;
 		}
+		executed[executed_size++] = job.buffers[k];
+		stats->binds_issued += job.slices[k].binds_issued;
+		stats->binds_skipped += job.slices[k].binds_skipped;
+		stats->draws_merged += job.slices[k].draws_merged;
+		stats->draws_instanced += job.slices[k].draws_instanced;
+	}
 
-		curr = curr->next;
+	if (success && executed_size > 0) {
+		vkCmdExecuteCommands(buff, executed_size, executed);
 	}
+	return success;
 }
 
-/* bool vulkan_recorddrawcommands(struct Application *app, VkCommandBuffer buff, VkFramebuffer
-frame, struct RenderGroup *render_group) { VkCommandBufferBeginInfo begin_info = {0};
-	begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+// Records one slice of the draw list into its secondary buffer, called from the thread pool.
+// Ranges are relative to the job's first entry
+void vulkan_recordslice(void *ctx, size_t start, size_t end, uint32_t slice) {
+	struct VulkanRecordJob *job = ctx;
+	struct VulkanRecordSlice *counts = &job->slices[slice];
+	VkCommandBuffer buff = job->buffers[slice];
 
-	// Reset command buffer
-	VkCommandBufferResetFlagBits reset_bits = 0;
-	vkResetCommandBuffer(buff, reset_bits);
+	VkCommandBufferInheritanceInfo inheritance_info = {0};
+	inheritance_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+	inheritance_info.renderPass = job->app->vulkan_data->render_pass;
+	inheritance_info.subpass = 0;
+	inheritance_info.framebuffer = job->framebuffer;
 
-	VkResult ret = vkBeginCommandBuffer(buff, &begin_info);
-	if (ret != VK_SUCCESS) {
-		fprintf(stderr, "Failure to begin recording to command buffer.\n");
-		return false;
+	VkCommandBufferBeginInfo begin_info = {0};
+	begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	begin_info.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+	begin_info.pInheritanceInfo = &inheritance_info;
+
+	vkResetCommandBuffer(buff, 0);
+	if (vkBeginCommandBuffer(buff, &begin_info) != VK_SUCCESS) {
+		counts->failed = true;
+		return;
 	}
 
-	VkRenderPassBeginInfo renderpass_info = {0};
-	renderpass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-	renderpass_info.renderPass = app->vulkan_data->render_pass;
-	renderpass_info.framebuffer = frame;
-	renderpass_info.renderArea.offset = (VkOffset2D){0, 0};
-	renderpass_info.renderArea.extent = app->vulkan_data->swapchain_extent;
+	vulkan_recorddrawlist(job->app, buff, job->streams, job->first, job->first + start,
+						  job->first + end, counts);
 
-	VkClearValue clear_color = {{{0.0f, 0.0f, 0.0f, 1.0f}}};
-	renderpass_info.clearValueCount = 1;
-	renderpass_info.pClearValues = &clear_color;
+	if (vkEndCommandBuffer(buff) != VK_SUCCESS) {
+		counts->failed = true;
+	}
+}
+
+/*
+	Binds a pipeline, or its instanced variant, and its set for the frame. Returns its layout or
+	NULL if it can't draw yet.
+*/
+VkPipelineLayout vulkan_bindpipeline(struct Application *app, VkCommandBuffer buff,
+									 enum PipelineType pltype, bool instanced) {
+	switch (pltype) {
+		case PIPELINE_2D:
+			vkCmdBindPipeline(buff, VK_PIPELINE_BIND_POINT_GRAPHICS,
+							  instanced ? app->vulkan_data->pipeline2d_instanced
+										: app->vulkan_data->pipeline2d);
+#ifndef OBJECT_PUSH_UBO
+			// Per-draw data goes in push constants, the set is bound once
+			vkCmdBindDescriptorSets(
+				buff, VK_PIPELINE_BIND_POINT_GRAPHICS, app->vulkan_data->pipeline_layout2d, 0, 1,
+				&app->vulkan_data->transform_sets[app->vulkan_data->current_frame], 0, NULL);
+#else
+			// Instances read no per-draw block, any offset does
+			if (instanced) {
+				uint32_t offset = 0;
+				vkCmdBindDescriptorSets(
+					buff, VK_PIPELINE_BIND_POINT_GRAPHICS, app->vulkan_data->pipeline_layout2d, 0,
+					1, &app->vulkan_data->transform_sets[app->vulkan_data->current_frame], 1,
+					&offset);
+			}
+#endif
+			return app->vulkan_data->pipeline_layout2d;
+		default:
+			return VK_NULL_HANDLE;
+	}
+}
+
+/*
+	Records entries 'start' to 'end' of the frame's sorted draw list. Shared buffers are bound
+	once at offset 0 and each mesh is drawn from its own first vertex and index. Pipelines and
+	buffers are only bound when they differ from the previous draw's, the buffer binds this saves
+	are counted in 'counts'. Stream entries are indexed by draw list entry, entry 'first' at 0.
+
+	Runs of VULKAN_INSTANCE_MIN or more copies of a 2D mesh are drawn as instances, their transform
+	slots written to the instance stream. With multi-draw support, runs of VULKAN_MULTI_DRAW_MIN or
+	more other draws on the same bindings are written to the command stream and drawn by one
+	indirect call.
+*/
+void vulkan_recorddrawlist(struct Application *app, VkCommandBuffer buff,
+						   struct VulkanRecordStreams *streams, size_t first, size_t start,
+						   size_t end, struct VulkanRecordSlice *counts) {
+	struct VulkanDrawItem *list = app->vulkan_data->draw_list;
+	union VulkanDrawCommand *commands = streams->commands.map;
+	uint32_t *instances = streams->instances.map;
+	struct ObjectPushConstants push = {0};
+	union VulkanDrawCommand command;
+	struct EngineObject *engine_object;
+	struct EngineMesh *mesh;
+	enum PipelineType pltype = NUM_PIPELINES;
+	VkPipelineLayout layout = VK_NULL_HANDLE;
+	VkBuffer vertex_buffer = VK_NULL_HANDLE, index_buffer = VK_NULL_HANDLE;
+	VkDeviceSize zero = 0, offset;
+	VkIndexType index_type = VK_INDEX_TYPE_UINT16;
+	size_t d, r, run, buffer_binds = 0, draw_binds = 0;
+	bool instanced = false, instances_bound = false, instance_run;
+
+	counts->binds_issued = 0;
+	counts->draws_merged = 0;
+	counts->draws_instanced = 0;
+	for (d = start; d < end; d += run) {
+		engine_object = list[d].object;
+		mesh = engine_object->render_data.mesh;
+
+		// Only the 2D pipeline has an instanced variant
+		run = 1;
+		if (engine_object->render_data.pltype == PIPELINE_2D) {
+			run = vulkan_meshrun(app, d, end, end);
+		}
+		instance_run = run >= VULKAN_INSTANCE_MIN;
+
+		if (engine_object->render_data.pltype != pltype || instance_run != instanced) {
+			pltype = engine_object->render_data.pltype;
+			instanced = instance_run;
+			layout = vulkan_bindpipeline(app, buff, pltype, instanced);
+			if (layout != VK_NULL_HANDLE) {
+				counts->binds_issued++;
+			}
+		}
+		if (layout == VK_NULL_HANDLE) {
+			run = 1;
+			continue;
+		}
+
+		// Vertex buffer bindings survive pipeline changes, so only the buffer decides
+		if (mesh->vi_buffer->buffer != vertex_buffer) {
+			vertex_buffer = mesh->vi_buffer->buffer;
+			vkCmdBindVertexBuffers(buff, 0, 1, &vertex_buffer, &zero);
+			buffer_binds++;
+		}
+		if (mesh->indices_size > 0 &&
+			(mesh->vi_buffer->buffer != index_buffer || mesh->index_type != index_type)) {
+			index_buffer = mesh->vi_buffer->buffer;
+			index_type = mesh->index_type;
+			vkCmdBindIndexBuffer(buff, index_buffer, 0, index_type);
+			buffer_binds++;
+		}
+
+		if (instanced) {
+			// Instance binding survives pipeline changes, all runs share the recording's stream
+			if (instances_bound == false) {
+				vkCmdBindVertexBuffers(buff, 1, 1, &streams->instances.buffer->buffer, &zero);
+				instances_bound = true;
+				buffer_binds++;
+			}
+			draw_binds += (mesh->indices_size > 0) ? 2 * run : run;
+
+			for (r = 0; r < run; r++) {
+				engine_object = list[d + r].object;
+				instances[d + r - first] =
+					engine_object->allocation->transform_base + engine_object->index;
+			}
+
+			// Copies share the mesh and level of detail, instances start at the run's entries
+			vulkan_drawcommand(app, list[d].object, &command);
+			if (mesh->indices_size > 0) {
+				vkCmdDrawIndexed(buff, command.indexed.indexCount, run, command.indexed.firstIndex,
+								 command.indexed.vertexOffset, (uint32_t)(d - first));
+			} else {
+				vkCmdDraw(buff, command.draw.vertexCount, run, command.draw.firstVertex,
+						  (uint32_t)(d - first));
+			}
+			counts->draws_instanced += run - 1;
+			continue;
+		}
+
+		// Following draws on the same bindings join this one's indirect call, up to a run that
+		// would be drawn as instances
+		run = 1;
+		if (app->vulkan_data->multi_draw_supported) {
+			while (d + run < end && run < app->vulkan_data->max_draw_indirect_count &&
+				   vulkan_samebindings(engine_object, list[d + run].object) &&
+				   vulkan_meshrun(app, d + run, end, VULKAN_INSTANCE_MIN) < VULKAN_INSTANCE_MIN) {
+				run++;
+			}
+			if (run < VULKAN_MULTI_DRAW_MIN) {
+				run = 1;
+			}
+		}
+		draw_binds += (mesh->indices_size > 0) ? 2 * run : run;
+
+		if (run > 1) {
+			for (r = 0; r < run; r++) {
+				vulkan_drawcommand(app, list[d + r].object, &commands[d + r - first]);
+			}
+
+			// Transform & tint are read from storage buffers at the instance's slot
+			push.object_index = VULKAN_OBJECT_INDIRECT;
+			vulkan_pushobject(app, buff, layout, &push);
+
+			offset = (VkDeviceSize)(d - first) * VULKAN_DRAW_COMMAND_SIZE;
+			if (mesh->indices_size > 0) {
+				vkCmdDrawIndexedIndirect(buff, streams->commands.buffer->buffer, offset, run,
+										 VULKAN_DRAW_COMMAND_SIZE);
+			} else {
+				vkCmdDrawIndirect(buff, streams->commands.buffer->buffer, offset, run,
+								  VULKAN_DRAW_COMMAND_SIZE);
+			}
+			counts->draws_merged += run - 1;
+			continue;
+		}
+
+		vulkan_drawcommand(app, engine_object, &command);
+
+		// Per-draw block with the object's prebuilt 2D affine
+		push.object_index = command.indexed.firstInstance;
+		memcpy(push.tint, engine_object->render_data.tint, sizeof(push.tint));
+		memcpy(push.transform, app->object_group->transforms[push.object_index].t2d.affine,
+			   sizeof(push.transform));
+		vulkan_pushobject(app, buff, layout, &push);
+
+		if (mesh->indices_size > 0) {
+			vkCmdDrawIndexed(buff, command.indexed.indexCount, 1, command.indexed.firstIndex,
+							 command.indexed.vertexOffset, command.indexed.firstInstance);
+		} else {
+			vkCmdDraw(buff, command.draw.vertexCount, 1, command.draw.firstVertex,
+					  command.draw.firstInstance);
+		}
+	}
+
+	counts->binds_issued += buffer_binds;
+	counts->binds_skipped = draw_binds - buffer_binds;
+}
+
+// Whether two draws share pipeline, buffer and index type, so one indirect call can make both
+bool vulkan_samebindings(struct EngineObject *a, struct EngineObject *b) {
+	struct EngineMesh *mesh_a = a->render_data.mesh, *mesh_b = b->render_data.mesh;
+
+	if (a->render_data.pltype != b->render_data.pltype ||
+		mesh_a->vi_buffer->buffer != mesh_b->vi_buffer->buffer ||
+		(mesh_a->indices_size > 0) != (mesh_b->indices_size > 0)) {
+		return false;
+	}
+	return mesh_a->indices_size == 0 || mesh_a->index_type == mesh_b->index_type;
+}
+
+// Number of draw list entries from 'd', at most 'limit', drawing one mesh at one level of detail
+size_t vulkan_meshrun(struct Application *app, size_t d, size_t end, size_t limit) {
+	struct VulkanDrawItem *list = app->vulkan_data->draw_list;
+	struct EngineObject *engine_object = list[d].object, *other;
+	uint32_t lod = vulkan_selectlod(app, engine_object);
+	size_t run = 1;
+
+	while (run < limit && d + run < end) {
+		other = list[d + run].object;
+		if (other->render_data.mesh != engine_object->render_data.mesh ||
+			other->render_data.pltype != engine_object->render_data.pltype ||
+			vulkan_selectlod(app, other) != lod) {
+			break;
+		}
+		run++;
+	}
+	return run;
+}
+
+/*
+	Fills an object's draw from the offsets of its mesh in the shared buffer, which is bound at
+	offset 0. The first instance selects the object's slot in the transform buffer.
+*/
+void vulkan_drawcommand(struct Application *app, struct EngineObject *engine_object,
+						union VulkanDrawCommand *command) {
+	struct EngineMesh *mesh = engine_object->render_data.mesh;
+	uint32_t transform_index = engine_object->allocation->transform_base + engine_object->index;
+	uint32_t first_vertex = mesh->vertex_offset / sizeof(struct Vertex);
+
+	if (mesh->indices_size > 0) {
+		// Levels of detail share the index buffer, only the range changes
+		struct MeshLod *lod = &mesh->lods[vulkan_selectlod(app, engine_object)];
+		command->indexed.indexCount = lod->count;
+		command->indexed.instanceCount = 1;
+		command->indexed.firstIndex = mesh->index_offset / mesh_indexstride(mesh) + lod->first;
+		command->indexed.vertexOffset = (int32_t)first_vertex;
+		command->indexed.firstInstance = transform_index;
+	} else {
+		command->draw.vertexCount = mesh->vertices_size;
+		command->draw.instanceCount = 1;
+		command->draw.firstVertex = first_vertex;
+		command->draw.firstInstance = transform_index;
+	}
+}
+
+// Grows a recording's streams for 'size' draw list entries, commands only with multi-draw
+bool vulkan_reservestreams(struct Application *app, struct VulkanRecordStreams *streams,
+						   size_t size) {
+	if (app->vulkan_data->multi_draw_supported &&
+		vulkan_reservestream(app, &streams->commands, size, VULKAN_DRAW_COMMAND_SIZE,
+							 VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT) == false) {
+		return false;
+	}
+	return vulkan_reservestream(app, &streams->instances, size, sizeof(uint32_t),
+								VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+}
+
+/*
+	Grows a recording's stream to hold 'size' entries. Only the recording being replaced used the
+	old buffer, and its last submission finished before the slot came around.
+*/
+bool vulkan_reservestream(struct Application *app, struct VulkanRecordStream *stream, size_t size,
+						  size_t entry_size, VkBufferUsageFlags usage) {
+	if (size <= stream->capacity) {
+		return true;
+	}
+
+	size_t capacity = stream->capacity * 2;
+	if (capacity < size) {
+		capacity = size;
+	}
+
+	struct VulkanBuffer *buffer;
+	bool ret = vkmemory_createbuffer(
+		&app->vulkan_data->vmemory, entry_size * capacity, usage,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &buffer);
+	if (ret == false) {
+		fprintf(stderr, "Failure creating recording stream buffer.\n");
+		return false;
+	}
+
+	void *map;
+	if (vkmemory_mapbuffer(&app->vulkan_data->vmemory, buffer, &map) == false) {
+		vkmemory_releasebuffer(&app->vulkan_data->vmemory, buffer);
+		return false;
+	}
+
+	if (stream->buffer != NULL) {
+		vkmemory_releasebuffer(&app->vulkan_data->vmemory, stream->buffer);
+	}
+	stream->buffer = buffer;
+	stream->map = map;
+	stream->capacity = capacity;
+	return true;
+}
+
+void vulkan_releasestreams(struct Application *app, struct VulkanRecordStreams *streams) {
+	if (streams->commands.buffer != NULL) {
+		vkmemory_releasebuffer(&app->vulkan_data->vmemory, streams->commands.buffer);
+	}
+	if (streams->instances.buffer != NULL) {
+		vkmemory_releasebuffer(&app->vulkan_data->vmemory, streams->instances.buffer);
+	}
+}
+
+/*
+	Picks an object's level of detail from its size on screen, allowing VULKAN_LOD_ERROR_PIXELS of
+	error. 2D bounds are in clip space, whose [-1, 1] range spans the swapchain extent.
+*/
+uint32_t vulkan_selectlod(struct Application *app, struct EngineObject *engine_object) {
+	struct EngineMesh *mesh = engine_object->render_data.mesh;
+	if (mesh->lods_size < 2) {
+		return 0;
+	}
+
+	struct EngineObjectAllocation *allocation = engine_object->allocation;
+	size_t i = engine_object->index;
+	float pixels[2] = {app->vulkan_data->swapchain_extent.width * 0.5f,
+					   app->vulkan_data->swapchain_extent.height * 0.5f};
+
+	// Pixels covered by one mesh unit, the larger axis decides
+	float scale = 0.0f, local;
+	int j;
+	for (j = 0; j < 2; j++) {
+		local = mesh->bounds_max[j] - mesh->bounds_min[j];
+		if (local > 0.0f) {
+			scale = fmaxf(scale, (allocation->bounds_max[j][i] - allocation->bounds_min[j][i]) /
+									 local * pixels[j]);
+		}
+	}
+	if (scale <= 0.0f) {
+		return mesh->lods_size - 1;
+	}
+
+	return mesh_selectlod(mesh, VULKAN_LOD_ERROR_PIXELS / scale);
+}
+
+/*
+	Sends one per-draw block. With OBJECT_PUSH_UBO the block is written at the object's slot of
+	the frame's dynamic uniform buffer and the set is rebound with that offset.
+*/
+void vulkan_pushobject(struct Application *app, VkCommandBuffer buff, VkPipelineLayout layout,
+					   struct ObjectPushConstants *push) {
+#ifndef OBJECT_PUSH_UBO
+	(void)app;
+	vkCmdPushConstants(buff, layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(*push), push);
+#else
+	uint32_t frame = app->vulkan_data->current_frame;
+	uint32_t offset = push->object_index * app->vulkan_data->push_stride;
+
+	memcpy((char *)app->vulkan_data->push_maps[frame] + offset, push, sizeof(*push));
+	vkCmdBindDescriptorSets(buff, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, 0, 1,
+							&app->vulkan_data->transform_sets[frame], 1, &offset);
+#endif
+}
+
+/*
+	Records the cull pass: counters are cleared, one dispatch per pipeline writes the commands of
+	its objects, and a barrier hands them to indirect draws and the counters to the host.
+*/
+void vulkan_recordgpucull(struct Application *app, VkCommandBuffer buff,
+						  struct ObjectGroup *obj_grp) {
+	uint32_t frame = app->vulkan_data->current_frame;
+	struct VulkanBuffer **buffers = app->vulkan_data->cull_buffers[frame];
+
+	vkCmdFillBuffer(buff, buffers[CULL_BUFFER_COUNTS]->buffer, 0, VK_WHOLE_SIZE, 0);
+
+	// Without draw counts every batch slot is drawn, and slots whose object was compacted away are
+	// no longer written by the cull pass
+	bool compact = app->vulkan_data->draw_indirect_count != NULL;
+	if (compact == false) {
+		vkCmdFillBuffer(buff, buffers[CULL_BUFFER_COMMANDS]->buffer, 0, VK_WHOLE_SIZE, 0);
+	}
+
+	VkMemoryBarrier barrier = {0};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	vkCmdPipelineBarrier(buff, VK_PIPELINE_STAGE_TRANSFER_BIT,
+						 VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, NULL, 0, NULL);
+
+	vkCmdBindPipeline(buff, VK_PIPELINE_BIND_POINT_COMPUTE, app->vulkan_data->cull_pipeline);
+	vkCmdBindDescriptorSets(buff, VK_PIPELINE_BIND_POINT_COMPUTE,
+							app->vulkan_data->cull_pipeline_layout, 0, 1,
+							&app->vulkan_data->cull_sets[frame], 0, NULL);
+
+	// Every dispatch walks all slots and skips other pipelines' objects
+	struct VulkanCullPush push = {0};
+	push.objects_size = obj_grp->transforms_size;
+	push.compact = compact;
+	uint32_t groups_size =
+		(push.objects_size + VULKAN_CULL_WORKGROUP_SIZE - 1) / VULKAN_CULL_WORKGROUP_SIZE;
+
+	enum PipelineType pltype;
+	for (pltype = NO_PIPELINE; pltype < NUM_PIPELINES; pltype++) {
+		if (obj_grp->pipelines[pltype].objects_size == 0) {
+			continue;
+		}
+
+		memcpy(push.planes, obj_grp->views[pltype].planes, sizeof(push.planes));
+		push.planes_size = obj_grp->views[pltype].planes_size;
+		push.pipeline = pltype;
+		vkCmdPushConstants(buff, app->vulkan_data->cull_pipeline_layout,
+						   VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push), &push);
+		vkCmdDispatch(buff, groups_size, 1, 1);
+	}
+
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_HOST_READ_BIT;
+	vkCmdPipelineBarrier(buff, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+						 VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_HOST_BIT, 0, 1,
+						 &barrier, 0, NULL, 0, NULL);
+}
+
+/*
+	Draws a pipeline's batches from the commands written by the cull pass, one indirect call per
+	batch. Without draw counts every command is drawn and culled ones have no instances.
+*/
+void vulkan_recordbatches(struct Application *app, VkCommandBuffer buff, VkPipelineLayout layout,
+						  struct ObjectGroup *obj_grp, enum PipelineType pltype) {
+	uint32_t frame = app->vulkan_data->current_frame;
+	VkBuffer commands = app->vulkan_data->cull_buffers[frame][CULL_BUFFER_COMMANDS]->buffer;
+	VkBuffer counts = app->vulkan_data->cull_buffers[frame][CULL_BUFFER_COUNTS]->buffer;
+	VkDeviceSize zero = 0, offset, count_offset;
+	struct ObjectDrawBatch *batch;
+	uint32_t b;
+
+	// Transform & tint are read from storage buffers at the instance's slot
+	struct ObjectPushConstants push = {0};
+	push.object_index = VULKAN_OBJECT_INDIRECT;
+	vulkan_pushobject(app, buff, layout, &push);
+
+	for (b = 0; b < obj_grp->batches_size; b++) {
+		batch = &obj_grp->batches[b];
+		if (batch->pltype != pltype || batch->buffer == NULL) {
+			continue;
+		}
+
+		// Counter 0 holds the culled total, batch counters follow it
+		offset = (VkDeviceSize)batch->command_base * VULKAN_DRAW_COMMAND_SIZE;
+		count_offset = sizeof(uint32_t) * (b + 1);
+		vkCmdBindVertexBuffers(buff, 0, 1, &batch->buffer->buffer, &zero);
+
+		if (batch->indexed) {
+			vkCmdBindIndexBuffer(buff, batch->buffer->buffer, 0, batch->index_type);
+			if (app->vulkan_data->draw_indexed_indirect_count != NULL) {
+				app->vulkan_data->draw_indexed_indirect_count(buff, commands, offset, counts,
+															  count_offset, batch->objects_size,
+															  VULKAN_DRAW_COMMAND_SIZE);
+			} else {
+				vkCmdDrawIndexedIndirect(buff, commands, offset, batch->objects_size,
+										 VULKAN_DRAW_COMMAND_SIZE);
+			}
+		} else {
+			if (app->vulkan_data->draw_indirect_count != NULL) {
+				app->vulkan_data->draw_indirect_count(buff, commands, offset, counts, count_offset,
+													  batch->objects_size,
+													  VULKAN_DRAW_COMMAND_SIZE);
+			} else {
+				vkCmdDrawIndirect(buff, commands, offset, batch->objects_size,
+								  VULKAN_DRAW_COMMAND_SIZE);
+			}
+		}
+	}
+}
+
+/* bool vulkan_recorddrawcommands(struct Application *app, VkCommandBuffer buff, VkFramebuffer
+frame, struct RenderGroup *render_group) { VkCommandBufferBeginInfo begin_info = {0};
+	begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+
+	// Reset command buffer
+	VkCommandBufferResetFlagBits reset_bits = 0;
+	vkResetCommandBuffer(buff, reset_bits);
+
+	VkResult ret = vkBeginCommandBuffer(buff, &begin_info);
+	if (ret != VK_SUCCESS) {
+		fprintf(stderr, "Failure to begin recording to command buffer.\n");
+		return false;
+	}
+
+	VkRenderPassBeginInfo renderpass_info = {0};
+	renderpass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+	renderpass_info.renderPass = app->vulkan_data->render_pass;
+	renderpass_info.framebuffer = frame;
+	renderpass_info.renderArea.offset = (VkOffset2D){0, 0};
+	renderpass_info.renderArea.extent = app->vulkan_data->swapchain_extent;
+
+	VkClearValue clear_color = {{{0.0f, 0.0f, 0.0f, 1.0f}}};
+	renderpass_info.clearValueCount = 1;
+	renderpass_info.pClearValues = &clear_color;
 
 	vkCmdBeginRenderPass(buff, &renderpass_info, VK_SUBPASS_CONTENTS_INLINE);
 
@@ -1485,6 +2624,17 @@ bool vulkan_createsynchronization(struct Application *app) {
 		}
 	}
 
+	// Transfer fences start unsignaled, they are waited on right after submission
+	fence_info.flags = 0;
+	for (i = 0; i < app->vulkan_data->transfer_queues_size; i++) {
+		VkResult ret = vkCreateFence(app->vulkan_data->device, &fence_info, NULL,
+									 &app->vulkan_data->transfer_fences[i]);
+		if (ret != VK_SUCCESS) {
+			fprintf(stderr, "Failure making transfer fence.\n");
+			return false;
+		}
+	}
+
 	return true;
 }
 
@@ -1520,7 +2670,78 @@ bool vulkan_createsynchronization(struct Application *app) {
 
 bool vulkan_copybuffer(struct Application *app, struct VulkanMemory *vmem, struct VulkanBuffer *src,
 					   struct VulkanBuffer *dest, VkDeviceSize size, VkDeviceSize offset) {
-	// Get transfer command buffer
+	// Split large copies evenly across the available transfer queues
+	uint32_t parts = size / TRANSFER_SPLIT_SIZE;
+	if (parts > app->vulkan_data->transfer_queues_size) {
+		parts = app->vulkan_data->transfer_queues_size;
+	}
+	if (parts == 0) {
+		parts = 1;
+	}
+
+	VkDeviceSize part_size = size / parts;
+	VkResult ret;
+	uint32_t i;
+
+	for (i = 0; i < parts; i++) {
+		// Get transfer command buffer for this queue
+		VkCommandBuffer buff = app->vulkan_data->tfr_command_buffers[i];
+
+		// Reset command buffer
+		VkCommandBufferResetFlagBits reset_bits = 0;
+		vkResetCommandBuffer(buff, reset_bits);
+
+		// Start and record command buffer
+		VkCommandBufferBeginInfo begin_info = {0};
+		begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+		ret = vkBeginCommandBuffer(buff, &begin_info);
+		if (ret != VK_SUCCESS) {
+			fprintf(stderr, "Failure to begin recording to command buffer.\n");
+			return false;
+		}
+
+		// Last part takes the remainder
+		VkBufferCopy copy_region = {0};
+		copy_region.srcOffset = part_size * i;
+		copy_region.dstOffset = offset + part_size * i;
+		copy_region.size = (i == parts - 1) ? size - part_size * i : part_size;
+
+		vkCmdCopyBuffer(buff, src->buffer, dest->buffer, 1, &copy_region);
+		vkEndCommandBuffer(buff);
+
+		// Submit command buffer to queue
+		VkSubmitInfo submit_info = {0};
+		submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submit_info.commandBufferCount = 1;
+		submit_info.pCommandBuffers = &buff;
+
+		ret = vkQueueSubmit(app->vulkan_data->transfer_queues[i], 1, &submit_info,
+							app->vulkan_data->transfer_fences[i]);
+		if (ret != VK_SUCCESS) {
+			fprintf(stderr, "Failure submitting transfer queue.\n");
+			if (i > 0) {
+				vkWaitForFences(app->vulkan_data->device, i, app->vulkan_data->transfer_fences,
+								VK_TRUE, UINT64_MAX);
+				vkResetFences(app->vulkan_data->device, i, app->vulkan_data->transfer_fences);
+			}
+			return false;
+		}
+	}
+
+	// Wait for every part to finish
+	vkWaitForFences(app->vulkan_data->device, parts, app->vulkan_data->transfer_fences, VK_TRUE,
+					UINT64_MAX);
+	vkResetFences(app->vulkan_data->device, parts, app->vulkan_data->transfer_fences);
+
+	return true;
+}
+
+// Copies several regions between two buffers with one submission on the first transfer queue
+bool vulkan_copybufferregions(struct Application *app, struct VulkanBuffer *src,
+							  struct VulkanBuffer *dest, const VkBufferCopy *regions,
+							  uint32_t regions_size) {
 	VkCommandBuffer buff = app->vulkan_data->tfr_command_buffers[0];
 
 	// Reset command buffer
@@ -1538,27 +2759,218 @@ bool vulkan_copybuffer(struct Application *app, struct VulkanMemory *vmem, struc
 		return false;
 	}
 
-	VkBufferCopy copy_region = {0};
-	copy_region.srcOffset = 0;
-	copy_region.dstOffset = offset;
-	copy_region.size = size;
-
-	vkCmdCopyBuffer(buff, src->buffer, dest->buffer, 1, &copy_region);
+	vkCmdCopyBuffer(buff, src->buffer, dest->buffer, regions_size, regions);
 	vkEndCommandBuffer(buff);
 
-	// Submit command buffer to queue
+	// Submit command buffer to queue and wait for it
 	VkSubmitInfo submit_info = {0};
 	submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 	submit_info.commandBufferCount = 1;
 	submit_info.pCommandBuffers = &buff;
 
-	ret = vkQueueSubmit(app->vulkan_data->transfer_queue, 1, &submit_info, NULL);
+	ret = vkQueueSubmit(app->vulkan_data->transfer_queues[0], 1, &submit_info,
+						app->vulkan_data->transfer_fences[0]);
 	if (ret != VK_SUCCESS) {
 		fprintf(stderr, "Failure submitting transfer queue.\n");
 		return false;
 	}
-	vkQueueWaitIdle(app->vulkan_data->transfer_queue);
 
+	vkWaitForFences(app->vulkan_data->device, 1, app->vulkan_data->transfer_fences, VK_TRUE,
+					UINT64_MAX);
+	vkResetFences(app->vulkan_data->device, 1, app->vulkan_data->transfer_fences);
+
+	return true;
+}
+
+/*
+	Times a copy of 'size' bytes between device-local buffers on the graphics queue alone, then
+	split across the transfer queues by vulkan_copybuffer, and prints the bandwidth of each. Both
+	copies run once untimed first, so the numbers leave out first use of the memory.
+*/
+bool vulkan_benchtransfer(struct Application *app, VkDeviceSize size) {
+	struct VulkanMemory *vmem = &app->vulkan_data->vmemory;
+	VkBufferUsageFlags usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+	struct VulkanBuffer *src, *dest;
+	if (vkmemory_createbuffer(vmem, size, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &src) ==
+		false) {
+		fprintf(stderr, "Failure creating benchmark buffers.\n");
+		return false;
+	}
+	if (vkmemory_createbuffer(vmem, size, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &dest) ==
+		false) {
+		fprintf(stderr, "Failure creating benchmark buffers.\n");
+		vkmemory_destroybuffer(vmem, src);
+		return false;
+	}
+
+	// Graphics queue copy is recorded once into a buffer of the graphics pool
+	VkCommandBufferAllocateInfo alloc_info = {0};
+	alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	alloc_info.commandPool = app->vulkan_data->gfx_command_pool;
+	alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	alloc_info.commandBufferCount = 1;
+
+	VkFenceCreateInfo fence_info = {0};
+	fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+	VkCommandBuffer buff = VK_NULL_HANDLE;
+	VkFence fence = VK_NULL_HANDLE;
+	VkCommandBufferBeginInfo begin_info = {0};
+	begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+
+	bool ret = vkAllocateCommandBuffers(app->vulkan_data->device, &alloc_info, &buff) ==
+				   VK_SUCCESS &&
+			   vkCreateFence(app->vulkan_data->device, &fence_info, NULL, &fence) == VK_SUCCESS &&
+			   vkBeginCommandBuffer(buff, &begin_info) == VK_SUCCESS;
+	if (ret) {
+		VkBufferCopy copy_region = {0};
+		copy_region.size = size;
+		vkCmdCopyBuffer(buff, src->buffer, dest->buffer, 1, &copy_region);
+		ret = vkEndCommandBuffer(buff) == VK_SUCCESS;
+	}
+	if (ret == false) {
+		fprintf(stderr, "Failure to record benchmark command buffer.\n");
+	}
+
+	VkSubmitInfo submit_info = {0};
+	submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submit_info.commandBufferCount = 1;
+	submit_info.pCommandBuffers = &buff;
+
+	double start, graphics_time = 0.0, split_time = 0.0;
+	int run;
+	for (run = 0; run < 2 && ret; run++) {
+		start = glfwGetTime();
+		ret = vkQueueSubmit(app->vulkan_data->graphics_queue, 1, &submit_info, fence) ==
+			  VK_SUCCESS;
+		if (ret == false) {
+			fprintf(stderr, "Failed to submit to graphics queue.\n");
+			break;
+		}
+		vkWaitForFences(app->vulkan_data->device, 1, &fence, VK_TRUE, UINT64_MAX);
+		vkResetFences(app->vulkan_data->device, 1, &fence);
+		graphics_time = glfwGetTime() - start;
+
+		start = glfwGetTime();
+		ret = vulkan_copybuffer(app, vmem, src, dest, size, 0);
+		split_time = glfwGetTime() - start;
+	}
+
+	if (ret) {
+		uint32_t parts = size / TRANSFER_SPLIT_SIZE;
+		if (parts > app->vulkan_data->transfer_queues_size) {
+			parts = app->vulkan_data->transfer_queues_size;
+		}
+		printf("Copied %.0f MiB: %.2f GB/s on the graphics queue, %.2f GB/s across %u transfer "
+			   "queue(s).\n",
+			   size / 1048576.0, size / graphics_time / 1e9, size / split_time / 1e9,
+			   parts > 0 ? parts : 1);
+	}
+
+	if (fence != VK_NULL_HANDLE) {
+		vkDestroyFence(app->vulkan_data->device, fence, NULL);
+	}
+	if (buff != VK_NULL_HANDLE) {
+		vkFreeCommandBuffers(app->vulkan_data->device, app->vulkan_data->gfx_command_pool, 1,
+							 &buff);
+	}
+	vkmemory_destroybuffer(vmem, dest);
+	vkmemory_destroybuffer(vmem, src);
+	return ret;
+}
+
+/*
+	Starts the current frame's update command buffer and returns its staging memory, with room for
+	'size' bytes. Updates left by a frame that was never submitted are sent first, and the staging
+	is reused once they finished.
+*/
+bool vulkan_beginupdates(struct Application *app, VkDeviceSize size, void **staging) {
+	uint32_t frame = app->vulkan_data->current_frame;
+	VkCommandBuffer buff = app->vulkan_data->update_buffers[frame];
+
+	if (app->vulkan_data->update_pending) {
+		if (vulkan_submitupdates(app) == false) {
+			return false;
+		}
+		vkWaitForFences(app->vulkan_data->device, 1, &app->vulkan_data->in_flight_fen[frame],
+						VK_TRUE, UINT64_MAX);
+	}
+
+	if (vulkan_reservestream(app, &app->vulkan_data->update_staging[frame], size, 1,
+							 VK_BUFFER_USAGE_TRANSFER_SRC_BIT) == false) {
+		return false;
+	}
+
+	// Reset command buffer
+	VkCommandBufferResetFlagBits reset_bits = 0;
+	vkResetCommandBuffer(buff, reset_bits);
+
+	VkCommandBufferBeginInfo begin_info = {0};
+	begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+	VkResult ret = vkBeginCommandBuffer(buff, &begin_info);
+	if (ret != VK_SUCCESS) {
+		fprintf(stderr, "Failure to begin recording to command buffer.\n");
+		return false;
+	}
+
+	// Earlier frames on the queue finish reading vertices before the copies overwrite them
+	vkCmdPipelineBarrier(buff, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+						 0, 0, NULL, 0, NULL, 0, NULL);
+
+	*staging = app->vulkan_data->update_staging[frame].map;
+	app->vulkan_data->update_pending = true;
+	return true;
+}
+
+// Copies regions of the current frame's update staging into a buffer
+void vulkan_recordupdates(struct Application *app, struct VulkanBuffer *dest,
+						  const VkBufferCopy *regions, uint32_t regions_size) {
+	uint32_t frame = app->vulkan_data->current_frame;
+	vkCmdCopyBuffer(app->vulkan_data->update_buffers[frame],
+					app->vulkan_data->update_staging[frame].buffer->buffer, dest->buffer,
+					regions_size, regions);
+}
+
+// Makes the copies visible to vertex input and ends the current frame's update command buffer
+void vulkan_endupdates(struct Application *app) {
+	VkCommandBuffer buff = app->vulkan_data->update_buffers[app->vulkan_data->current_frame];
+
+	VkMemoryBarrier barrier = {0};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT;
+	vkCmdPipelineBarrier(buff, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+						 0, 1, &barrier, 0, NULL, 0, NULL);
+	vkEndCommandBuffer(buff);
+}
+
+/*
+	Submits pending updates on their own, signaling the current frame's fence. Used when the frame
+	recording them is not submitted.
+*/
+bool vulkan_submitupdates(struct Application *app) {
+	uint32_t frame = app->vulkan_data->current_frame;
+	if (app->vulkan_data->update_pending == false) {
+		return true;
+	}
+
+	vulkan_endupdates(app);
+	app->vulkan_data->update_pending = false;
+
+	VkSubmitInfo submit_info = {0};
+	submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submit_info.commandBufferCount = 1;
+	submit_info.pCommandBuffers = &app->vulkan_data->update_buffers[frame];
+
+	vkResetFences(app->vulkan_data->device, 1, &app->vulkan_data->in_flight_fen[frame]);
+	VkResult ret = vkQueueSubmit(app->vulkan_data->graphics_queue, 1, &submit_info,
+								 app->vulkan_data->in_flight_fen[frame]);
+	if (ret != VK_SUCCESS) {
+		fprintf(stderr, "Failed to submit to graphics queue.\n");
+		return false;
+	}
 	return true;
 }
 
@@ -1580,6 +2992,158 @@ uint32_t vulkan_findmemorytype(struct Application *app, uint32_t type_filter,
 	return 0;
 }
 
+/*
+	Lists every object that passed this frame's CPU cull with its sort key, in pipeline then
+	chunk order, and sorts the list by key. Static objects are left out unless 'statics' is set.
+	Listed statics are counted as the front of the list only when all of them sort beneath every
+	dynamic draw, otherwise they are drawn in order among the dynamic ones.
+*/
+bool vulkan_builddrawlist(struct Application *app, struct ObjectGroup *obj_grp, bool statics) {
+	struct EngineObjectAllocation *curr;
+	struct EnginePipeline *pipeline;
+	enum PipelineType pltype;
+	size_t c, v, index, size = 0, statics_size = 0;
+	uint64_t key, order, static_order = 0, dynamic_order = UINT64_MAX;
+
+	for (pltype = NO_PIPELINE; pltype < NUM_PIPELINES; pltype++) {
+		pipeline = &obj_grp->pipelines[pltype];
+		for (c = 0; c < pipeline->chunks_size; c++) {
+			size += pipeline->chunks[c]->visible_size;
+		}
+	}
+
+	if (size > app->vulkan_data->draw_items_capacity) {
+		size_t capacity = app->vulkan_data->draw_items_capacity * 2;
+		if (capacity < size) {
+			capacity = size;
+		}
+
+		struct VulkanDrawItem *items =
+			realloc(app->vulkan_data->draw_items, sizeof(*items) * capacity);
+		if (items == NULL) {
+			fprintf(stderr, "Failure to allocate draw list.\n");
+			return false;
+		}
+		app->vulkan_data->draw_items = items;
+
+		items = realloc(app->vulkan_data->draw_items_temp, sizeof(*items) * capacity);
+		if (items == NULL) {
+			fprintf(stderr, "Failure to allocate draw list.\n");
+			return false;
+		}
+		app->vulkan_data->draw_items_temp = items;
+		app->vulkan_data->draw_items_capacity = capacity;
+	}
+
+	struct VulkanDrawItem *items = app->vulkan_data->draw_items;
+	size = 0;
+	for (pltype = NO_PIPELINE; pltype < NUM_PIPELINES; pltype++) {
+		pipeline = &obj_grp->pipelines[pltype];
+		for (c = 0; c < pipeline->chunks_size; c++) {
+			curr = pipeline->chunks[c];
+			for (v = 0; v < curr->visible_size; v++) {
+				index = curr->visible[v];
+				if ((curr->flags[index] & OBJECT_FLAG_STATIC) && statics == false) {
+					continue;
+				}
+
+				key = vulkan_sortkey(curr, index, pltype);
+				order = key >> VULKAN_SORT_BUFFER_SHIFT;
+				if (curr->flags[index] & OBJECT_FLAG_STATIC) {
+					static_order = order > static_order ? order : static_order;
+					statics_size++;
+				} else {
+					dynamic_order = order < dynamic_order ? order : dynamic_order;
+				}
+				items[size].key = key;
+				items[size].object = curr->objects[index];
+				size++;
+			}
+		}
+	}
+
+	app->vulkan_data->draw_list =
+		vulkan_radixsort(items, app->vulkan_data->draw_items_temp, size);
+	app->vulkan_data->draw_list_size = size;
+	app->vulkan_data->draw_static_order = static_order;
+	app->vulkan_data->draw_dynamic_order = dynamic_order;
+	app->vulkan_data->draw_statics_split = statics_size == 0 || static_order < dynamic_order;
+	app->vulkan_data->draw_statics_size = app->vulkan_data->draw_statics_split ? statics_size : 0;
+	return true;
+}
+
+// Builds an object's draw sort key, see VULKAN_SORT_PIPELINE_SHIFT for the layout
+uint64_t vulkan_sortkey(struct EngineObjectAllocation *allocation, size_t index,
+						enum PipelineType pltype) {
+	struct EngineMesh *mesh = allocation->objects[index]->render_data.mesh;
+	uint64_t order = vulkan_floatorder(allocation->pos[2][index]) >> 16;
+
+	uint64_t key = (uint64_t)pltype << VULKAN_SORT_PIPELINE_SHIFT;
+	if (pltype == PIPELINE_2D) {
+		key |= order << VULKAN_SORT_LAYER_SHIFT;
+	} else {
+		key |= order;
+	}
+
+	// Truncated ids only cost binds when two buffers or meshes share them
+	key |= (uint64_t)(mesh->vi_buffer->id & VULKAN_SORT_BUFFER_MASK) << VULKAN_SORT_BUFFER_SHIFT;
+	key |= (uint64_t)((mesh->vertex_offset / sizeof(struct Vertex)) & VULKAN_SORT_FIELD_MASK)
+		   << VULKAN_SORT_MESH_SHIFT;
+	return key;
+}
+
+// Maps a float to an unsigned integer with the same ordering
+uint32_t vulkan_floatorder(float value) {
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	return (bits & 0x80000000u) ? ~bits : bits | 0x80000000u;
+}
+
+/*
+	Stable LSD radix sort on the keys, one pass per VULKAN_SORT_RADIX_BITS digit. Passes where
+	every key has the same digit are skipped. Items ping-pong with 'temp', the returned array holds
+	the sorted order.
+*/
+struct VulkanDrawItem *vulkan_radixsort(struct VulkanDrawItem *items,
+										struct VulkanDrawItem *temp, size_t size) {
+	size_t counts[1u << VULKAN_SORT_RADIX_BITS];
+	const uint64_t mask = (1u << VULKAN_SORT_RADIX_BITS) - 1;
+	struct VulkanDrawItem *swap;
+	size_t i, sum, count;
+	uint32_t shift;
+
+	if (size < 2) {
+		return items;
+	}
+
+	for (shift = 0; shift < 64; shift += VULKAN_SORT_RADIX_BITS) {
+		memset(counts, 0, sizeof(counts));
+		for (i = 0; i < size; i++) {
+			counts[(items[i].key >> shift) & mask]++;
+		}
+		if (counts[(items[0].key >> shift) & mask] == size) {
+			continue;
+		}
+
+		// Exclusive prefix sum gives each digit its first slot
+		sum = 0;
+		for (i = 0; i <= mask; i++) {
+			count = counts[i];
+			counts[i] = sum;
+			sum += count;
+		}
+
+		for (i = 0; i < size; i++) {
+			temp[counts[(items[i].key >> shift) & mask]++] = items[i];
+		}
+		swap = items;
+		items = temp;
+		temp = swap;
+	}
+
+	return items;
+}
+
 bool vulkan_drawframe(struct Application *app) {
 	uint32_t image_index;
 
@@ -1587,6 +3151,44 @@ bool vulkan_drawframe(struct Application *app) {
 					&app->vulkan_data->in_flight_fen[app->vulkan_data->current_frame], VK_TRUE,
 					UINT64_MAX);
 
+	// Buffers released MAX_FRAMES_IN_FLIGHT frames ago are no longer referenced by the GPU
+	vkmemory_collectgarbage(&app->vulkan_data->vmemory, MAX_FRAMES_IN_FLIGHT);
+
+	// Vertex updates are copied by this frame's update buffer, ahead of its draws
+	if (objgrp_flushupdates(app->object_group, app) == false) {
+		fprintf(stderr, "Failure to flush object updates.\n");
+	}
+
+	// This frame's transform buffer is free since its fence signaled
+	if (vulkan_updatetransforms(app) == false) {
+		fprintf(stderr, "Failure to update object transforms.\n");
+		return false;
+	}
+#ifdef OBJECT_PUSH_UBO
+	if (vulkan_updatepushbuffer(app) == false) {
+		fprintf(stderr, "Failure to update per-draw uniform buffer.\n");
+		return false;
+	}
+#endif
+
+	// Visible lists for recording, bounds are current after the flush. Large groups are culled on
+	// the GPU instead and report the counts of this frame's previous cull pass
+	struct FrameStats *stats = &app->vulkan_data->frame_stats;
+	stats->frame++;
+	stats->objects_visible = stats->objects_culled = 0;
+
+	bool gpu_cull = vulkan_usegpucull(app, app->object_group);
+	if (gpu_cull) {
+		vulkan_readcullcounts(app, stats);
+	}
+	if (vulkan_updateculldata(app, gpu_cull) == false) {
+		fprintf(stderr, "Failure to update object cull data.\n");
+		return false;
+	}
+	if (gpu_cull == false) {
+		objgrp_cull(app->object_group, &stats->objects_visible, &stats->objects_culled);
+	}
+
 	VkResult ret = vkAcquireNextImageKHR(
 		app->vulkan_data->device, app->vulkan_data->swapchain, UINT64_MAX,
 		app->vulkan_data->image_available_sem[app->vulkan_data->current_frame], NULL, &image_index);
@@ -1605,11 +3207,24 @@ bool vulkan_drawframe(struct Application *app) {
 	app->vulkan_data->imgs_in_flight[image_index] =
 		app->vulkan_data->in_flight_fen[app->vulkan_data->current_frame];
 
-	// Rerecord command buffers
-	vulkan_recordobjgrp(app, app->vulkan_data->gfx_command_buffers[image_index],
-						app->vulkan_data->swapchain_framebuffers[image_index], app->object_group);
+	// Rerecord the command buffer only if the scene changed since it was recorded
+	uint32_t slot = image_index * MAX_FRAMES_IN_FLIGHT + app->vulkan_data->current_frame;
+	if (vulkan_recordframe(app, image_index, gpu_cull) == false) {
+		fprintf(stderr, "Failure to record command buffer.\n");
+		return false;
+	}
+
+	// Submit command buffer for presentation, after the frame's vertex updates
+	VkCommandBuffer buffers[2];
+	uint32_t buffers_size = 0;
+	if (app->vulkan_data->update_pending) {
+		vulkan_endupdates(app);
+		app->vulkan_data->update_pending = false;
+		buffers[buffers_size++] =
+			app->vulkan_data->update_buffers[app->vulkan_data->current_frame];
+	}
+	buffers[buffers_size++] = app->vulkan_data->gfx_command_buffers[slot];
 
-	// Submit command buffer for presentation
 	VkPipelineStageFlags wait_stages[1] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
 	VkSubmitInfo submit_info = {0};
 	submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
@@ -1617,8 +3232,8 @@ bool vulkan_drawframe(struct Application *app) {
 	submit_info.pWaitSemaphores =
 		&app->vulkan_data->image_available_sem[app->vulkan_data->current_frame];
 	submit_info.pWaitDstStageMask = wait_stages;
-	submit_info.commandBufferCount = 1;
-	submit_info.pCommandBuffers = &app->vulkan_data->gfx_command_buffers[image_index];
+	submit_info.commandBufferCount = buffers_size;
+	submit_info.pCommandBuffers = buffers;
 	submit_info.signalSemaphoreCount = 1;
 	submit_info.pSignalSemaphores =
 		&app->vulkan_data->render_finished_sem[app->vulkan_data->current_frame];
@@ -1657,6 +3272,287 @@ bool vulkan_drawframe(struct Application *app) {
 	return true;
 }
 
+/*
+	Copies the object group's transforms into the current frame's storage buffer with one memcpy,
+	growing the buffer and rewriting its descriptor when the group outgrew it.
+*/
+bool vulkan_updatetransforms(struct Application *app) {
+	struct ObjectGroup *obj_grp = app->object_group;
+	uint32_t frame = app->vulkan_data->current_frame;
+
+	if (obj_grp->transforms_size == 0) {
+		return true;
+	}
+
+	if (obj_grp->transforms_size > app->vulkan_data->transform_capacity[frame]) {
+		size_t capacity = app->vulkan_data->transform_capacity[frame] * 2;
+		if (capacity < obj_grp->transforms_size) {
+			capacity = obj_grp->transforms_size;
+		}
+		if (capacity < TRANSFORM_BUFFER_MIN_CAPACITY) {
+			capacity = TRANSFORM_BUFFER_MIN_CAPACITY;
+		}
+
+		struct VulkanBuffer *buffer;
+		bool ret = vkmemory_createbuffer(
+			&app->vulkan_data->vmemory, sizeof(union ObjectTransform) * capacity,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &buffer);
+		if (ret == false) {
+			fprintf(stderr, "Failure creating transform buffer.\n");
+			return false;
+		}
+
+		void *map;
+		if (vkmemory_mapbuffer(&app->vulkan_data->vmemory, buffer, &map) == false) {
+			vkmemory_releasebuffer(&app->vulkan_data->vmemory, buffer);
+			return false;
+		}
+
+		// Old buffer may still be bound by recorded command buffers, let it retire
+		if (app->vulkan_data->transform_buffers[frame] != NULL) {
+			vkmemory_releasebuffer(&app->vulkan_data->vmemory,
+								   app->vulkan_data->transform_buffers[frame]);
+		}
+		app->vulkan_data->transform_buffers[frame] = buffer;
+		app->vulkan_data->transform_maps[frame] = map;
+		app->vulkan_data->transform_capacity[frame] = capacity;
+
+		VkDescriptorBufferInfo buffer_info = {0};
+		buffer_info.buffer = buffer->buffer;
+		buffer_info.offset = 0;
+		buffer_info.range = VK_WHOLE_SIZE;
+
+		VkWriteDescriptorSet write = {0};
+		write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		write.dstSet = app->vulkan_data->transform_sets[frame];
+		write.dstBinding = 0;
+		write.descriptorCount = 1;
+		write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		write.pBufferInfo = &buffer_info;
+
+		vkUpdateDescriptorSets(app->vulkan_data->device, 1, &write, 0, NULL);
+
+		// Command buffers that bound the old set are invalid
+		atomic_fetch_add(&obj_grp->generation, 1);
+	}
+
+	memcpy(app->vulkan_data->transform_maps[frame], obj_grp->transforms,
+		   sizeof(*obj_grp->transforms) * obj_grp->transforms_size);
+	return true;
+}
+
+// GPU culling pays off for large groups on devices that can draw them indirectly
+bool vulkan_usegpucull(struct Application *app, struct ObjectGroup *obj_grp) {
+	return app->vulkan_data->gpu_cull_supported &&
+		   obj_grp->transforms_size >= VULKAN_GPU_CULL_THRESHOLD &&
+		   obj_grp->commands_size <= app->vulkan_data->max_draw_indirect_count;
+}
+
+/*
+	Keeps the frame's cull data buffer sized for every transform slot, since the vertex shader's
+	set references it. Its tints are copied in every frame, since indirect and instanced draws read
+	them. When the group is culled on the GPU the batches are copied in too, and the command and
+	counter buffers are sized to match.
+*/
+bool vulkan_updateculldata(struct Application *app, bool gpu_cull) {
+	struct ObjectGroup *obj_grp = app->object_group;
+	uint32_t frame = app->vulkan_data->current_frame;
+
+	app->vulkan_data->cull_counts_size[frame] = 0;
+	if (obj_grp->transforms_size == 0) {
+		return true;
+	}
+
+	if (vulkan_reservecullbuffer(app, CULL_BUFFER_OBJECTS, obj_grp->transforms_size) == false) {
+		return false;
+	}
+	if (gpu_cull == false) {
+		// Merged and instanced CPU-culled draws read their tint here as well
+		memcpy(app->vulkan_data->cull_maps[frame][CULL_BUFFER_OBJECTS], obj_grp->cull_data,
+			   sizeof(*obj_grp->cull_data) * obj_grp->transforms_size);
+		return true;
+	}
+
+	if (vulkan_reservecullbuffer(app, CULL_BUFFER_BATCHES, obj_grp->batches_size) == false ||
+		vulkan_reservecullbuffer(app, CULL_BUFFER_COMMANDS, obj_grp->commands_size) == false ||
+		vulkan_reservecullbuffer(app, CULL_BUFFER_COUNTS, obj_grp->batches_size + 1) == false) {
+		return false;
+	}
+
+	memcpy(app->vulkan_data->cull_maps[frame][CULL_BUFFER_OBJECTS], obj_grp->cull_data,
+		   sizeof(*obj_grp->cull_data) * obj_grp->transforms_size);
+
+	struct VulkanCullBatch *batches = app->vulkan_data->cull_maps[frame][CULL_BUFFER_BATCHES];
+	uint32_t b;
+	for (b = 0; b < obj_grp->batches_size; b++) {
+		batches[b].command_base = obj_grp->batches[b].command_base;
+		batches[b].indexed = obj_grp->batches[b].indexed;
+		batches[b].pipeline = obj_grp->batches[b].pltype;
+		batches[b].reserved = 0;
+	}
+
+	app->vulkan_data->cull_counts_size[frame] = obj_grp->batches_size + 1;
+	return true;
+}
+
+// Adds the counters of the frame's last cull pass, finished since its fence signaled
+void vulkan_readcullcounts(struct Application *app, struct FrameStats *stats) {
+	uint32_t frame = app->vulkan_data->current_frame;
+	uint32_t i, counts_size = app->vulkan_data->cull_counts_size[frame];
+	const uint32_t *counts = app->vulkan_data->cull_maps[frame][CULL_BUFFER_COUNTS];
+
+	if (counts_size == 0) {
+		return;
+	}
+
+	stats->objects_culled += counts[0];
+	for (i = 1; i < counts_size; i++) {
+		stats->objects_visible += counts[i];
+	}
+}
+
+/*
+	Grows one of the frame's cull buffers to hold 'count' elements and rewrites its descriptors.
+	Commands stay in device-local memory, everything else is mapped.
+*/
+bool vulkan_reservecullbuffer(struct Application *app, enum CullBuffer which, size_t count) {
+	static const VkDeviceSize strides[NUM_CULL_BUFFERS] = {
+		sizeof(struct ObjectCullData), sizeof(struct VulkanCullBatch), VULKAN_DRAW_COMMAND_SIZE,
+		sizeof(uint32_t)};
+	uint32_t frame = app->vulkan_data->current_frame;
+
+	if (count <= app->vulkan_data->cull_capacity[frame][which]) {
+		return true;
+	}
+
+	size_t capacity = app->vulkan_data->cull_capacity[frame][which] * 2;
+	if (capacity < count) {
+		capacity = count;
+	}
+	if (capacity < TRANSFORM_BUFFER_MIN_CAPACITY) {
+		capacity = TRANSFORM_BUFFER_MIN_CAPACITY;
+	}
+
+	VkBufferUsageFlags usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+	VkMemoryPropertyFlags properties =
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+	if (which == CULL_BUFFER_COMMANDS) {
+		usage |= VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT;
+		properties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+	} else if (which == CULL_BUFFER_COUNTS) {
+		// Cleared by the cull pass and read back for frame stats
+		usage |= VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+	}
+
+	struct VulkanBuffer *buffer;
+	bool ret = vkmemory_createbuffer(&app->vulkan_data->vmemory, strides[which] * capacity, usage,
+									 properties, &buffer);
+	if (ret == false) {
+		fprintf(stderr, "Failure creating cull buffer.\n");
+		return false;
+	}
+
+	void *map = NULL;
+	if (which != CULL_BUFFER_COMMANDS &&
+		vkmemory_mapbuffer(&app->vulkan_data->vmemory, buffer, &map) == false) {
+		vkmemory_releasebuffer(&app->vulkan_data->vmemory, buffer);
+		return false;
+	}
+
+	// Old buffer may still be bound by recorded command buffers, let it retire
+	if (app->vulkan_data->cull_buffers[frame][which] != NULL) {
+		vkmemory_releasebuffer(&app->vulkan_data->vmemory,
+							   app->vulkan_data->cull_buffers[frame][which]);
+	}
+	app->vulkan_data->cull_buffers[frame][which] = buffer;
+	app->vulkan_data->cull_maps[frame][which] = map;
+	app->vulkan_data->cull_capacity[frame][which] = capacity;
+
+	VkDescriptorBufferInfo buffer_info = {0};
+	buffer_info.buffer = buffer->buffer;
+	buffer_info.offset = 0;
+	buffer_info.range = VK_WHOLE_SIZE;
+
+	VkWriteDescriptorSet writes[2] = {0};
+	uint32_t writes_size = 1;
+	writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	writes[0].dstSet = app->vulkan_data->cull_sets[frame];
+	writes[0].dstBinding = which;
+	writes[0].descriptorCount = 1;
+	writes[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	writes[0].pBufferInfo = &buffer_info;
+
+	// The vertex shader reads indirect draws' tints from the cull data
+	if (which == CULL_BUFFER_OBJECTS) {
+		writes[1] = writes[0];
+		writes[1].dstSet = app->vulkan_data->transform_sets[frame];
+		writes[1].dstBinding = 2;
+		writes_size = 2;
+	}
+
+	vkUpdateDescriptorSets(app->vulkan_data->device, writes_size, writes, 0, NULL);
+
+	// Recorded cull passes and indirect draws used the old buffers
+	atomic_fetch_add(&app->object_group->generation, 1);
+	return true;
+}
+
+#ifdef OBJECT_PUSH_UBO
+// Grows the frame's per-draw uniform buffer to one block per transform slot
+bool vulkan_updatepushbuffer(struct Application *app) {
+	struct ObjectGroup *obj_grp = app->object_group;
+	uint32_t frame = app->vulkan_data->current_frame;
+
+	if (obj_grp->transforms_size <= app->vulkan_data->push_capacity[frame]) {
+		return true;
+	}
+
+	size_t capacity = app->vulkan_data->transform_capacity[frame];
+	struct VulkanBuffer *buffer;
+	bool ret = vkmemory_createbuffer(
+		&app->vulkan_data->vmemory, app->vulkan_data->push_stride * capacity,
+		VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &buffer);
+	if (ret == false) {
+		fprintf(stderr, "Failure creating per-draw uniform buffer.\n");
+		return false;
+	}
+
+	void *map;
+	if (vkmemory_mapbuffer(&app->vulkan_data->vmemory, buffer, &map) == false) {
+		vkmemory_releasebuffer(&app->vulkan_data->vmemory, buffer);
+		return false;
+	}
+
+	if (app->vulkan_data->push_buffers[frame] != NULL) {
+		vkmemory_releasebuffer(&app->vulkan_data->vmemory, app->vulkan_data->push_buffers[frame]);
+	}
+	app->vulkan_data->push_buffers[frame] = buffer;
+	app->vulkan_data->push_maps[frame] = map;
+	app->vulkan_data->push_capacity[frame] = capacity;
+
+	VkDescriptorBufferInfo buffer_info = {0};
+	buffer_info.buffer = buffer->buffer;
+	buffer_info.offset = 0;
+	buffer_info.range = OBJECT_PUSH_SIZE;
+
+	VkWriteDescriptorSet write = {0};
+	write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	write.dstSet = app->vulkan_data->transform_sets[frame];
+	write.dstBinding = 1;
+	write.descriptorCount = 1;
+	write.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	write.pBufferInfo = &buffer_info;
+
+	vkUpdateDescriptorSets(app->vulkan_data->device, 1, &write, 0, NULL);
+
+	// Command buffers that bound the old set are invalid
+	atomic_fetch_add(&obj_grp->generation, 1);
+	return true;
+}
+#endif
+
 // Shader functions
 struct ShaderFile vulkan_readshaderfile(const char *filename) {
 	struct ShaderFile return_shader = {0};
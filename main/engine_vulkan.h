@@ -5,6 +5,7 @@
 #include "engine_vkmemory.h"
 #include "hashdata.h"
 #include "object_struct.h"
+#include "threadpool.h"
 
 #include <assert.h>
 #include <math.h>
@@ -20,11 +21,69 @@
 #define GFX_INDICES_SIZE 1
 #define PRESENT_INDICES_SIZE 1
 #define TRANSFER_INDICES_SIZE 1
+#define TRANSFER_QUEUES_SIZE 4
+#define TRANSFER_SPLIT_SIZE 1048576
+// Copy timed by the --bench-transfer switch, the largest buffer one memory block holds
+#define TRANSFER_BENCH_SIZE VK_ALLOC_BLOCK_SIZE
 
 #define MAX_FRAMES_IN_FLIGHT 2
+#define TRANSFORM_BUFFER_MIN_CAPACITY 256
+
+// Push constant space every implementation has to provide
+#define VULKAN_MIN_PUSH_CONSTANTS_SIZE 128
+
+// Blocks over the guaranteed size go through a dynamic uniform buffer instead
+#if OBJECT_PUSH_SIZE > VULKAN_MIN_PUSH_CONSTANTS_SIZE
+#define OBJECT_PUSH_UBO
+#endif
 #define VULKAN_HASHSET_SIZE 32
 
-enum ShaderCache { VERTEX_SHADER_2D, FRAGMENT_SHADER_2D, NUM_SHADER_CACHE };
+// Groups with at least this many transform slots are culled by a compute pass
+#define VULKAN_GPU_CULL_THRESHOLD 65536
+#define VULKAN_CULL_WORKGROUP_SIZE 64
+// Commands are VkDrawIndexedIndirectCommand sized, non-indexed batches use the first 16 bytes
+#define VULKAN_DRAW_COMMAND_SIZE 20
+/*
+	Draw sort key fields, most significant first: pipeline, layer, vertex buffer, mesh and depth.
+	2D objects are drawn in layer order taken from their z position, so buffers and meshes are
+	only grouped within a layer. 3D objects are sorted by depth within a mesh. The bits above
+	VULKAN_SORT_BUFFER_SHIFT give the draw order static draws must stay beneath to be split off.
+*/
+#define VULKAN_SORT_PIPELINE_SHIFT 60
+#define VULKAN_SORT_LAYER_SHIFT 44
+#define VULKAN_SORT_BUFFER_SHIFT 32
+#define VULKAN_SORT_MESH_SHIFT 16
+#define VULKAN_SORT_FIELD_MASK 0xFFFFu
+#define VULKAN_SORT_BUFFER_MASK 0xFFFu
+#define VULKAN_SORT_RADIX_BITS 8
+// Screen error a level of detail may add
+#define VULKAN_LOD_ERROR_PIXELS 1.0f
+// Object index telling shader2d.vs to read the instance's transform & tint from storage buffers
+#define VULKAN_OBJECT_INDIRECT UINT32_MAX
+// Shortest run of draws on the same bindings merged into one indirect call
+#define VULKAN_MULTI_DRAW_MIN 4
+// Shortest run of draws of one mesh drawn as instances of a single draw
+#define VULKAN_INSTANCE_MIN 4
+// Draw lists at least this long are recorded into secondary command buffers across the thread pool
+#define VULKAN_PARALLEL_RECORD_THRESHOLD 2048
+#define VULKAN_MAX_RECORD_SLICES (THREADPOOL_MAX_THREADS + 1)
+
+enum ShaderCache {
+	VERTEX_SHADER_2D,
+	VERTEX_SHADER_2D_INSTANCED,
+	FRAGMENT_SHADER_2D,
+	COMPUTE_SHADER_CULL,
+	NUM_SHADER_CACHE
+};
+
+// Buffers of the GPU cull pass, in binding order of its descriptor set
+enum CullBuffer {
+	CULL_BUFFER_OBJECTS,
+	CULL_BUFFER_BATCHES,
+	CULL_BUFFER_COMMANDS,
+	CULL_BUFFER_COUNTS,
+	NUM_CULL_BUFFERS
+};
 
 struct QueueFamilies {
 	uint32_t graphics_count;
@@ -33,6 +92,9 @@ struct QueueFamilies {
 	uint32_t present_indices[PRESENT_INDICES_SIZE];
 	uint32_t transfer_count;
 	uint32_t transfer_indices[TRANSFER_INDICES_SIZE];
+	// Queues to create from the transfer family, false if it is shared with graphics
+	uint32_t transfer_queue_count;
+	bool transfer_dedicated;
 };
 
 struct SwapChainSupportDetails {
@@ -48,6 +110,113 @@ struct ShaderFile {
 	size_t size;
 };
 
+// Draw batch as read by shadercull.cs
+struct VulkanCullBatch {
+	uint32_t command_base;
+	uint32_t indexed;
+	uint32_t pipeline;
+	uint32_t reserved;
+};
+
+// Push constants of the cull pass, one dispatch per pipeline
+struct VulkanCullPush {
+	float planes[CULL_MAX_PLANES][4];
+	uint32_t planes_size;
+	uint32_t objects_size;
+	uint32_t compact;
+	uint32_t pipeline;
+};
+
+/*
+	Per-frame counters, refreshed by vulkan_drawframe. Counts from the GPU cull pass are read back
+	when the frame's buffers come around again, so they lag by MAX_FRAMES_IN_FLIGHT frames.
+*/
+struct FrameStats {
+	uint64_t frame;
+	size_t objects_visible;
+	size_t objects_culled;
+
+	// Pipeline & buffer binds recorded, and buffer binds saved over binding for every draw. Both
+	// are from the last recording when the frame reused its command buffer
+	size_t binds_issued;
+	size_t binds_skipped;
+
+	// Draws joined into a preceding draw's indirect call or made as its extra instances, from the
+	// last recording
+	size_t draws_merged;
+	size_t draws_instanced;
+
+	// Whether the frame recorded its command buffer, and how many frames did so far
+	bool recorded;
+	uint64_t frames_recorded;
+};
+
+// Bind counts of one recorded range of the draw list
+struct VulkanRecordSlice {
+	size_t binds_issued;
+	size_t binds_skipped;
+	size_t draws_merged;
+	size_t draws_instanced;
+	bool failed;
+};
+
+// One entry of an indirect command buffer, non-indexed draws use the first 16 bytes
+union VulkanDrawCommand {
+	VkDrawIndexedIndirectCommand indexed;
+	VkDrawIndirectCommand draw;
+};
+
+// Host-visible stream written while recording, with room for an entry per draw list entry
+struct VulkanRecordStream {
+	struct VulkanBuffer *buffer;
+	void *map;
+	size_t capacity;
+};
+
+// Indirect commands of merged draws and transform slots of instanced draws
+struct VulkanRecordStreams {
+	struct VulkanRecordStream commands;
+	struct VulkanRecordStream instances;
+};
+
+// Draw list split across the thread pool, each slice recorded into its own secondary buffer
+struct VulkanRecordJob {
+	struct Application *app;
+	VkCommandBuffer *buffers;
+	VkFramebuffer framebuffer;
+	struct VulkanRecordStreams *streams;
+	size_t first;
+	struct VulkanRecordSlice slices[VULKAN_MAX_RECORD_SLICES];
+};
+
+/*
+	Object group generations a cached graphics command buffer was recorded from. CPU-culled
+	frames record static draws once into a secondary buffer of their own, kept while 'generation'
+	and 'static_generation' hold and re-executed by every recording of the primary.
+*/
+struct VulkanRecording {
+	uint64_t generation;
+	uint64_t draw_generation;
+	uint64_t static_generation;
+	bool gpu_cull;
+	bool valid;
+
+	size_t statics_size;
+	struct VulkanRecordSlice static_counts;
+	uint64_t static_order;
+	bool statics_valid;
+
+	// Streams of merged and instanced draws, dynamic and static ones kept apart like their buffers
+	struct VulkanRecordStreams streams;
+	struct VulkanRecordStreams static_streams;
+};
+
+// Visible object and its sort key, sorted every CPU-culled frame before recording
+struct VulkanDrawItem {
+	uint64_t key;
+	struct EngineObject *object;
+};
+
 struct VulkanData {
 	// Instance
 	VkInstance instance;
@@ -60,7 +229,12 @@ struct VulkanData {
 	VkDevice device;
 
 	// Graphics and present queue
-	VkQueue graphics_queue, present_queue, transfer_queue;
+	VkQueue graphics_queue, present_queue;
+
+	// Transfer queues (falls back to graphics queue if no dedicated family)
+	uint32_t transfer_queues_size;
+	VkQueue transfer_queues[TRANSFER_QUEUES_SIZE];
+	VkFence transfer_fences[TRANSFER_QUEUES_SIZE];
 
 	// Surface, swapchain, and associated variables
 	VkSurfaceKHR surface;
@@ -77,15 +251,81 @@ struct VulkanData {
 	VkPipelineLayout pipeline_layout2d;
 	VkPipelineLayout pipeline_layout3d;
 	VkPipeline pipeline2d;
+	VkPipeline pipeline2d_instanced;
 	VkPipeline pipeline3d;
 	VkShaderModule shadercache[NUM_SHADER_CACHE];
 
-	// Framebuffers & command buffers
+	// Per-object transform storage buffers, one per frame in flight, kept mapped
+	VkDescriptorSetLayout transform_set_layout;
+	VkDescriptorPool descriptor_pool;
+	VkDescriptorSet transform_sets[MAX_FRAMES_IN_FLIGHT];
+	struct VulkanBuffer *transform_buffers[MAX_FRAMES_IN_FLIGHT];
+	void *transform_maps[MAX_FRAMES_IN_FLIGHT];
+	size_t transform_capacity[MAX_FRAMES_IN_FLIGHT];
+
+	/*
+		GPU culling: a compute pass writes each batch's indirect commands and draw count. Without
+		VK_KHR_draw_indirect_count commands are not compacted and culled ones draw no instances.
+		CPU-culled frames use the same indirect draws to merge runs of draws on the same buffer.
+	*/
+	bool multi_draw_supported;
+	bool gpu_cull_supported;
+	uint32_t max_draw_indirect_count;
+	PFN_vkCmdDrawIndexedIndirectCountKHR draw_indexed_indirect_count;
+	PFN_vkCmdDrawIndirectCountKHR draw_indirect_count;
+	VkDescriptorSetLayout cull_set_layout;
+	VkDescriptorSet cull_sets[MAX_FRAMES_IN_FLIGHT];
+	VkPipelineLayout cull_pipeline_layout;
+	VkPipeline cull_pipeline;
+	struct VulkanBuffer *cull_buffers[MAX_FRAMES_IN_FLIGHT][NUM_CULL_BUFFERS];
+	void *cull_maps[MAX_FRAMES_IN_FLIGHT][NUM_CULL_BUFFERS];
+	size_t cull_capacity[MAX_FRAMES_IN_FLIGHT][NUM_CULL_BUFFERS];
+	// Counters written by the frame's last cull pass, 0 when it was culled on the CPU
+	uint32_t cull_counts_size[MAX_FRAMES_IN_FLIGHT];
+
+	// Draws of CPU-culled frames, 'draw_list' points at whichever array holds the sorted order
+	struct VulkanDrawItem *draw_items;
+	struct VulkanDrawItem *draw_items_temp;
+	struct VulkanDrawItem *draw_list;
+	size_t draw_list_size;
+	size_t draw_statics_size;
+	// Highest order of the listed static draws and lowest of the dynamic ones, statics are only
+	// split to the front of the list when they are all beneath every dynamic draw
+	uint64_t draw_static_order;
+	uint64_t draw_dynamic_order;
+	bool draw_statics_split;
+	size_t draw_items_capacity;
+
+#ifdef OBJECT_PUSH_UBO
+	// Per-draw blocks at each object's transform slot, bound with a dynamic offset
+	struct VulkanBuffer *push_buffers[MAX_FRAMES_IN_FLIGHT];
+	void *push_maps[MAX_FRAMES_IN_FLIGHT];
+	size_t push_capacity[MAX_FRAMES_IN_FLIGHT];
+	VkDeviceSize push_stride;
+#endif
+
+	// Framebuffers & command buffers. Graphics command buffers are kept per framebuffer and frame
+	// in flight, since they bind the frame's sets, and reused until their recording goes stale
 	uint32_t swapchain_framebuffers_size;
 	VkFramebuffer *swapchain_framebuffers;
 	VkCommandPool gfx_command_pool, tfr_command_pool;
 	uint32_t gfx_command_buffers_size, tfr_command_buffers_size;
 	VkCommandBuffer *gfx_command_buffers, *tfr_command_buffers;
+	struct VulkanRecording *gfx_recordings;
+
+	// One graphics pool per thread pool slice and frame in flight, at [frame * slices + slice], so
+	// slices record without locking. Each graphics command buffer has a secondary buffer per slice
+	// from them, at [buffer * slices + slice]
+	uint32_t record_slices_size;
+	VkCommandPool *record_pools;
+	VkCommandBuffer *record_buffers;
+	// Static draws of each graphics command buffer, from the pool of its frame's first slice
+	VkCommandBuffer *static_buffers;
+	// Vertex updates of each frame in flight, copied from the frame's staging stream by a command
+	// buffer submitted ahead of the frame, so frames still in flight keep reading the old data
+	VkCommandBuffer update_buffers[MAX_FRAMES_IN_FLIGHT];
+	struct VulkanRecordStream update_staging[MAX_FRAMES_IN_FLIGHT];
+	bool update_pending;
 
 	// Memory allocation info
 	struct VulkanMemory vmemory;
@@ -99,6 +339,7 @@ struct VulkanData {
 	VkFence *imgs_in_flight;
 	uint32_t current_frame;
 	bool framebuffer_resized;
+	struct FrameStats frame_stats;
 
 	// Structures required for creation
 	struct QueueFamilies qf_indices;
@@ -130,7 +371,10 @@ bool vulkan_createswapchain(struct Application *);
 bool vulkan_createimageviews(struct Application *);
 bool vulkan_createrenderpass(struct Application *);
 bool vulkan_createshaders(struct Application *);
+bool vulkan_createdescriptors(struct Application *);
+bool vulkan_createpipelinelayout(struct Application *, VkPipelineLayout *);
 bool vulkan_create2Dpipeline(struct Application *);
+bool vulkan_createcullpipeline(struct Application *);
 bool vulkan_createframebuffers(struct Application *);
 bool vulkan_createcommandpools(struct Application *);
 bool vulkan_createcommandbuffers(struct Application *);
@@ -139,16 +383,57 @@ bool vulkan_createsynchronization(struct Application *);
 // Vulkan transfer queue functions
 bool vulkan_copybuffer(struct Application *, struct VulkanMemory *, struct VulkanBuffer *,
 					   struct VulkanBuffer *, VkDeviceSize, VkDeviceSize);
+bool vulkan_copybufferregions(struct Application *, struct VulkanBuffer *, struct VulkanBuffer *,
+							  const VkBufferCopy *, uint32_t);
+bool vulkan_benchtransfer(struct Application *, VkDeviceSize);
+bool vulkan_beginupdates(struct Application *, VkDeviceSize, void **);
+void vulkan_recordupdates(struct Application *, struct VulkanBuffer *, const VkBufferCopy *,
+						  uint32_t);
+void vulkan_endupdates(struct Application *);
+bool vulkan_submitupdates(struct Application *);
 uint32_t vulkan_findmemorytype(struct Application *, uint32_t, VkMemoryPropertyFlags);
 
 // Command buffer recording
-bool vulkan_recordobjgrp(struct Application *, VkCommandBuffer, VkFramebuffer,
-						 struct ObjectGroup *);
-void vulkan_recordallocationlist(struct Application *, VkCommandBuffer,
-								 struct EngineObjectAllocation *);
+bool vulkan_recordframe(struct Application *, uint32_t, bool);
+bool vulkan_recordobjgrp(struct Application *, uint32_t, uint32_t, struct ObjectGroup *);
+bool vulkan_recordstatics(struct Application *, uint32_t, uint32_t);
+bool vulkan_recordsecondaries(struct Application *, VkCommandBuffer, uint32_t, uint32_t, size_t,
+							  bool);
+void vulkan_recordslice(void *, size_t, size_t, uint32_t);
+VkPipelineLayout vulkan_bindpipeline(struct Application *, VkCommandBuffer, enum PipelineType,
+									 bool);
+void vulkan_recorddrawlist(struct Application *, VkCommandBuffer, struct VulkanRecordStreams *,
+						   size_t, size_t, size_t, struct VulkanRecordSlice *);
+bool vulkan_samebindings(struct EngineObject *, struct EngineObject *);
+size_t vulkan_meshrun(struct Application *, size_t, size_t, size_t);
+void vulkan_drawcommand(struct Application *, struct EngineObject *, union VulkanDrawCommand *);
+bool vulkan_reservestreams(struct Application *, struct VulkanRecordStreams *, size_t);
+bool vulkan_reservestream(struct Application *, struct VulkanRecordStream *, size_t, size_t,
+						  VkBufferUsageFlags);
+void vulkan_releasestreams(struct Application *, struct VulkanRecordStreams *);
+uint32_t vulkan_selectlod(struct Application *, struct EngineObject *);
+void vulkan_pushobject(struct Application *, VkCommandBuffer, VkPipelineLayout,
+					   struct ObjectPushConstants *);
+void vulkan_recordgpucull(struct Application *, VkCommandBuffer, struct ObjectGroup *);
+void vulkan_recordbatches(struct Application *, VkCommandBuffer, VkPipelineLayout,
+						  struct ObjectGroup *, enum PipelineType);
+
+// Draw sorting
+bool vulkan_builddrawlist(struct Application *, struct ObjectGroup *, bool);
+uint64_t vulkan_sortkey(struct EngineObjectAllocation *, size_t, enum PipelineType);
+uint32_t vulkan_floatorder(float);
+struct VulkanDrawItem *vulkan_radixsort(struct VulkanDrawItem *, struct VulkanDrawItem *, size_t);
 
 // Frame draw
 bool vulkan_drawframe(struct Application *);
+bool vulkan_updatetransforms(struct Application *);
+bool vulkan_usegpucull(struct Application *, struct ObjectGroup *);
+bool vulkan_updateculldata(struct Application *, bool);
+void vulkan_readcullcounts(struct Application *, struct FrameStats *);
+bool vulkan_reservecullbuffer(struct Application *, enum CullBuffer, size_t);
+#ifdef OBJECT_PUSH_UBO
+bool vulkan_updatepushbuffer(struct Application *);
+#endif
 
 // Shader functions
 struct ShaderFile vulkan_readshaderfile(const char *);
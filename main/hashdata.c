@@ -151,6 +151,36 @@ bool hashtable_access(struct HashTable *hashtable, char *key, union HashTableVal
 	return false;
 }
 
+/**
+ * @brief Removes an item from the HashTable
+ *
+ * @param hashtable HashTable to remove from
+ * @param key Key to reference with
+ * @return true Item was removed
+ * @return false Item is not found
+ */
+bool hashtable_remove(struct HashTable *hashtable, char *key) {
+	uint32_t hash = __djb2_a(key);
+	uint32_t table_pos = hash % hashtable->size;
+	struct HashTableDefinition *data_pos = hashtable->table[table_pos], *prev_pos = NULL;
+
+	while (data_pos != NULL) {
+		if (strcmp(data_pos->key, key) == 0) {
+			if (prev_pos == NULL) {
+				hashtable->table[table_pos] = data_pos->next;
+			} else {
+				prev_pos->next = data_pos->next;
+			}
+			free(data_pos);
+			return true;
+		}
+		prev_pos = data_pos;
+		data_pos = data_pos->next;
+	}
+
+	return false;
+}
+
 /**
  * @brief Creates an empty HashSet of size 'size'
  *
@@ -307,4 +337,66 @@ uint32_t __djb2_a(const char *key) {
 	}
 
 	return hash;
-}
\ No newline at end of file
+}
+
+/**
+ * @brief 64-bit hash function for binary data (MurmurHash64A)
+ *
+ * Processes 8 bytes per step, used to key large blobs like mesh geometry
+ *
+ * @param key Input data
+ * @param len Length of input data in bytes
+ * @param seed Starting seed, chain calls by passing the previous hash
+ * @return uint64_t Output hash
+ */
+uint64_t __murmur64a(const void *key, size_t len, uint64_t seed) {
+	const uint64_t m = 0xc6a4a7935bd1e995ULL;
+	const int r = 47;
+	const unsigned char *data = key;
+	const unsigned char *end = data + (len & ~(size_t)7);
+	uint64_t hash = seed ^ (len * m);
+	uint64_t k;
+
+	while (data != end) {
+		memcpy(&k, data, sizeof(k));
+		data += sizeof(k);
+
+		k *= m;
+		k ^= k >> r;
+		k *= m;
+
+		hash ^= k;
+		hash *= m;
+	}
+
+	// Mix remaining bytes
+	switch (len & 7) {
+		case 7:
+			hash ^= (uint64_t)data[6] << 48;
+			// fall through
+		case 6:
+			hash ^= (uint64_t)data[5] << 40;
+			// fall through
+		case 5:
+			hash ^= (uint64_t)data[4] << 32;
+			// fall through
+		case 4:
+			hash ^= (uint64_t)data[3] << 24;
+			// fall through
+		case 3:
+			hash ^= (uint64_t)data[2] << 16;
+			// fall through
+		case 2:
+			hash ^= (uint64_t)data[1] << 8;
+			// fall through
+		case 1:
+			hash ^= (uint64_t)data[0];
+			hash *= m;
+	}
+
+	hash ^= hash >> r;
+	hash *= m;
+	hash ^= hash >> r;
+
+	return hash;
+}
@@ -53,6 +53,7 @@ void hashtable_destroy(struct HashTable *);
 bool hashtable_store(struct HashTable *, char *, union HashTableValue, enum HashTableType);
 bool hashtable_exists(struct HashTable *, char *);
 bool hashtable_access(struct HashTable *, char *, union HashTableValue *);
+bool hashtable_remove(struct HashTable *, char *);
 
 struct HashSet *hashset_create(size_t size);
 void hashset_destroy(struct HashSet *);
@@ -61,5 +62,6 @@ bool hashset_exists(struct HashSet *, const char *);
 void hashset_print(struct HashSet *);
 
 uint32_t __djb2_a(const char *);
+uint64_t __murmur64a(const void *, size_t, uint64_t);
 
 #endif
\ No newline at end of file
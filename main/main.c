@@ -3,10 +3,12 @@
 #include "config.h"
 #include "engine_object.h"
 #include "engine_vulkan.h"
+#include "threadpool.h"
 
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 int main(int argc, char **argv) {
 	printf("VLK Engine - Version %s\n", VERSION_NUMBER);
@@ -17,8 +19,12 @@ int main(int argc, char **argv) {
 
 	struct VulkanData vulkan_data = {0};
 	struct ObjectGroup objgrp = {0};
-	struct Application app = {
-		.execute_path = {0}, .window = NULL, .vulkan_data = &vulkan_data, .object_group = &objgrp};
+	struct ThreadPool thread_pool = {0};
+	struct Application app = {.execute_path = {0},
+							  .window = NULL,
+							  .vulkan_data = &vulkan_data,
+							  .object_group = &objgrp,
+							  .thread_pool = &thread_pool};
 
 	bool ret = application_init(&app);
 	if (ret == false) {
@@ -26,6 +32,14 @@ int main(int argc, char **argv) {
 		return EXIT_FAILURE;
 	}
 
+	// Measure copy bandwidth of the queues instead of running
+	if (argc > 1 && strcmp(argv[1], "--bench-transfer") == 0) {
+		ret = vulkan_benchtransfer(&app, TRANSFER_BENCH_SIZE);
+		vkDeviceWaitIdle(vulkan_data.device);
+		application_close(&app);
+		return ret ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
 	while (application_loopcondition(&app)) {
 		application_loopevent(&app);
 	}
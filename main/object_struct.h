@@ -1,114 +1,306 @@
 #include "GLFW/glfw3.h"
+#include "engine_mesh.h"
+#include "engine_spatial.h"
 
 #include <pthread.h>
+#include <stdatomic.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 #ifndef OBJECTS_H
 #define OBJECTS_H
 
+#define OBJECT_SOA_ALIGNMENT 32
+
+// Hierarchy index of objects without a parent or children
+#define OBJECT_HIERARCHY_NONE SIZE_MAX
+
 enum PipelineType { NO_PIPELINE, PIPELINE_2D, PIPELINE_3D, NUM_PIPELINES };
 
-union UniformData {
-	struct {
-		float translate[4];
-		float rotation[4];
-		float scale[4];
-	} u2d;
+enum ObjectFlags {
+	OBJECT_FLAG_STATIC = 1 << 0,
+	OBJECT_FLAG_RETIRED = 1 << 1,
+	// Transform changed since the last flush
+	OBJECT_FLAG_DIRTY = 1 << 2
+};
+
+/*
+	Per-object entry of the transform storage buffer, read by the vertex shader at gl_InstanceIndex.
+	Both layouts are 64 bytes so one std430 array serves every pipeline. 2D entries hold the two
+	rows of the affine (rotation & translation), built by engine_transform.c.
+*/
+union ObjectTransform {
 	struct {
-		float model[16];
-		float view[16];
-		float projection[16];
-	} u3d;
+		float affine[2][4];
+		float reserved[8];
+	} t2d;
+	float model[16];
 };
 
 /*
-	How RenderData would eventually be drawn when properly bound via command buffer:
+	Planes objects are culled against, (a, b, c, d) with the inside where ax + by + cz + d >= 0.
+	A view without planes keeps every object.
+*/
+#define CULL_MAX_PLANES 6
 
-	> vkCmdBindDescriptorSets(buff, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, 0, 1, &descriptor_set,
-		1, &uniform_position);
-	> vkCmdDrawIndexed(buff, indices_size, 1, indices_position, vertex_position, 0);
+struct CullView {
+	float planes[CULL_MAX_PLANES][4];
+	uint32_t planes_size;
+};
 
+/*
+	Per-object entry of the cull data buffer, at the same slot as the object's transform. Read by
+	the GPU cull pass (shadercull.cs) to write draw commands and by shader2d.vs for the tint of
+	indirect draws. Laid out for std430.
 */
+#define OBJECT_CULL_LIVE 1u
+#define OBJECT_BATCH_NONE UINT32_MAX
 
-struct RenderData {
-	// Pipeline
+struct ObjectCullData {
+	// World bounds, with the index count (or vertex count if not indexed) in the spare lane
+	float bounds_min[3];
+	uint32_t count;
+	// First index (or first vertex) in the batch's buffer
+	float bounds_max[3];
+	uint32_t first;
+	float tint[4];
+	int32_t vertex_offset;
+	// Draw batch and the object's command within it when draws are not compacted
+	uint32_t batch;
+	uint32_t batch_slot;
+	uint32_t flags;
+};
+
+_Static_assert(sizeof(struct ObjectCullData) == 64, "struct ObjectCullData must be 64 bytes");
+
+/*
+	Objects of one pipeline drawn by one indirect call because they share a vertex & index buffer
+	and index type. Each batch owns 'objects_size' consecutive commands starting at
+	'command_base' in the frame's indirect buffer, and keeps a reference to its buffer while any
+	of its objects is live. Compaction renumbers the slots, and a batch left without objects is
+	reused for the next buffer.
+*/
+struct ObjectDrawBatch {
 	enum PipelineType pltype;
+	struct VulkanBuffer *buffer;
+	VkIndexType index_type;
+	bool indexed;
 
-	// Vertex & index buffer
-	struct VulkanBuffer *vi_buffer;
-	VkDeviceSize vertex_offset;
-	VkDeviceSize index_offset;
+	uint32_t objects_size;
+	uint32_t live_size;
+	uint32_t command_base;
+};
 
-	// Vertices
-	struct Vertex *vertices;
-	size_t vertices_size;
+/*
+	Per-draw block sent with vkCmdPushConstants, or through a dynamic uniform buffer when
+	OBJECT_PUSH_UBO is defined. Laid out for both std430 and std140, see shader2d.vs.
+*/
+#define OBJECT_PUSH_SIZE 64
 
-	// Indices
-	uint64_t *indices;
-	size_t indices_size;
+struct ObjectPushConstants {
+	uint32_t object_index;
+	uint32_t reserved[3];
+	float tint[4];
+	// 2D affine transform rows, xyz used
+	float transform[2][4];
+};
+
+_Static_assert(sizeof(struct ObjectPushConstants) == OBJECT_PUSH_SIZE,
+			   "OBJECT_PUSH_SIZE must match struct ObjectPushConstants");
+
+/*
+	How RenderData is drawn, with the transform buffer bound once per pipeline:
+
+	> vkCmdBindDescriptorSets(buff, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, 0, 1, &transform_set,
+		0, NULL);
+	> vkCmdDrawIndexed(buff, indices_size, 1, 0, 0, transform_base + index);
 
-	// Uniform buffer as descriptor set
-	VkBuffer uni_buffer;
-	VkDescriptorSet desc_set;
-	VkDeviceSize uniform_offset;
+*/
+
+struct RenderData {
+	// Pipeline
+	enum PipelineType pltype;
 
-	// Uniforms
-	union UniformData *uniforms;
-	size_t uniform_size;
+	// Geometry, shared with other objects through the mesh registry
+	struct EngineMesh *mesh;
+
+	// Color multiplier sent with each draw
+	float tint[4];
 };
 
+/*
+	Render handle for an object. Transforms and flags are stored in the owning allocation's
+	arrays at 'index' and accessed through the object_get/object_set functions. Both change when
+	compaction moves the object, the handle itself does not.
+*/
 struct EngineObject {
 	struct RenderData render_data;
 
-	// x, y, z position
-	float pos[3];
-	// rotation along axis
-	float rot[3];
+	// Owning allocation and slot in its arrays
+	struct EngineObjectAllocation *allocation;
+	size_t index;
+
+	// Scene graph, position & rotation are relative to 'parent' when set
+	struct EngineObject *parent;
+	size_t hierarchy_index;
+	uint32_t depth;
+
+	// Leaf in the group's spatial tree for this pipeline, SPATIAL_NULL when not indexed
+	uint32_t spatial_proxy;
 
 	// Functional information
 	struct Application *owner;
+	char name[16];
 
 	// Memory allocation information
-	uint16_t retain_count;
-	bool is_static : 1;
+	_Atomic uint32_t retain_count;
 };
 
 struct EngineObjectCreateInfo {
 	enum PipelineType pltype;
 
+	// Geometry is read by objgrp_processqueue, not when queued, and must stay valid until then
 	struct Vertex *vertices;
 	size_t vertices_size;
 
-	int *indices;
+	uint32_t *indices;
 	size_t indices_size;
 
+	// Initial x, y, z position and rotation along axis
+	float pos[3];
+	float rot[3];
+
 	bool is_static;
 	char name[16];
+
+	// CPU geometry kept once a static mesh is uploaded, the group's policy by default
+	enum MeshRetention retention;
 };
 
+/*
+	Fixed-capacity chunk of a pipeline's objects. 256 objects fill 16 KiB of streams and handle
+	pointers, and every chunk owns as many transform slots from 'transform_base' whether used or
+	not.
+*/
+#define OBJECT_CHUNK_CAPACITY 256
+
 struct EngineObjectAllocation {
-	struct EngineObject *objects;
+	// Render handles, which live in the group's object pool so they stay put when moved
+	struct EngineObject **objects;
 	size_t objects_size;
-	pthread_mutex_t lock;
-	struct EngineObjectAllocation *next;
+
+	// Structure-of-arrays storage, one stream per component, OBJECT_SOA_ALIGNMENT aligned and
+	// padded so SIMD passes can run over whole vectors
+	float *pos[3];
+	float *rot[3];
+	uint32_t *flags;
+
+	// Single allocation holding the handle pointers followed by every stream
+	void *soa_block;
+
+	// World-space bounds, refreshed whenever the object's transform is rebuilt
+	float *bounds_min[3];
+	float *bounds_max[3];
+
+	// Indices of objects that passed the last cull, walked by command recording
+	uint32_t *visible;
+	size_t visible_size;
+
+	// Set when any object has OBJECT_FLAG_DIRTY, so clean allocations are skipped on flush
+	_Atomic bool transforms_dirty;
+
+	// First slot of this allocation in the group's transform array
+	size_t transform_base;
 };
 
+/*
+	Objects of one pipeline packed into chunks. Chunks in use come first and are all full but the
+	last, destroyed objects are filled by the pipeline's last object on flush. Chunks emptied that
+	way are kept after the used ones, with their transform slots, for the next objects.
+*/
 struct EnginePipeline {
 	enum PipelineType pltype;
-	struct EngineObjectAllocation *allocations;
-};
-
-struct ObjectGroupQueue {
-	struct EngineObjectCreateInfo *info;
-	struct ObjectGroupQueue *next;
+	struct EngineObjectAllocation **chunks;
+	size_t chunks_size;
+	size_t chunks_allocated;
+	size_t chunks_capacity;
+	size_t objects_size;
 };
 
 struct ObjectGroup {
 	struct VulkanMemory *memory_pool;
 	struct EnginePipeline pipelines[NUM_PIPELINES];
 	struct HashTable *object_table;
-	struct ObjectGroupQueue *queue[NUM_PIPELINES];
+	struct MeshRegistry mesh_registry;
+
+	// Retention of static meshes whose create info doesn't pick one
+	enum MeshRetention retention;
+
+	// Temporary memory of objgrp_processqueue, reset at the start of each batch
+	struct Arena scratch;
+
+	// Shared blocks holding mesh geometry, each freed once its meshes are released
+	struct Arena mesh_arena;
+
+	// Chunk headers and render handles, handles are reused once their object is compacted away
+	struct Pool allocation_pool;
+	struct Pool object_pool;
+
+	// Spatial index of each pipeline's objects by world bounds
+	struct SpatialTree spatial[NUM_PIPELINES];
+
+	// View each pipeline's objects are culled against before recording
+	struct CullView views[NUM_PIPELINES];
+
+	// Growable arrays of copied create infos waiting to be processed
+	struct EngineObjectCreateInfo *queue[NUM_PIPELINES];
 	size_t queue_size[NUM_PIPELINES];
+	size_t queue_capacity[NUM_PIPELINES];
+
+	// CPU copy of the transform buffer, copied to the GPU whole every frame
+	union ObjectTransform *transforms;
+	size_t transforms_size;
+	size_t transforms_capacity;
+
+	// CPU copy of the cull data buffer, parallel to 'transforms'
+	struct ObjectCullData *cull_data;
+
+	// Draw batches for GPU culling, never removed so cull data can index them
+	struct ObjectDrawBatch *batches;
+	uint32_t batches_size;
+	uint32_t batches_capacity;
+	uint32_t commands_size;
+
+	// Meshes with changed vertices waiting for the next flush, each holding a reference
+	struct EngineMesh **dirty_meshes;
+	size_t dirty_size;
+	size_t dirty_capacity;
+	pthread_mutex_t dirty_lock;
+
+	// Objects with a parent or children, sorted by depth so parents are written before children
+	struct EngineObject **hierarchy;
+	bool *hierarchy_changed;
+	size_t hierarchy_size;
+	size_t hierarchy_capacity;
+	bool hierarchy_sorted;
+
+	// Set when any hierarchy member moved, so static hierarchies are skipped on flush
+	_Atomic bool hierarchy_dirty;
+	pthread_mutex_t hierarchy_lock;
+
+	// Objects whose last reference was dropped, destroyed by the next flush on the owning thread
+	struct EngineObject **retired;
+	size_t retired_size;
+	size_t retired_capacity;
+	pthread_mutex_t retired_lock;
+
+	// Bumped whenever recorded draw commands go out of date. 'generation' covers which objects,
+	// batches and GPU resources are drawn, 'draw_generation' the per-draw data only CPU-culled
+	// frames record: transforms, tints and what is visible. 'static_generation' is bumped instead
+	// of 'draw_generation' when that data changes for an OBJECT_FLAG_STATIC object
+	_Atomic uint64_t generation;
+	_Atomic uint64_t draw_generation;
+	_Atomic uint64_t static_generation;
 };
 
 #endif	// OBJECTS_H
\ No newline at end of file
@@ -2,12 +2,59 @@
 #pragma shader_stage(vertex)
 #extension GL_ARB_separate_shader_objects : enable
 
+// Matches union ObjectTransform in object_struct.h
+struct ObjectTransform {
+	vec4 affine[2];
+	vec4 reserved[2];
+};
+
+layout(std430, set = 0, binding = 0) readonly buffer TransformBuffer {
+	ObjectTransform transforms[];
+};
+
+// Matches struct ObjectCullData, only the tint is read here
+struct ObjectCullData {
+	vec4 boundsMin;
+	vec4 boundsMax;
+	vec4 tint;
+	uvec4 draw;
+};
+
+layout(std430, set = 0, binding = 2) readonly buffer CullDataBuffer {
+	ObjectCullData cullData[];
+};
+
+// Object index of draws written by the cull pass, see VULKAN_OBJECT_INDIRECT
+const uint OBJECT_INDIRECT = 0xFFFFFFFFu;
+
+// Matches struct ObjectPushConstants, compile with -DOBJECT_PUSH_UBO for the uniform fallback
+#ifdef OBJECT_PUSH_UBO
+layout(std140, set = 0, binding = 1) uniform ObjectPush {
+#else
+layout(push_constant) uniform ObjectPush {
+#endif
+	uint objectIndex;
+	vec4 tint;
+	vec4 transform[2];
+} push;
+
 layout(location = 0) in vec2 inPosition;
 layout(location = 1) in vec3 inColor;
 
 layout(location = 0) out vec3 fragColor;
 
 void main() {
-	gl_Position = vec4(inPosition, 0.0, 1.0);
-	fragColor = inColor;
+	// Affine from the per-draw block, or from the instance's slot for indirect draws
+	vec4 row0 = push.transform[0];
+	vec4 row1 = push.transform[1];
+	vec4 tint = push.tint;
+	if (push.objectIndex == OBJECT_INDIRECT) {
+		row0 = transforms[gl_InstanceIndex].affine[0];
+		row1 = transforms[gl_InstanceIndex].affine[1];
+		tint = cullData[gl_InstanceIndex].tint;
+	}
+
+	vec3 position = vec3(inPosition, 1.0);
+	gl_Position = vec4(dot(row0.xyz, position), dot(row1.xyz, position), 0.0, 1.0);
+	fragColor = inColor * tint.rgb;
 }
\ No newline at end of file
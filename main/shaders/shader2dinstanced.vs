@@ -0,0 +1,42 @@
+#version 450
+#pragma shader_stage(vertex)
+#extension GL_ARB_separate_shader_objects : enable
+
+// Matches union ObjectTransform in object_struct.h
+struct ObjectTransform {
+	vec4 affine[2];
+	vec4 reserved[2];
+};
+
+layout(std430, set = 0, binding = 0) readonly buffer TransformBuffer {
+	ObjectTransform transforms[];
+};
+
+// Matches struct ObjectCullData, only the tint is read here
+struct ObjectCullData {
+	vec4 boundsMin;
+	vec4 boundsMax;
+	vec4 tint;
+	uvec4 draw;
+};
+
+layout(std430, set = 0, binding = 2) readonly buffer CullDataBuffer {
+	ObjectCullData cullData[];
+};
+
+layout(location = 0) in vec2 inPosition;
+layout(location = 1) in vec3 inColor;
+// Per-instance transform slot, see vertex_getinstanceattributedescriptions
+layout(location = 2) in uint inObject;
+
+layout(location = 0) out vec3 fragColor;
+
+void main() {
+	vec4 row0 = transforms[inObject].affine[0];
+	vec4 row1 = transforms[inObject].affine[1];
+	vec4 tint = cullData[inObject].tint;
+
+	vec3 position = vec3(inPosition, 1.0);
+	gl_Position = vec4(dot(row0.xyz, position), dot(row1.xyz, position), 0.0, 1.0);
+	fragColor = inColor * tint.rgb;
+}
\ No newline at end of file
@@ -0,0 +1,111 @@
+#version 450
+#pragma shader_stage(compute)
+
+layout(local_size_x = 64) in;
+
+// Matches struct ObjectCullData in object_struct.h
+struct ObjectCullData {
+	vec3 boundsMin;
+	uint count;
+	vec3 boundsMax;
+	uint first;
+	vec4 tint;
+	int vertexOffset;
+	uint batch;
+	uint batchSlot;
+	uint flags;
+};
+
+// Matches struct VulkanCullBatch in engine_vulkan.h
+struct DrawBatch {
+	uint commandBase;
+	uint indexed;
+	uint pipeline;
+	uint reserved;
+};
+
+layout(std430, set = 0, binding = 0) readonly buffer CullDataBuffer {
+	ObjectCullData objects[];
+};
+
+layout(std430, set = 0, binding = 1) readonly buffer BatchBuffer {
+	DrawBatch batches[];
+};
+
+// VkDrawIndexedIndirectCommand, or VkDrawIndirectCommand in the first 4 words
+layout(std430, set = 0, binding = 2) writeonly buffer CommandBuffer {
+	uint commands[];
+};
+
+// Culled objects at 0, then each batch's draw count
+layout(std430, set = 0, binding = 3) buffer CountBuffer {
+	uint counts[];
+};
+
+// Matches struct VulkanCullPush
+layout(push_constant) uniform CullPush {
+	vec4 planes[6];
+	uint planesSize;
+	uint objectsSize;
+	uint compact;
+	uint pipeline;
+} push;
+
+const uint OBJECT_CULL_LIVE = 1u;
+const uint OBJECT_BATCH_NONE = 0xFFFFFFFFu;
+const uint DRAW_COMMAND_WORDS = 5u;
+
+void main() {
+	uint index = gl_GlobalInvocationID.x;
+	if (index >= push.objectsSize) {
+		return;
+	}
+
+	ObjectCullData object = objects[index];
+	if (object.batch == OBJECT_BATCH_NONE) {
+		return;
+	}
+	DrawBatch batch = batches[object.batch];
+	if (batch.pipeline != push.pipeline) {
+		return;
+	}
+
+	// Box corner farthest along each plane normal decides, as in engine_cull.c
+	bool live = (object.flags & OBJECT_CULL_LIVE) != 0u;
+	bool visible = live;
+	for (uint p = 0u; p < push.planesSize && visible; p++) {
+		vec4 plane = push.planes[p];
+		vec3 corner = mix(object.boundsMin, object.boundsMax,
+						  greaterThanEqual(plane.xyz, vec3(0.0)));
+		visible = dot(plane.xyz, corner) + plane.w >= 0.0;
+	}
+	if (live && !visible) {
+		atomicAdd(counts[0], 1u);
+	}
+
+	// Compacted commands are appended, otherwise every object owns one and culled ones are empty
+	uint slot;
+	if (push.compact != 0u) {
+		if (!visible) {
+			return;
+		}
+		slot = batch.commandBase + atomicAdd(counts[object.batch + 1u], 1u);
+	} else {
+		slot = batch.commandBase + object.batchSlot;
+		if (visible) {
+			atomicAdd(counts[object.batch + 1u], 1u);
+		}
+	}
+
+	// First instance selects the object's slot in the transform buffer
+	uint word = slot * DRAW_COMMAND_WORDS;
+	commands[word] = object.count;
+	commands[word + 1u] = visible ? 1u : 0u;
+	commands[word + 2u] = object.first;
+	if (batch.indexed != 0u) {
+		commands[word + 3u] = uint(object.vertexOffset);
+		commands[word + 4u] = index;
+	} else {
+		commands[word + 3u] = index;
+	}
+}
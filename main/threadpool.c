@@ -0,0 +1,203 @@
+#include "threadpool.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+/**
+ * @brief Starts 'workers_size' worker threads
+ *
+ * The calling thread takes part in every dispatch, so a pool with zero workers is valid and runs
+ * jobs inline. Must be destroyed with 'threadpool_destroy'
+ *
+ * @param pool ThreadPool to initialize
+ * @param workers_size Number of worker threads to start
+ * @return true Pool is ready
+ * @return false Pool could not be created
+ */
+bool threadpool_init(struct ThreadPool *pool, uint32_t workers_size) {
+	if (workers_size > THREADPOOL_MAX_THREADS) {
+		workers_size = THREADPOOL_MAX_THREADS;
+	}
+
+	pool->workers_size = 0;
+	pool->func = NULL;
+	pool->ctx = NULL;
+	pool->job_size = 0;
+	pool->generation = 0;
+	pool->pending = 0;
+	pool->stop = false;
+
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->work_cond, NULL);
+	pthread_cond_init(&pool->done_cond, NULL);
+
+	uint32_t i;
+	for (i = 0; i < workers_size; i++) {
+		pool->workers[i].pool = pool;
+		pool->workers[i].slice = i + 1;
+
+		if (pthread_create(&pool->workers[i].thread, NULL, threadpool_worker, &pool->workers[i]) !=
+			0) {
+			fprintf(stderr, "Failure to create worker thread.\n");
+			threadpool_destroy(pool);
+			return false;
+		}
+
+		pool->workers_size++;
+	}
+
+	return true;
+}
+
+/**
+ * @brief Stops and joins all worker threads
+ *
+ * @param pool ThreadPool to destroy
+ */
+void threadpool_destroy(struct ThreadPool *pool) {
+	pthread_mutex_lock(&pool->lock);
+	pool->stop = true;
+	pthread_cond_broadcast(&pool->work_cond);
+	pthread_mutex_unlock(&pool->lock);
+
+	uint32_t i;
+	for (i = 0; i < pool->workers_size; i++) {
+		pthread_join(pool->workers[i].thread, NULL);
+	}
+	pool->workers_size = 0;
+
+	pthread_cond_destroy(&pool->done_cond);
+	pthread_cond_destroy(&pool->work_cond);
+	pthread_mutex_destroy(&pool->lock);
+}
+
+/**
+ * @brief Runs 'func' over [0, job_size) split into contiguous slices and waits for completion
+ *
+ * Slice boundaries only depend on 'job_size' and the slice count, so two dispatches of the same
+ * size see the same partition. Only one thread may dispatch at a time
+ *
+ * @param pool ThreadPool to run on
+ * @param func Function called with (ctx, start, end, slice) for every non-empty slice
+ * @param ctx Context passed to 'func'
+ * @param job_size Number of items to process
+ */
+void threadpool_dispatch(struct ThreadPool *pool, void (*func)(void *, size_t, size_t, uint32_t),
+						 void *ctx, size_t job_size) {
+	size_t start, end;
+
+	// Wake workers
+	pthread_mutex_lock(&pool->lock);
+	pool->func = func;
+	pool->ctx = ctx;
+	pool->job_size = job_size;
+	pool->pending = pool->workers_size;
+	pool->generation++;
+	pthread_cond_broadcast(&pool->work_cond);
+	pthread_mutex_unlock(&pool->lock);
+
+	// Calling thread takes slice 0
+	threadpool_slicerange(job_size, 0, pool->workers_size + 1, &start, &end);
+	if (start < end) {
+		func(ctx, start, end, 0);
+	}
+
+	// Wait for the rest
+	pthread_mutex_lock(&pool->lock);
+	while (pool->pending > 0) {
+		pthread_cond_wait(&pool->done_cond, &pool->lock);
+	}
+	pthread_mutex_unlock(&pool->lock);
+}
+
+/**
+ * @brief Number of slices a dispatch is split into
+ *
+ * @param pool ThreadPool to check
+ * @return uint32_t Worker count plus the calling thread
+ */
+uint32_t threadpool_slicecount(struct ThreadPool *pool) {
+	return pool->workers_size + 1;
+}
+
+/**
+ * @brief Calculates the item range of one slice
+ *
+ * @param job_size Number of items in the job
+ * @param slice Slice index
+ * @param slices Total slice count
+ * @param start Output first item
+ * @param end Output one past the last item
+ */
+void threadpool_slicerange(size_t job_size, uint32_t slice, uint32_t slices, size_t *start,
+						   size_t *end) {
+	size_t base = job_size / slices, extra = job_size % slices;
+
+	// First 'extra' slices take one more item
+	*start = base * slice + ((slice < extra) ? slice : extra);
+	*end = *start + base + ((slice < extra) ? 1 : 0);
+}
+
+/**
+ * @brief Counts online processors
+ *
+ * @return uint32_t Processor count, at least 1
+ */
+uint32_t threadpool_processorcount() {
+#ifdef _WIN32
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return (info.dwNumberOfProcessors > 0) ? info.dwNumberOfProcessors : 1;
+#else
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+	return (count > 0) ? (uint32_t)count : 1;
+#endif
+}
+
+/**
+ * @brief Worker thread loop, waits for a new job generation and runs its slice
+ *
+ * @param arg ThreadPoolWorker owned by the pool
+ * @return void* Unused
+ */
+void *threadpool_worker(void *arg) {
+	struct ThreadPoolWorker *worker = arg;
+	struct ThreadPool *pool = worker->pool;
+	uint64_t seen = 0;
+	size_t start, end;
+
+	while (true) {
+		pthread_mutex_lock(&pool->lock);
+		while (pool->stop == false && pool->generation == seen) {
+			pthread_cond_wait(&pool->work_cond, &pool->lock);
+		}
+		if (pool->stop) {
+			pthread_mutex_unlock(&pool->lock);
+			break;
+		}
+
+		seen = pool->generation;
+		void (*func)(void *, size_t, size_t, uint32_t) = pool->func;
+		void *ctx = pool->ctx;
+		size_t job_size = pool->job_size;
+		uint32_t slices = pool->workers_size + 1;
+		pthread_mutex_unlock(&pool->lock);
+
+		threadpool_slicerange(job_size, worker->slice, slices, &start, &end);
+		if (start < end) {
+			func(ctx, start, end, worker->slice);
+		}
+
+		pthread_mutex_lock(&pool->lock);
+		pool->pending--;
+		if (pool->pending == 0) {
+			pthread_cond_signal(&pool->done_cond);
+		}
+		pthread_mutex_unlock(&pool->lock);
+	}
+
+	return NULL;
+}
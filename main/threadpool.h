@@ -0,0 +1,45 @@
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#define THREADPOOL_MAX_THREADS 32
+
+struct ThreadPoolWorker {
+	struct ThreadPool *pool;
+	uint32_t slice;
+	pthread_t thread;
+};
+
+struct ThreadPool {
+	struct ThreadPoolWorker workers[THREADPOOL_MAX_THREADS];
+	uint32_t workers_size;
+
+	pthread_mutex_t lock;
+	pthread_cond_t work_cond;
+	pthread_cond_t done_cond;
+
+	// Current job, split into workers_size + 1 contiguous slices
+	void (*func)(void *, size_t, size_t, uint32_t);
+	void *ctx;
+	size_t job_size;
+	uint64_t generation;
+	uint32_t pending;
+	bool stop;
+};
+
+bool threadpool_init(struct ThreadPool *, uint32_t);
+void threadpool_destroy(struct ThreadPool *);
+void threadpool_dispatch(struct ThreadPool *, void (*)(void *, size_t, size_t, uint32_t), void *,
+						 size_t);
+uint32_t threadpool_slicecount(struct ThreadPool *);
+void threadpool_slicerange(size_t, uint32_t, uint32_t, size_t *, size_t *);
+uint32_t threadpool_processorcount();
+void *threadpool_worker(void *);
+
+#endif	// THREADPOOL_H